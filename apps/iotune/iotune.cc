@@ -27,6 +27,7 @@
 #include <memory>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include <sys/vfs.h>
 #include <sys/sysmacros.h>
 #include <boost/range/irange.hpp>
@@ -51,6 +52,8 @@
 #include <seastar/util/log.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/read_first_line.hh>
+#include <seastar/util/conversions.hh>
+#include <seastar/core/align.hh>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -200,6 +203,21 @@ struct io_rates {
     }
 };
 
+struct mixed_rates {
+    io_rates read;
+    io_rates write;
+    // Of the worst shard
+    std::chrono::duration<double> p99_latency{0};
+
+    mixed_rates operator+(const mixed_rates& a) const {
+        return mixed_rates{read + a.read, write + a.write, std::max(p99_latency, a.p99_latency)};
+    }
+
+    float iops() const {
+        return read.iops + write.iops;
+    }
+};
+
 struct row_stats {
     size_t points;
     double average;
@@ -410,6 +428,72 @@ class io_worker {
     }
 };
 
+// Issues random reads and writes of several sizes in the given proportion
+// and keeps track of how long each of them takes
+class mixed_io_worker {
+    file _file;
+    uint64_t _file_size;
+    std::vector<size_t> _sizes;
+    std::bernoulli_distribution _is_read;
+    std::uniform_int_distribution<size_t> _size_idx;
+    uint64_t _bytes[2] = {};
+    unsigned _requests[2] = {};
+    std::vector<float> _latencies_us;
+    std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _start_measuring;
+    std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _end_measuring;
+    std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _end_load;
+public:
+    mixed_io_worker(file f, uint64_t file_size, double read_ratio, std::vector<size_t> sizes, std::chrono::duration<double> duration)
+        : _file(std::move(f))
+        , _file_size(file_size)
+        , _sizes(std::move(sizes))
+        , _is_read(read_ratio)
+        , _size_idx(0, _sizes.size() - 1)
+        , _start_measuring(iotune_clock::now() + std::chrono::duration<double>(10ms))
+        , _end_measuring(_start_measuring + duration)
+        , _end_load(_end_measuring + 10ms)
+    {}
+
+    bool should_stop() const {
+        return iotune_clock::now() >= _end_load;
+    }
+
+    std::unique_ptr<char[], free_deleter> get_buffer() {
+        auto max_size = *std::max_element(_sizes.begin(), _sizes.end());
+        return allocate_aligned_buffer<char>(max_size, _file.memory_dma_alignment());
+    }
+
+    future<> issue_request(char* buf) {
+        bool read = _is_read(random_generator);
+        auto size = _sizes[_size_idx(random_generator)];
+        uint64_t pos = std::uniform_int_distribution<uint64_t>(0, _file_size / size - 1)(random_generator) * size;
+        auto start = iotune_clock::now();
+        auto f = read ? _file.dma_read(pos, buf, size) : _file.dma_write(pos, buf, size);
+        return f.then([this, read, start] (size_t size) {
+            auto now = iotune_clock::now();
+            if ((start > _start_measuring) && (now < _end_measuring)) {
+                _latencies_us.push_back(std::chrono::duration<float, std::micro>(now - start).count());
+                _bytes[read] += size;
+                _requests[read]++;
+            }
+        });
+    }
+
+    mixed_rates get_rates() {
+        if (_latencies_us.empty()) {
+            throw std::runtime_error("No data collected");
+        }
+        auto t = (_end_measuring - _start_measuring).count();
+        mixed_rates rates;
+        rates.read = io_rates{float(_bytes[1] / t), float(_requests[1] / t)};
+        rates.write = io_rates{float(_bytes[0] / t), float(_requests[0] / t)};
+        auto p99 = _latencies_us.begin() + _latencies_us.size() * 99 / 100;
+        std::nth_element(_latencies_us.begin(), p99, _latencies_us.end());
+        rates.p99_latency = std::chrono::duration<float, std::micro>(*p99);
+        return rates;
+    }
+};
+
 class test_file {
 public:
     enum class pattern { sequential, random };
@@ -495,6 +579,35 @@ class test_file {
         });
     }
 
+    future<mixed_rates> mixed_workload(double read_ratio, std::vector<size_t> sizes, unsigned max_os_concurrency, std::chrono::duration<double> duration) {
+        if (!max_os_concurrency) {
+            return make_ready_future<mixed_rates>();
+        }
+        auto alignment = std::max(_file.disk_read_dma_alignment(), _file.disk_write_dma_alignment());
+        // The sequential write test decides how large the file grows, so
+        // larger requests can only be clamped to it here
+        auto max_size = align_down<uint64_t>(_file_size, alignment);
+        if (!max_size) {
+            return make_exception_future<mixed_rates>(std::runtime_error("Test file too small for the mixed workload"));
+        }
+        for (auto& size : sizes) {
+            size = std::min<uint64_t>(align_up(std::max(size, alignment), alignment), max_size);
+        }
+        auto worker = std::make_unique<mixed_io_worker>(_file, _file_size, read_ratio, std::move(sizes), duration);
+        auto concurrency = boost::irange<unsigned, unsigned>(0, max_os_concurrency, 1);
+        return parallel_for_each(std::move(concurrency), [worker = worker.get()] (unsigned idx) {
+            auto bufptr = worker->get_buffer();
+            auto buf = bufptr.get();
+            return do_until([worker] { return worker->should_stop(); }, [buf, worker] {
+                return worker->issue_request(buf);
+            }).finally([alive = std::move(bufptr)] {});
+        }).then([this, worker = std::move(worker)] () mutable {
+            return _file.flush().then([worker = std::move(worker)] {
+                return worker->get_rates();
+            });
+        });
+    }
+
     future<> stop() {
         return _file.close();
     }
@@ -573,6 +686,14 @@ class iotune_multi_shard_context {
         }, io_rates(), std::plus<io_rates>());
     }
 
+    // The iodepth is the total one, split between the shards
+    future<mixed_rates> mixed_data(double read_ratio, std::vector<size_t> sizes, unsigned iodepth, std::chrono::duration<double> duration) {
+        return _iotune_test_file.map_reduce0([read_ratio, sizes = std::move(sizes), iodepth, duration] (test_file& tf) {
+            auto shard_iodepth = iodepth / smp::count + (this_shard_id() < iodepth % smp::count ? 1 : 0);
+            return tf.mixed_workload(read_ratio, sizes, shard_iodepth, duration);
+        }, mixed_rates(), std::plus<mixed_rates>());
+    }
+
 private:
     template <typename Fn>
     future<uint64_t> saturate(float rate_threshold, size_t buffer_size, std::chrono::duration<double> duration, Fn&& workload) {
@@ -604,6 +725,14 @@ class iotune_multi_shard_context {
     {}
 };
 
+// The highest throughput seen with the given mix of reads and writes that
+// kept the p99 latency within the target
+struct mixed_point {
+    double read_ratio;
+    std::chrono::duration<double> latency_target;
+    mixed_rates rates;
+};
+
 struct disk_descriptor {
     std::string mountpoint;
     uint64_t read_iops;
@@ -612,6 +741,7 @@ struct disk_descriptor {
     uint64_t write_bw;
     std::optional<uint64_t> read_sat_len;
     std::optional<uint64_t> write_sat_len;
+    std::vector<mixed_point> mixed;
 };
 
 void string_to_file(sstring conf_file, sstring buf) {
@@ -650,6 +780,22 @@ void write_property_file(sstring conf_file, std::vector<disk_descriptor> disk_de
         if (desc.write_sat_len) {
             out << YAML::Key << "write_saturation_length" << YAML::Value << *desc.write_sat_len;
         }
+        if (!desc.mixed.empty()) {
+            out << YAML::Key << "mixed_workloads";
+            out << YAML::BeginSeq;
+            for (auto& p : desc.mixed) {
+                out << YAML::BeginMap;
+                out << YAML::Key << "read_ratio" << YAML::Value << p.read_ratio;
+                out << YAML::Key << "latency_target_us" << YAML::Value << uint64_t(std::chrono::duration<double, std::micro>(p.latency_target).count());
+                out << YAML::Key << "p99_latency_us" << YAML::Value << uint64_t(std::chrono::duration<double, std::micro>(p.rates.p99_latency).count());
+                out << YAML::Key << "read_iops" << YAML::Value << uint64_t(p.rates.read.iops);
+                out << YAML::Key << "read_bandwidth" << YAML::Value << uint64_t(p.rates.read.bytes_per_sec);
+                out << YAML::Key << "write_iops" << YAML::Value << uint64_t(p.rates.write.iops);
+                out << YAML::Key << "write_bandwidth" << YAML::Value << uint64_t(p.rates.write.bytes_per_sec);
+                out << YAML::EndMap;
+            }
+            out << YAML::EndSeq;
+        }
         out << YAML::EndMap;
     }
     out << YAML::EndSeq;
@@ -697,6 +843,9 @@ int main(int ac, char** av) {
         ("fs-check", bpo::bool_switch(&fs_check), "perform FS check only")
         ("accuracy", bpo::value<unsigned>()->default_value(3), "acceptable deviation of measurements (percents)")
         ("saturation", bpo::value<sstring>()->default_value(""), "measure saturation lengths (read | write | both) (this is very slow!)")
+        ("mixed-read-ratios", bpo::value<std::vector<double>>()->multitoken(), "measure mixed random workloads with these fractions of reads (e.g. 0.5 0.9)")
+        ("mixed-request-sizes", bpo::value<std::vector<sstring>>()->multitoken(), "request sizes of the mixed workloads, picked evenly (minimum I/O size if not set, clamped to the test file size)")
+        ("latency-targets-ms", bpo::value<std::vector<double>>()->multitoken()->default_value({0.5, 1, 2, 5}, "0.5 1 2 5"), "p99 latencies at which to report the mixed workloads throughput")
     ;
 
     return app.run(ac, av, [&] {
@@ -707,6 +856,31 @@ int main(int ac, char** av) {
             auto duration = std::chrono::duration<double>(configuration["duration"].as<unsigned>() * 1s);
             auto accuracy = configuration["accuracy"].as<unsigned>();
             auto saturation = configuration["saturation"].as<sstring>();
+            std::vector<double> mixed_read_ratios;
+            if (configuration.count("mixed-read-ratios")) {
+                mixed_read_ratios = configuration["mixed-read-ratios"].as<std::vector<double>>();
+            }
+            std::vector<size_t> mixed_request_sizes;
+            if (configuration.count("mixed-request-sizes")) {
+                for (auto& size : configuration["mixed-request-sizes"].as<std::vector<sstring>>()) {
+                    mixed_request_sizes.push_back(parse_memory_size(size));
+                }
+            }
+            std::vector<std::chrono::duration<double>> latency_targets;
+            for (auto ms : configuration["latency-targets-ms"].as<std::vector<double>>()) {
+                latency_targets.push_back(ms * 1ms);
+            }
+            std::sort(latency_targets.begin(), latency_targets.end());
+            for (auto ratio : mixed_read_ratios) {
+                if (ratio < 0 || ratio > 1) {
+                    fmt::print("Bad --mixed-read-ratios value\n");
+                    return 1;
+                }
+            }
+            if (!mixed_read_ratios.empty() && latency_targets.empty()) {
+                fmt::print("Bad --latency-targets-ms value\n");
+                return 1;
+            }
 
             bool read_saturation, write_saturation;
             if (saturation == "") {
@@ -841,6 +1015,43 @@ int main(int ac, char** av) {
                 rates = iotune_tests.get_sharded_worst_rates().get0();
                 fmt::print("{} IOPS{}\n", uint64_t(read_iops.iops), accuracy_msg());
 
+                // Every mix is measured at growing iodepths until the p99
+                // latency goes above the largest target. Each target then
+                // gets the best throughput among the iodepths that met it.
+                std::vector<mixed_point> mixed;
+                auto sizes = mixed_request_sizes.empty() ? std::vector<size_t>({test_directory.minimum_io_size()}) : mixed_request_sizes;
+                auto max_iodepth = std::min(test_directory.max_iodepth(), 128 * smp::count);
+                // Share of the duration each iodepth step runs for. A mix
+                // takes up to log2(max_iodepth) + 1 steps, e.g. 8 steps and
+                // 16% of the duration on a single shard.
+                constexpr double mixed_step_share = 0.02;
+                for (auto ratio : mixed_read_ratios) {
+                    fmt::print("Measuring mixed workload with {}% reads:\n", int(round(ratio * 100)));
+                    std::vector<mixed_rates> sweep;
+                    for (unsigned iodepth = 1; iodepth <= max_iodepth; iodepth *= 2) {
+                        auto rates = iotune_tests.mixed_data(ratio, sizes, iodepth, duration * mixed_step_share).get0();
+                        sweep.push_back(rates);
+                        if (rates.p99_latency > latency_targets.back()) {
+                            break;
+                        }
+                    }
+                    for (auto target : latency_targets) {
+                        const mixed_rates* best = nullptr;
+                        for (auto& rates : sweep) {
+                            if (rates.p99_latency <= target && (!best || rates.iops() > best->iops())) {
+                                best = &rates;
+                            }
+                        }
+                        if (!best) {
+                            fmt::print("  p99 {}us: not reached\n", uint64_t(target / 1us));
+                            continue;
+                        }
+                        fmt::print("  p99 {}us: {} IOPS, {} MB/s\n", uint64_t(target / 1us), uint64_t(best->iops()),
+                                uint64_t((best->read.bytes_per_sec + best->write.bytes_per_sec) / (1024 * 1024)));
+                        mixed.push_back(mixed_point{ratio, target, *best});
+                    }
+                }
+
                 struct disk_descriptor desc;
                 desc.mountpoint = mountpoint;
                 desc.read_iops = read_iops.iops;
@@ -849,6 +1060,7 @@ int main(int ac, char** av) {
                 desc.write_iops = write_iops.iops;
                 desc.write_bw = write_bw.bytes_per_sec;
                 desc.write_sat_len = write_sat;
+                desc.mixed = std::move(mixed);
                 disk_descriptors.push_back(std::move(desc));
             }
 
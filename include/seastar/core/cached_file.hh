@@ -0,0 +1,215 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <boost/intrusive/list.hpp>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+class cached_file_impl;
+
+/// Shard-local cache of file blocks.
+///
+/// The cache keeps fixed-size blocks of the files wrapped with
+/// \ref make_cached_file() in the memory of the shard it was created on.
+/// A shard may have several caches, e.g. one per kind of file, each with
+/// its own capacity and metrics.
+///
+/// Blocks are evicted in segmented LRU order: a block read from the disk
+/// starts in the probationary segment and is moved to the protected one
+/// when it's hit again. Eviction takes the least recently used
+/// probationary blocks first, so a single scan through a large file
+/// doesn't push out blocks that are in use. The cache registers a
+/// memory reclaimer and gives up blocks when the shard runs low on memory.
+///
+/// Concurrent reads missing the same block are served by a single read
+/// of the underlying file.
+///
+/// The cache must outlive the files using it.
+class block_cache {
+public:
+    struct config {
+        /// Memory the cached blocks may take, in bytes
+        size_t capacity = 64 << 20;
+        /// Size of a cached block, rounded up to a multiple of 4096
+        size_t block_size = 32 << 10;
+        /// Share of the capacity the protected segment may take
+        float protected_share = 0.8;
+        /// Value of the "cache" label of the metrics
+        sstring name = "default";
+    };
+
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t coalesced = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+        uint64_t blocks = 0;
+        uint64_t bytes = 0;
+    };
+private:
+    using list_hook = boost::intrusive::list_member_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
+
+    struct key {
+        uint64_t file_id;
+        uint64_t index;
+        bool operator==(const key& o) const noexcept {
+            return file_id == o.file_id && index == o.index;
+        }
+    };
+    struct key_hash {
+        size_t operator()(const key& k) const noexcept {
+            return std::hash<uint64_t>()(k.file_id * 0x9e3779b97f4a7c15ull ^ k.index);
+        }
+    };
+
+    struct block {
+        key k;
+        temporary_buffer<char> data;
+        bool is_protected = false;
+        list_hook lru_hook;
+        list_hook file_hook;
+
+        block(key k, temporary_buffer<char> data) noexcept : k(k), data(std::move(data)) {}
+    };
+
+    template <list_hook block::*Hook>
+    using block_list = boost::intrusive::list<block,
+            boost::intrusive::member_hook<block, list_hook, Hook>,
+            boost::intrusive::constant_time_size<false>>;
+    using lru_list = block_list<&block::lru_hook>;
+    using file_list = block_list<&block::file_hook>;
+
+    struct pending_read {
+        shared_promise<> ready;
+        temporary_buffer<char> data;
+    };
+
+    config _config;
+    uint64_t _next_file_id = 0;
+    std::unordered_map<key, std::unique_ptr<block>, key_hash> _blocks;
+    std::unordered_map<key, lw_shared_ptr<pending_read>, key_hash> _pending;
+    // Least recently used blocks first
+    lru_list _probationary;
+    lru_list _protected;
+    uint64_t _protected_bytes = 0;
+    stats _stats;
+    memory::reclaimer _reclaimer;
+    metrics::metric_groups _metrics;
+
+    friend class cached_file_impl;
+
+    uint64_t register_file() noexcept { return _next_file_id++; }
+    future<temporary_buffer<char>> get_block(cached_file_impl& f, uint64_t index, const io_priority_class& pc);
+    void insert(cached_file_impl& f, uint64_t index, temporary_buffer<char> data);
+    void touch(block& b) noexcept;
+    void erase(block& b) noexcept;
+    // Drops the blocks of the file in [first, last] and forgets the reads
+    // of them in flight. Returns the number of blocks dropped.
+    uint64_t drop(cached_file_impl& f, uint64_t first, uint64_t last) noexcept;
+    void evict_to(size_t bytes) noexcept;
+    memory::reclaiming_result reclaim(memory::reclaimer::request req) noexcept;
+public:
+    explicit block_cache(config cfg);
+    block_cache(block_cache&&) = delete;
+    ~block_cache();
+
+    size_t block_size() const noexcept { return _config.block_size; }
+    size_t capacity() const noexcept { return _config.capacity; }
+    /// Changes the capacity, evicting blocks if the cache takes more
+    void set_capacity(size_t capacity) noexcept;
+    /// Evicts blocks taking at least the given number of bytes, or all of
+    /// them. Returns the number of bytes evicted.
+    size_t evict(size_t bytes) noexcept;
+
+    const stats& get_stats() const noexcept { return _stats; }
+};
+
+/// A \ref layered_file_impl serving reads from a \ref block_cache.
+///
+/// Reads are split into cache blocks; missing blocks are read from the
+/// underlying file and inserted into the cache. Writes, truncation,
+/// discards and allocations go to the underlying file and drop the
+/// cached blocks they affect.
+///
+/// dma_read_bulk() of a range within one block returns a buffer sharing
+/// the memory of the cached block, so callers must not modify it. Input
+/// streams created with make_file_input_stream() only read their buffers.
+class cached_file_impl : public layered_file_impl {
+    friend class block_cache;
+
+    block_cache& _cache;
+    const uint64_t _id;
+    block_cache::file_list _blocks;
+    gate _gate;
+    // Bumped by every operation changing the contents of the file, reads
+    // started before it mustn't populate the cache.
+    uint64_t _generation = 0;
+
+    future<std::vector<temporary_buffer<char>>> read_blocks(uint64_t pos, size_t len, const io_priority_class& pc);
+    void invalidate(uint64_t pos, uint64_t len) noexcept;
+    // Runs an operation changing [pos, pos + len) of the underlying file
+    template <typename Func>
+    futurize_t<std::invoke_result_t<Func>> modify(uint64_t pos, uint64_t len, Func&& op) noexcept;
+public:
+    cached_file_impl(file underlying_file, block_cache& cache);
+    ~cached_file_impl();
+
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override;
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override;
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) override;
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) override;
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override;
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override;
+    virtual future<> flush() override;
+    virtual future<struct stat> stat() override;
+    virtual future<> truncate(uint64_t length) override;
+    virtual future<> discard(uint64_t offset, uint64_t length) override;
+    virtual future<> allocate(uint64_t position, uint64_t length) override;
+    virtual future<uint64_t> size() override;
+    virtual future<> close() override;
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override;
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override;
+};
+
+/// Wraps a file so that its reads are served from the given cache.
+///
+/// \param f the file to cache
+/// \param cache shard-local cache to keep the blocks of the file in, must
+///        outlive the returned file
+file make_cached_file(file f, block_cache& cache);
+
+/// @}
+
+}
@@ -21,12 +21,15 @@
  */
 #pragma once
 
-#include <boost/intrusive/slist.hpp>
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/set.hpp>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/util/shared_token_bucket.hh>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <functional>
@@ -103,19 +106,40 @@ class fair_queue_ticket {
 
 class fair_queue_entry {
     friend class fair_queue;
-
+public:
+    using clock_type = std::chrono::steady_clock;
+private:
     fair_queue_ticket _ticket;
-    bi::slist_member_hook<> _hook;
+    clock_type::time_point _deadline = clock_type::time_point::max();
+    // All entries are linked with the former in the order they were queued,
+    // and the ones with a deadline are also indexed by it with the latter
+    bi::list_member_hook<> _hook;
+    bi::set_member_hook<bi::optimize_size<true>> _deadline_hook;
+
+    struct deadline_compare {
+        bool operator()(const fair_queue_entry& a, const fair_queue_entry& b) const noexcept {
+            return a._deadline < b._deadline;
+        }
+    };
 
 public:
     fair_queue_entry(fair_queue_ticket t) noexcept
         : _ticket(std::move(t)) {}
-    using container_list_t = bi::slist<fair_queue_entry,
+    using container_list_t = bi::list<fair_queue_entry,
+            bi::constant_time_size<false>,
+            bi::member_hook<fair_queue_entry, bi::list_member_hook<>, &fair_queue_entry::_hook>>;
+    using deadline_set_t = bi::multiset<fair_queue_entry,
             bi::constant_time_size<false>,
-            bi::cache_last<true>,
-            bi::member_hook<fair_queue_entry, bi::slist_member_hook<>, &fair_queue_entry::_hook>>;
+            bi::compare<deadline_compare>,
+            bi::member_hook<fair_queue_entry, bi::set_member_hook<bi::optimize_size<true>>, &fair_queue_entry::_deadline_hook>>;
 
     fair_queue_ticket ticket() const noexcept { return _ticket; }
+
+    /// Sets the time by which the request must be dispatched. Must be
+    /// called before the entry is queued.
+    void set_deadline(clock_type::time_point deadline) noexcept { _deadline = deadline; }
+    bool has_deadline() const noexcept { return _deadline != clock_type::time_point::max(); }
+    clock_type::time_point deadline() const noexcept { return _deadline; }
 };
 
 /// \brief Group of queues class
@@ -209,6 +233,19 @@ class fair_group {
 
     const fair_queue_ticket _cost_capacity;
     token_bucket_t _token_bucket;
+    // The configured replenish rate
+    const capacity_t _base_rate;
+
+    /*
+     * With capacity borrowing the per-poll dispatch limit of a shard is
+     * not a fixed 1/smp::count of the group capacity. Instead the capacity
+     * is split between the shards that have requests queued in proportion
+     * to the shares of their backlogged classes, so that a hot shard can
+     * use the part idle siblings leave behind. Every queue adds the shares
+     * of its backlogged classes to this sum.
+     */
+    const bool _capacity_borrowing;
+    std::atomic<uint64_t> _backlog_shares = 0;
 
 public:
 
@@ -238,6 +275,7 @@ class fair_group {
         unsigned long size_rate;
         float rate_factor = 1.0;
         std::chrono::duration<double> rate_limit_duration = std::chrono::milliseconds(1);
+        bool capacity_borrowing = false;
     };
 
     explicit fair_group(config cfg);
@@ -250,10 +288,23 @@ class fair_group {
     void release_capacity(capacity_t cap) noexcept;
     void replenish_capacity(clock_type::time_point now) noexcept;
     void maybe_replenish_capacity(clock_type::time_point& local_ts) noexcept;
+    // Replenish at the given fraction of the configured rate
+    void scale_rate(double scale) noexcept;
+    double rate_scale() const noexcept {
+        return double(_token_bucket.rate()) / _base_rate;
+    }
 
     capacity_t capacity_deficiency(capacity_t from) const noexcept;
     capacity_t ticket_capacity(fair_queue_ticket ticket) const noexcept;
 
+    bool capacity_borrowing() const noexcept { return _capacity_borrowing; }
+    void update_backlog_shares(int64_t delta) noexcept {
+        _backlog_shares.fetch_add(delta, std::memory_order_relaxed);
+    }
+    // How much a queue whose backlogged classes have the given shares may
+    // dispatch in one poll
+    capacity_t dispatch_quota(uint64_t shares) const noexcept;
+
     std::chrono::duration<double> rate_limit_duration() const noexcept {
         std::chrono::duration<double, rate_resolution> dur((double)_token_bucket.limit() / _token_bucket.rate());
         return std::chrono::duration_cast<std::chrono::duration<double>>(dur);
@@ -288,6 +339,11 @@ class fair_queue {
     struct config {
         sstring label = "";
         std::chrono::microseconds tau = std::chrono::milliseconds(5);
+        /// Requests due within this time are dispatched ahead of the
+        /// requests their class queued before them, and ahead of other
+        /// classes that are less than \c tau worth of shares behind.
+        /// Otherwise requests with a deadline keep their place in the queue.
+        std::chrono::microseconds deadline_horizon = std::chrono::milliseconds(5);
     };
 
     using class_id = unsigned int;
@@ -312,6 +368,16 @@ class fair_queue {
         void assert_enough_capacity() const noexcept {
             assert(c.size() < c.capacity());
         }
+
+        // Removes a class that is not necessarily on top
+        void remove(priority_class_ptr pc) noexcept {
+            c.erase(std::find(c.begin(), c.end(), pc));
+            std::make_heap(c.begin(), c.end(), comp);
+        }
+
+        const std::vector<priority_class_ptr>& classes() const noexcept {
+            return c;
+        }
     };
 
     config _config;
@@ -325,6 +391,12 @@ class fair_queue {
     std::vector<std::unique_ptr<priority_class_data>> _priority_classes;
     size_t _nr_classes = 0;
     capacity_t _last_accumulated = 0;
+    // Queued entries with a deadline
+    unsigned _nr_deadlines = 0;
+    // Shares of the plugged classes with queued requests, and the part
+    // of it that's accounted on the group (see fair_group::dispatch_quota)
+    uint64_t _backlog_shares = 0;
+    uint64_t _published_backlog_shares = 0;
 
     /*
      * When the shared capacity os over the local queue delays
@@ -332,16 +404,20 @@ class fair_queue {
      *
      * \head  -- the value group head rover is expected to cross
      * \cap   -- the capacity that's accounted on the group
+     * \pc    -- the class the capacity is grabbed for
      *
-     * The last field is needed to "rearm" the wait in case
+     * The cap field is needed to "rearm" the wait in case
      * queue decides that it wants to dispatch another capacity
-     * in the middle of the waiting
+     * in the middle of the waiting. The class is needed to grab
+     * more if its next entry needs more while waiting, e.g. when
+     * it grew or was overtaken by one due soon
      */
     struct pending {
         capacity_t head;
         capacity_t cap;
+        const priority_class_data* pc;
 
-        pending(capacity_t t, capacity_t c) noexcept : head(t), cap(c) {}
+        pending(capacity_t t, capacity_t c, const priority_class_data* p) noexcept : head(t), cap(c), pc(p) {}
     };
 
     std::optional<pending> _pending;
@@ -353,8 +429,15 @@ class fair_queue {
     void unplug_priority_class(priority_class_data& pc) noexcept;
 
     enum class grab_result { grabbed, cant_preempt, pending };
-    grab_result grab_capacity(const fair_queue_entry& ent) noexcept;
-    grab_result grab_pending_capacity(const fair_queue_entry& ent) noexcept;
+    grab_result grab_capacity(const priority_class_data& pc, const fair_queue_entry& ent) noexcept;
+    grab_result grab_pending_capacity(const priority_class_data& pc, const fair_queue_entry& ent) noexcept;
+
+    capacity_t max_deviation(const priority_class_data& pc) const noexcept;
+    fair_queue_entry& next_entry(priority_class_data& pc, clock_type::time_point now) noexcept;
+    void pop_entry(priority_class_data& pc, fair_queue_entry& ent) noexcept;
+    priority_class_data& pick_class(clock_type::time_point now) noexcept;
+    void expire_requests(clock_type::time_point now, const std::function<void(fair_queue_entry&)>& expired);
+    void publish_backlog_shares() noexcept;
 public:
     /// Constructs a fair queue with configuration parameters \c cfg.
     ///
@@ -404,9 +487,15 @@ class fair_queue {
     /// \param desc an instance of \c fair_queue_ticket structure describing the request that just finished.
     void notify_request_finished(fair_queue_ticket desc) noexcept;
     void notify_request_cancelled(fair_queue_entry& ent) noexcept;
+    /// Changes the ticket of a queued entry, e.g. when more work was merged into it
+    void update_request_ticket(fair_queue_entry& ent, fair_queue_ticket ticket) noexcept;
 
     /// Try to execute new requests if there is capacity left in the queue.
     void dispatch_requests(std::function<void(fair_queue_entry&)> cb);
+    /// Same as above, and hands the queued requests whose deadline passed
+    /// to \c expired instead. Those are removed from the queue without
+    /// being accounted as executing.
+    void dispatch_requests(std::function<void(fair_queue_entry&)> cb, std::function<void(fair_queue_entry&)> expired);
 
     clock_type::time_point next_pending_aio() const noexcept;
 
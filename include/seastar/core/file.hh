@@ -134,6 +134,9 @@ class file_impl {
         return read_dma(pos, std::move(iov), pc);
     }
 
+    // Default implementation writes and then flushes
+    virtual future<size_t> write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent*) noexcept;
+
     virtual future<> flush(void) = 0;
     virtual future<struct stat> stat(void) = 0;
     virtual future<> truncate(uint64_t length) = 0;
@@ -368,6 +371,27 @@ class file {
     ///         write may happen due to an I/O error.
     future<size_t> dma_write(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc = default_priority_class(), io_intent* intent = nullptr) noexcept;
 
+    /// Performs a DMA write from the specified buffer and makes it stable on persistent storage.
+    ///
+    /// Equivalent to \ref dma_write() followed by \ref flush(), but where the reactor
+    /// backend supports it (io_uring) the two are submitted to the kernel together,
+    /// saving the round trip between them. Only the data written is accounted
+    /// against the I/O priority class, just as with the separate calls.
+    ///
+    /// \param pos offset to write into.  Must be aligned to \ref disk_write_dma_alignment.
+    /// \param buffer aligned address of buffer to read from.  Buffer must exists
+    ///               until the future is made ready.
+    /// \param len number of bytes to write.  Must be aligned.
+    /// \param pc the IO priority class under which to queue this operation
+    /// \param intent the IO intention confirmation (\ref seastar::io_intent)
+    ///
+    /// \return a future representing the number of bytes actually written and
+    ///         made stable.  A short write may happen due to an I/O error.
+    template <typename CharType>
+    future<size_t> dma_write_and_sync(uint64_t pos, const CharType* buffer, size_t len, const io_priority_class& pc = default_priority_class(), io_intent* intent = nullptr) noexcept {
+        return dma_write_and_sync_impl(pos, reinterpret_cast<const uint8_t*>(buffer), len, pc, intent);
+    }
+
     /// Causes any previously written data to be made stable on persistent storage.
     ///
     /// Prior to a flush, written data may or may not survive a power failure.  After
@@ -568,6 +592,9 @@ class file {
     future<size_t>
     dma_write_impl(uint64_t pos, const uint8_t* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept;
 
+    future<size_t>
+    dma_write_and_sync_impl(uint64_t pos, const uint8_t* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept;
+
     future<temporary_buffer<uint8_t>>
     dma_read_impl(uint64_t pos, size_t len, const io_priority_class& pc, io_intent* intent) noexcept;
 
@@ -34,6 +34,7 @@
 #include <seastar/core/iostream.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/internal/api-level.hh>
+#include <seastar/core/internal/read_ahead_engine.hh>
 #include <cstdint>
 
 namespace seastar {
@@ -47,6 +48,8 @@ class file_input_stream_history {
     window current_window;
     window previous_window;
     unsigned read_ahead = 1;
+    // Shared by all the streams using this history, see read_ahead_engine
+    internal::read_ahead_engine engine;
 
     friend class file_data_source_impl;
 };
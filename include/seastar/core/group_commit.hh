@@ -0,0 +1,142 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+struct group_commit_options {
+    /// Batches are cut at this many bytes
+    size_t max_batch_size = 1 << 20;
+    /// Longest time a batch may be held open waiting for more appends,
+    /// zero to commit as soon as the previous batch is durable
+    std::chrono::microseconds max_delay = std::chrono::milliseconds(2);
+    ::seastar::io_priority_class io_priority_class = default_priority_class();
+};
+
+/// Appends records of many fibers to a file, committing them in batches.
+///
+/// Appended data is copied into the open batch. A batch is written with
+/// a single aligned dma_write() followed by a single flush(), and every
+/// append in it completes when the flush does. Only one batch is committed
+/// at a time, so appends made while a commit is in flight are grouped in
+/// the next batch.
+///
+/// The writer estimates the rate of appends and the commit latency. When
+/// fewer bytes than arrive during a commit are pending, it holds the batch
+/// open for up to half the commit latency (but at most
+/// \ref group_commit_options::max_delay) so that the next sync covers
+/// more appends.
+///
+/// Once a commit fails, the appends it carried and all later ones fail
+/// with the same exception.
+class group_commit_writer {
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    struct stats {
+        uint64_t appends = 0;
+        uint64_t bytes = 0;
+        uint64_t batches = 0;
+        clock_type::duration commit_latency{};
+        size_t target_batch_size = 0;
+    };
+private:
+    struct batch {
+        temporary_buffer<char> buf;
+        // File position of buf[0], aligned
+        uint64_t pos = 0;
+        // Bytes in buf, including the tail of the previous batch
+        size_t len = 0;
+        // Bytes appended into this batch
+        size_t appended = 0;
+        shared_promise<> durable;
+    };
+
+    file _file;
+    group_commit_options _options;
+    size_t _alignment;
+    // Where the next append goes
+    uint64_t _pos;
+    std::unique_ptr<batch> _open;
+    std::deque<std::unique_ptr<batch>> _sealed;
+    batch* _inflight = nullptr;
+    // Data following the last aligned position, rewritten by the next batch
+    temporary_buffer<char> _tail;
+    future<> _committer = make_ready_future<>();
+    bool _committing = false;
+    bool _closing = false;
+    // Someone waits for the open batch, don't hold it
+    bool _urgent = false;
+    condition_variable _batch_ready;
+    std::exception_ptr _failure;
+
+    // Bytes appended since the last commit started
+    uint64_t _appended_since_commit = 0;
+    std::optional<clock_type::time_point> _last_commit_start;
+    double _append_rate = 0; // bytes per second
+    stats _stats;
+
+    batch& batch_for(size_t len);
+    void seal();
+    bool batch_ready() const noexcept;
+    void start_committer();
+    future<> commit_loop();
+    future<> hold_batch() noexcept;
+    future<> commit(std::unique_ptr<batch> b);
+    future<> write(uint64_t pos, const char* buf, size_t len);
+    void update_estimates(clock_type::duration latency) noexcept;
+    void fail(std::exception_ptr ex) noexcept;
+public:
+    /// Constructs a writer appending at the given position of the file,
+    /// which must be aligned to the disk write alignment of the file.
+    explicit group_commit_writer(file f, group_commit_options options = {}, uint64_t pos = 0);
+    group_commit_writer(group_commit_writer&&) = delete;
+    ~group_commit_writer();
+
+    /// Appends data to the file.
+    ///
+    /// \return the position of the data in the file, once it is durable
+    future<uint64_t> append(std::string_view data) noexcept;
+    /// Waits until everything appended so far is durable
+    future<> flush() noexcept;
+    /// Commits what was appended, truncates the file to the end of the
+    /// appended data and closes the file.
+    future<> close() noexcept;
+
+    /// Position the next append goes to
+    uint64_t position() const noexcept { return _pos; }
+    const stats& get_stats() const noexcept { return _stats; }
+};
+
+/// @}
+
+}
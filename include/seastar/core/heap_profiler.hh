@@ -0,0 +1,53 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <seastar/http/httpd.hh>
+#include <seastar/core/memory.hh>
+#include <ostream>
+#include <vector>
+
+namespace seastar {
+
+/// Profiles of the sampling heap profiler, see
+/// \ref memory::set_heap_sampling_rate().
+namespace heap_profiler {
+
+/// Collects the sampled heap profiles of all shards, merging the sites
+/// with the same backtrace.
+future<std::vector<memory::sampled_allocation_site>> collect();
+
+/// Collects the sampled heap profile of one shard.
+future<std::vector<memory::sampled_allocation_site>> collect(unsigned shard);
+
+/// Writes a profile in the text format of gperftools heap profiles, which
+/// pprof reads. The mappings of the process are appended so that pprof
+/// can symbolize the backtraces.
+void write_pprof(std::ostream& os, const std::vector<memory::sampled_allocation_site>& sites);
+
+/// \defgroup add_heap_profile_routes adds a \p path endpoint that returns
+///    the sampled heap profile of all shards for pprof, or of one shard
+///    with the \p shard query parameter
+/// @{
+future<> add_heap_profile_routes(distributed<httpd::http_server>& server, sstring path = "/debug/pprof/heap");
+future<> add_heap_profile_routes(httpd::http_server& server, sstring path = "/debug/pprof/heap");
+/// @}
+
+}
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+
+namespace seastar {
+
+namespace internal {
+
+// Picks how long an idle reactor polls before going to sleep.
+//
+// The governor keeps a decaying histogram of the idle gaps of its shard
+// (the time from running out of work until new work shows up) and an
+// estimate of how late the shard wakes up from sleep. Every so many gaps
+// it chooses one of:
+//
+//  - spin: most gaps are shorter than the wakeup latency, so sleeping
+//    would roughly double the response time; poll for the maximum time.
+//  - poll_then_sleep: most gaps end within the maximum poll time; poll
+//    for long enough to catch them, then sleep.
+//  - sleep: most gaps are longer than the maximum poll time; polling
+//    only burns CPU, so sleep right away.
+class idle_governor {
+public:
+    enum class mode {
+        spin = 0,
+        poll_then_sleep = 1,
+        sleep = 2,
+    };
+private:
+    // Power-of-two buckets of microseconds, the last one open-ended
+    static constexpr unsigned nr_buckets = 24;
+    // How many gaps are recorded between decisions
+    static constexpr unsigned update_period = 64;
+    // Fraction of the gaps the chosen poll time should cover
+    static constexpr double target_quantile = 0.9;
+
+    std::array<double, nr_buckets> _gaps = {};
+    double _total = 0;
+    unsigned _since_update = 0;
+    const std::chrono::nanoseconds _max_poll_time;
+    std::chrono::nanoseconds _poll_time;
+    mode _mode = mode::poll_then_sleep;
+    // Exponentially weighted average of how late timers fire after sleep
+    std::chrono::nanoseconds _wakeup_latency{0};
+
+    static unsigned bucket_of(std::chrono::nanoseconds gap) noexcept;
+    static std::chrono::nanoseconds bucket_limit(unsigned bucket) noexcept;
+    void update() noexcept;
+public:
+    explicit idle_governor(std::chrono::nanoseconds max_poll_time) noexcept;
+    // An idle period ended with new work after this long
+    void on_idle_end(std::chrono::nanoseconds gap) noexcept;
+    // The reactor woke up from sleep this long after its next timer was due
+    void on_wakeup(std::chrono::nanoseconds lateness) noexcept;
+
+    std::chrono::nanoseconds poll_time() const noexcept { return _poll_time; }
+    mode current_mode() const noexcept { return _mode; }
+    std::chrono::nanoseconds wakeup_latency() const noexcept { return _wakeup_latency; }
+};
+
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace seastar {
+
+namespace internal {
+
+// Scales the dispatch rate of an io_group to keep the time requests spend
+// in the disk around a target.
+//
+// The configured request and bandwidth rates describe a healthy disk. When
+// the disk slows down (garbage collection, thermal throttling, neighbours
+// on shared storage) requests dispatched at those rates pile up in it and
+// the completion latency grows without bound. The controller looks at the
+// mean completion latency of every period and
+//
+//  - cuts the rate in proportion to the overshoot (at most by half) when it
+//    is above the target,
+//  - raises the rate by a fixed step when it is below the target,
+//
+// staying within [min_scale, max_scale] of the configured rate. Periods
+// without completions leave the rate as it is.
+class io_rate_controller {
+public:
+    struct config {
+        std::chrono::duration<double> latency_target;
+        double min_scale = 0.1;
+        double max_scale = 1.0;
+    };
+private:
+    // Share of the rate range regained per period below the target
+    static constexpr double increase_step = 0.05;
+
+    const config _config;
+    double _scale;
+public:
+    explicit io_rate_controller(config cfg) noexcept;
+    // A period ended in which nr requests completed after spending the given
+    // total time in the disk. Returns the new scale.
+    double update(uint64_t nr, std::chrono::duration<double> total) noexcept;
+
+    double scale() const noexcept { return _scale; }
+    // How often update() is expected to be called
+    std::chrono::milliseconds period() const noexcept;
+};
+
+}
+
+}
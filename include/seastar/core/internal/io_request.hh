@@ -38,7 +38,7 @@ namespace internal {
 
 class io_request {
 public:
-    enum class operation { read, readv, write, writev, fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel };
+    enum class operation { read, readv, write, writev, fdatasync, write_fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel };
 private:
     operation _op;
     // the upper layers give us void pointers, but storing void pointers here is just
@@ -75,6 +75,7 @@ class io_request {
     using sendmsg_op = recvmsg_op;
     using write_op = read_op;
     using writev_op = readv_op;
+    using write_fdatasync_op = write_op;
     struct fdatasync_op {
         int fd;
     };
@@ -111,6 +112,7 @@ class io_request {
         write_op _write;
         writev_op _writev;
         fdatasync_op _fdatasync;
+        write_fdatasync_op _write_fdatasync;
         accept_op _accept;
         connect_op _connect;
         poll_add_op _poll_add;
@@ -226,6 +228,22 @@ class io_request {
         return req;
     }
 
+    // Write followed by fdatasync of the same file. Backends that can chain
+    // requests in the kernel submit it as one unit, others must never see it
+    // (see reactor_backend::have_linked_fdatasync())
+    static io_request make_write_fdatasync(int fd, uint64_t pos, const void* address, size_t size, bool nowait_works) {
+        io_request req;
+        req._op = operation::write_fdatasync;
+        req._write_fdatasync = {
+          .fd = fd,
+          .pos = pos,
+          .addr = const_cast<char*>(reinterpret_cast<const char*>(address)),
+          .size = size,
+          .nowait_works = nowait_works,
+        };
+        return req;
+    }
+
     static io_request make_accept(int fd, struct sockaddr* addr, socklen_t* addrlen, int flags) {
         io_request req;
         req._op = operation::accept;
@@ -295,6 +313,7 @@ class io_request {
         switch (_op) {
         case operation::write:
         case operation::writev:
+        case operation::write_fdatasync:
         case operation::send:
         case operation::sendmsg:
             return true;
@@ -338,6 +357,9 @@ class io_request {
         if constexpr (Op == operation::fdatasync) {
             return _fdatasync;
         }
+        if constexpr (Op == operation::write_fdatasync) {
+            return _write_fdatasync;
+        }
         if constexpr (Op == operation::accept) {
             return _accept;
         }
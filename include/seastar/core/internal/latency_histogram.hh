@@ -0,0 +1,88 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/metrics_types.hh>
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace seastar {
+
+namespace internal {
+
+// Fixed-size log-linear histogram of latencies, in the spirit of HDR
+// histograms.
+//
+// Latencies are counted in microseconds. Every power of two range is split
+// into 2^sub_bucket_bits equal buckets, so a bucket is at most 25% wide
+// relative to its lower bound. Latencies of 2^max_shift microseconds
+// (about 16s) and longer all land in the last bucket. Recording is a couple
+// of bit operations and an increment, and the whole histogram takes less
+// than a kilobyte.
+class latency_histogram {
+    static constexpr unsigned sub_bucket_bits = 2;
+    static constexpr unsigned sub_buckets = 1 << sub_bucket_bits;
+    static constexpr unsigned max_shift = 24;
+public:
+    static constexpr unsigned nr_buckets = (max_shift - sub_bucket_bits + 1) << sub_bucket_bits;
+private:
+    std::array<uint64_t, nr_buckets> _buckets = {};
+    uint64_t _count = 0;
+    std::chrono::duration<double> _sum{0};
+public:
+    static unsigned bucket_of(uint64_t usec) noexcept {
+        if (usec < sub_buckets) {
+            return usec;
+        }
+        auto shift = log2floor(usec);
+        if (shift >= max_shift) {
+            return nr_buckets - 1;
+        }
+        auto sub = (usec >> (shift - sub_bucket_bits)) & (sub_buckets - 1);
+        return ((shift - sub_bucket_bits + 1) << sub_bucket_bits) + sub;
+    }
+
+    // Latencies in the bucket are below this many microseconds
+    static uint64_t bucket_limit(unsigned bucket) noexcept {
+        if (bucket < sub_buckets) {
+            return bucket + 1;
+        }
+        auto shift = (bucket >> sub_bucket_bits) + sub_bucket_bits - 1;
+        auto sub = bucket & (sub_buckets - 1);
+        return uint64_t(sub_buckets + sub + 1) << (shift - sub_bucket_bits);
+    }
+
+    void add(std::chrono::duration<double> lat) noexcept {
+        auto usec = std::chrono::duration_cast<std::chrono::microseconds>(lat).count();
+        _buckets[bucket_of(std::max<int64_t>(usec, 0))]++;
+        _count++;
+        _sum += lat;
+    }
+
+    uint64_t count() const noexcept { return _count; }
+
+    // In seconds, as Prometheus expects
+    metrics::histogram to_metrics() const;
+};
+
+}
+
+}
@@ -27,6 +27,7 @@
 #include <seastar/util/bool_class.hh>
 #include <boost/intrusive_ptr.hpp>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <tuple>
 #include <sys/uio.h>
@@ -37,10 +38,12 @@ class reactor;
 class pollable_fd;
 class pollable_fd_state;
 class socket_address;
+class file;
 
 namespace internal {
 
 class buffer_allocator;
+class zerocopy_tracker;
 
 }
 
@@ -57,7 +60,7 @@ using pollable_fd_state_ptr = boost::intrusive_ptr<pollable_fd_state>;
 class pollable_fd_state {
     unsigned _refs = 0;
 public:
-    virtual ~pollable_fd_state() {}
+    virtual ~pollable_fd_state();
     struct speculation {
         int events = 0;
         explicit speculation(int epoll_events_guessed = 0) : events(epoll_events_guessed) {}
@@ -111,13 +114,29 @@ class pollable_fd_state {
     future<temporary_buffer<char>> recv_some(internal::buffer_allocator* ba);
     future<size_t> sendmsg(struct msghdr *msg);
     future<size_t> recvmsg(struct msghdr *msg);
+    // Batched versions of recvmsg() and sendmsg(); return the number of
+    // messages received or sent, which is at least one
+    future<size_t> recvmmsg(struct mmsghdr* msgs, size_t n);
+    future<size_t> sendmmsg(struct mmsghdr* msgs, size_t n);
     future<size_t> sendto(socket_address addr, const void* buf, size_t len);
     future<> poll_rdhup();
+    // Whether a write of \c len bytes is sent without copying (see
+    // reactor_options::zerocopy_send_threshold)
+    bool zerocopy_eligible(size_t len) const noexcept;
+    // Picks up the completion reports of zero-copy sends. The socket
+    // polls as failed until they are read, so pollers call this when it
+    // does, before waking up the waiters.
+    void reap_zerocopy() noexcept;
+    // Whether send_file() can hand \c f to the kernel to send from
+    static bool can_send_file(file& f) noexcept;
+    future<> send_file(file& f, uint64_t pos, uint64_t len);
 
 protected:
-    explicit pollable_fd_state(file_desc fd, speculation speculate = speculation())
-        : fd(std::move(fd)), events_known(speculate.events) {}
+    explicit pollable_fd_state(file_desc fd, speculation speculate = speculation());
 private:
+    // Zero-copy (MSG_ZEROCOPY) sends the kernel hasn't released yet
+    std::unique_ptr<internal::zerocopy_tracker> _zerocopy;
+
     void maybe_no_more_recv();
     void maybe_no_more_send();
     void forget(); // called on end-of-life
@@ -182,9 +201,24 @@ class pollable_fd {
     future<size_t> recvmsg(struct msghdr *msg) {
         return _s->recvmsg(msg);
     }
+    future<size_t> recvmmsg(struct mmsghdr* msgs, size_t n) {
+        return _s->recvmmsg(msgs, n);
+    }
+    future<size_t> sendmmsg(struct mmsghdr* msgs, size_t n) {
+        return _s->sendmmsg(msgs, n);
+    }
     future<size_t> sendto(socket_address addr, const void* buf, size_t len) {
         return _s->sendto(addr, buf, len);
     }
+    bool zerocopy_eligible(size_t len) const noexcept {
+        return _s->zerocopy_eligible(len);
+    }
+    static bool can_send_file(file& f) noexcept {
+        return pollable_fd_state::can_send_file(f);
+    }
+    future<> send_file(file& f, uint64_t pos, uint64_t len) {
+        return _s->send_file(f, pos, len);
+    }
     file_desc& get_file_desc() const { return _s->fd; }
     using shutdown_kernel_only = bool_class<struct shutdown_kernel_only_tag>;
     void shutdown(int how, shutdown_kernel_only kernel_only = shutdown_kernel_only::yes);
@@ -0,0 +1,90 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace seastar {
+
+namespace internal {
+
+// Sizes the read-ahead of the input streams reading one file.
+//
+// The engine sees where every stream starts and ends, and detects whether
+// the streams move through the file sequentially (each one starts where
+// the previous one stopped), with a fixed stride, or backwards with a
+// fixed stride. Streams of a file with such a pattern are expected to be
+// read through and may start with full read-ahead instead of growing it
+// one buffer at a time.
+//
+// It also tracks how fast the streams consume data and how long their
+// reads take. The read-ahead a stream needs is what gets consumed while
+// a read is in flight. Reads on an idle disk are used for that estimate,
+// so the read-ahead doesn't grow just because the reads wait in the I/O
+// queue behind others; when they do wait much longer than that, the disk
+// is considered backlogged and streams stop growing their read-ahead.
+class read_ahead_engine {
+public:
+    using clock_type = std::chrono::steady_clock;
+    enum class access_pattern { unknown, sequential, strided, reverse, random };
+private:
+    // Streams in a row that must follow a pattern before it's trusted
+    static constexpr unsigned confidence = 2;
+    // Weight of a new sample in the moving averages
+    static constexpr double smoothing = 0.125;
+    // Reads slower than this many times the idle latency mean the disk is backlogged
+    static constexpr double backlog_factor = 4;
+
+    access_pattern _candidate = access_pattern::unknown;
+    unsigned _hits = 0;
+    std::optional<uint64_t> _last_start;
+    uint64_t _last_end = 0;
+    int64_t _stride = 0;
+
+    double _consume_rate = 0; // bytes per second
+    double _read_latency = 0; // seconds
+    double _idle_latency = 0; // seconds
+public:
+    // A stream starts reading at pos
+    void on_stream_start(uint64_t pos) noexcept;
+    // A stream consumed data up to pos and was closed
+    void on_stream_end(uint64_t pos) noexcept;
+    // The consumer took this many bytes, that long after the previous ones
+    void on_consumed(size_t bytes, clock_type::duration elapsed) noexcept;
+    // A read completed this long after it was issued
+    void on_read(clock_type::duration latency) noexcept;
+
+    access_pattern pattern() const noexcept {
+        return _hits >= confidence ? _candidate : access_pattern::unknown;
+    }
+    bool backlogged() const noexcept {
+        return _idle_latency > 0 && _read_latency > backlog_factor * _idle_latency;
+    }
+    double consume_rate() const noexcept { return _consume_rate; }
+    // Buffers of the given size to keep in flight ahead of the consumer,
+    // zero when there's no estimate yet
+    unsigned wanted_read_ahead(size_t buffer_size) const noexcept;
+};
+
+}
+
+}
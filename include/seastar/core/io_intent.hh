@@ -24,6 +24,7 @@
 #include <boost/container/small_vector.hpp>
 #include <seastar/core/internal/io_intent.hh>
 #include <seastar/core/io_priority_class.hh>
+#include <chrono>
 
 namespace seastar {
 
@@ -37,7 +38,13 @@ namespace seastar {
 ///
 /// If no intent is provided, then the request is processed till its
 /// completion be it success or error
+///
+/// An intent can also carry a deadline for its requests, see
+/// \ref set_deadline()
 class io_intent {
+public:
+    using clock_type = std::chrono::steady_clock;
+private:
     struct intents_for_queue {
         dev_t dev;
         io_priority_class_id qid;
@@ -68,6 +75,7 @@ class io_intent {
 
     boost::container::small_vector<intents_for_queue, 1> _intents;
     references _refs;
+    clock_type::time_point _deadline = clock_type::time_point::max();
     friend internal::intent_reference::intent_reference(io_intent*) noexcept;
 
 public:
@@ -77,7 +85,7 @@ class io_intent {
     io_intent(const io_intent&) = delete;
     io_intent& operator=(const io_intent&) = delete;
     io_intent& operator=(io_intent&&) = delete;
-    io_intent(io_intent&& o) noexcept : _intents(std::move(o._intents)), _refs(std::move(o._refs)) {
+    io_intent(io_intent&& o) noexcept : _intents(std::move(o._intents)), _refs(std::move(o._refs)), _deadline(o._deadline) {
         for (auto&& r : _refs.list) {
             r._intent = this;
         }
@@ -91,6 +99,24 @@ class io_intent {
         _intents.clear();
     }
 
+    /// Sets the time by which the requests attached to this intent
+    /// afterwards must be sent to the disk
+    ///
+    /// As the deadline approaches, such requests are dispatched ahead
+    /// of the other requests of their class (and, to a limited extent,
+    /// of other classes). Requests still queued when the deadline passes
+    /// are not sent to the disk at all, their futures are resolved into
+    /// the \ref timed_out_error "timed_out_error".
+    void set_deadline(clock_type::time_point deadline) noexcept {
+        _deadline = deadline;
+    }
+
+    /// \returns the deadline set by \ref set_deadline(), or
+    /// \c time_point::max() if there is none
+    clock_type::time_point deadline() const noexcept {
+        return _deadline;
+    }
+
     /// @private
     internal::cancellable_queue& find_or_create_cancellable_queue(dev_t dev, io_priority_class_id qid) {
         for (auto&& i : _intents) {
@@ -23,13 +23,20 @@
 
 #include <boost/container/small_vector.hpp>
 #include <seastar/core/sstring.hh>
+#include <seastar/core/aligned_buffer.hh>
 #include <seastar/core/fair_queue.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/internal/io_request.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/timer.hh>
 #include <seastar/util/spinlock.hh>
+#include <atomic>
 #include <chrono>
+#include <map>
 #include <memory>
+#include <optional>
+#include <tuple>
 #include <vector>
 #include <sys/uio.h>
 
@@ -47,6 +54,7 @@ class io_intent;
 
 namespace internal {
 class io_sink;
+class io_rate_controller;
 namespace linux_abi {
 
 struct io_event;
@@ -83,6 +91,23 @@ class io_queue {
     // decoupling and is temporary
     size_t _queued_requests = 0;
     size_t _requests_executing = 0;
+
+    // Completions not yet reported to the group's rate controller
+    uint64_t _unreported_completions = 0;
+    std::chrono::duration<double> _unreported_latency{0};
+    // Runs the group's rate controller, armed on the shard that created the group
+    timer<lowres_clock> _rate_controller_timer;
+    metrics::metric_groups _rate_controller_metrics;
+public:
+    // File, class and end position of a queued read
+    using merge_key = std::tuple<int, fair_queue::class_id, uint64_t>;
+private:
+    // Queued reads that later adjacent reads can be merged into
+    std::map<merge_key, queued_io_request*> _merge_targets;
+    // Where the holes between merged reads are read into
+    std::unique_ptr<char[], free_deleter> _merge_gap_buffer;
+
+    std::optional<future<size_t>> try_merge_read(priority_class_data& pclass, const internal::io_request& req);
 public:
 
     using clock_type = std::chrono::steady_clock;
@@ -111,6 +136,19 @@ class io_queue {
         float rate_factor = 1.0;
         std::chrono::duration<double> rate_limit_duration = std::chrono::milliseconds(1);
         size_t block_count_limit_min = 1;
+        // When non-zero, the dispatch rate is scaled within
+        // [min_rate_scale, max_rate_scale] of the rates above to keep the
+        // mean time requests spend in the disk around this target
+        std::chrono::duration<double> latency_target{0};
+        float min_rate_scale = 0.1;
+        float max_rate_scale = 1.0;
+        // Let shards with queued requests dispatch the share of the
+        // group capacity that idle shards don't use
+        bool capacity_borrowing = false;
+        // Merge queued reads of the same file and class that are at most
+        // read_merge_gap bytes apart into one request
+        bool merge_reads = false;
+        size_t read_merge_gap = 0;
     };
 
     io_queue(io_group_ptr group, internal::io_sink& sink);
@@ -128,7 +166,10 @@ class io_queue {
     void submit_request(io_desc_read_write* desc, internal::io_request req) noexcept;
     void cancel_request(queued_io_request& req) noexcept;
     void complete_cancelled_request(queued_io_request& req) noexcept;
+    void expire_request() noexcept;
+    void forget_merge_target(const merge_key& key) noexcept;
     void complete_request(io_desc_read_write& desc) noexcept;
+    void account_latency(std::chrono::duration<double> lat) noexcept;
 
 
     [[deprecated("I/O queue users should not track individual requests, but resources (weight, size) passing through the queue")]]
@@ -167,6 +208,8 @@ class io_queue {
 private:
     static fair_queue::config make_fair_queue_config(const config& cfg, sstring label);
     void register_stats(sstring name, priority_class_data& pc);
+    void report_latency() noexcept;
+    void start_rate_controller();
 };
 
 class io_group {
@@ -186,8 +229,14 @@ class io_group {
     util::spinlock _lock;
     const shard_id _allocated_on;
 
+    std::unique_ptr<internal::io_rate_controller> _rate_controller;
+    // Completions reported by the shards since the controller last looked
+    std::atomic<uint64_t> _completions{0};
+    std::atomic<uint64_t> _completion_usec{0};
+
     static fair_group::config make_fair_group_config(const io_queue::config& qcfg) noexcept;
     priority_class_data& find_or_create_class(io_priority_class pc);
+    void update_rate() noexcept;
 };
 
 inline const io_queue::config& io_queue::get_config() const noexcept {
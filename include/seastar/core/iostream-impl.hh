@@ -447,6 +447,27 @@ output_stream<CharType>::flush() noexcept {
     return make_ready_future<>();
 }
 
+template <typename CharType>
+future<>
+output_stream<CharType>::flush_and_wait() noexcept {
+    if (_ex) {
+        return make_exception_future<>(std::move(_ex));
+    }
+    // if flush is scheduled, disable it and flush right away
+    _flush = false;
+    if (_flushing) {
+        // flush in progress, wait for it to end before continuing
+        return _in_batch.value().get_future().then([this] {
+            if (_ex) {
+                return make_exception_future<>(std::move(_ex));
+            }
+            return do_flush();
+        });
+    } else {
+        return do_flush();
+    }
+}
+
 template <typename CharType>
 future<>
 output_stream<CharType>::put(temporary_buffer<CharType> buf) noexcept {
@@ -414,6 +414,13 @@ class output_stream final {
     future<> write(temporary_buffer<char_type>) noexcept;
     future<> flush() noexcept;
 
+    /// Flushes the stream and waits until the data written so far was
+    /// handed to the underlying data sink, even if flushes are batched
+    /// (see \ref output_stream_options::batch_flushes). Needed before
+    /// writing to the same destination bypassing the stream, e.g. with
+    /// \ref connected_socket::send_file().
+    future<> flush_and_wait() noexcept;
+
     /// Flushes the stream before closing it (and the underlying data sink) to
     /// any further writes.  The resulting future must be waited on before
     /// destroying this object.
@@ -91,6 +91,12 @@ namespace seastar {
 /// * \ref set_heap_profiling_enabled()
 /// * \ref scoped_heap_profiling
 ///
+/// The sampling heap profiler records only a random sample of the
+/// allocations instead, cheaply enough to keep it on in production, and
+/// can export profiles for pprof. See:
+/// * \ref set_heap_sampling_rate()
+/// * \ref sampled_heap_profile()
+///
 /// ### Abort on allocation failure
 ///
 /// Often, the best way to debug an allocation failure is a coredump. This
@@ -215,6 +221,15 @@ extern std::pmr::polymorphic_allocator<char>* malloc_allocator;
 // Returns @true if any work was actually performed.
 bool drain_cross_cpu_freelist();
 
+// Call periodically to return memory held by the free objects of idle
+// small pools to the page allocator, and to adapt the free object
+// watermarks of the pools to their recent use. Continues from the pool
+// where the previous call stopped, and stops early once \c should_stop
+// returns true.
+//
+// Returns @true if all the pools were visited.
+bool compact_small_pools(bool (*should_stop)() = nullptr);
+
 
 // We don't want the memory code calling back into the rest of
 // the system, so allow the rest of the system to tell the memory
@@ -261,6 +276,7 @@ class statistics {
     uint64_t _mallocs;
     uint64_t _frees;
     uint64_t _cross_cpu_frees;
+    uint64_t _cross_cpu_free_batches;
     size_t _total_memory;
     size_t _free_memory;
     uint64_t _reclaims;
@@ -271,11 +287,11 @@ class statistics {
     uint64_t _foreign_frees;
     uint64_t _foreign_cross_frees;
 private:
-    statistics(uint64_t mallocs, uint64_t frees, uint64_t cross_cpu_frees,
+    statistics(uint64_t mallocs, uint64_t frees, uint64_t cross_cpu_frees, uint64_t cross_cpu_free_batches,
             uint64_t total_memory, uint64_t free_memory, uint64_t reclaims,
             uint64_t large_allocs, uint64_t failed_allocs,
             uint64_t foreign_mallocs, uint64_t foreign_frees, uint64_t foreign_cross_frees)
-        : _mallocs(mallocs), _frees(frees), _cross_cpu_frees(cross_cpu_frees)
+        : _mallocs(mallocs), _frees(frees), _cross_cpu_frees(cross_cpu_frees), _cross_cpu_free_batches(cross_cpu_free_batches)
         , _total_memory(total_memory), _free_memory(free_memory), _reclaims(reclaims)
         , _large_allocs(large_allocs), _failed_allocs(failed_allocs)
         , _foreign_mallocs(foreign_mallocs), _foreign_frees(foreign_frees)
@@ -288,6 +304,9 @@ class statistics {
     /// Total number of memory deallocations that occured on a different lcore
     /// than the one on which they were allocated.
     uint64_t cross_cpu_frees() const { return _cross_cpu_frees; }
+    /// Number of batches the cross-cpu deallocations of this lcore were
+    /// handed to their lcores in.
+    uint64_t cross_cpu_free_batches() const { return _cross_cpu_free_batches; }
     /// Total number of objects which were allocated but not freed.
     size_t live_objects() const { return mallocs() - frees(); }
     /// Total free memory (in bytes)
@@ -312,6 +331,79 @@ class statistics {
     friend statistics stats();
 };
 
+/// Memory held by the small object pool of one size class.
+struct small_pool_statistics {
+    /// Size of the objects of the pool, in bytes
+    size_t object_size = 0;
+    /// Objects allocated and not freed
+    size_t live_objects = 0;
+    /// Objects the pool keeps for reuse, on its free list or in its spans
+    size_t free_objects = 0;
+    /// Pages held by the pool
+    size_t pages = 0;
+
+    /// Share of the memory held by the pool which is not taken by live
+    /// objects, from 0 to 1. Memory stranded in a pool this way can't be
+    /// used by allocations of other sizes.
+    double fragmentation() const noexcept;
+};
+
+/// Spans of pages of one order: more than 2^(order-1) and up to 2^order pages.
+struct span_statistics {
+    unsigned order = 0;
+    size_t free_spans = 0;
+    size_t free_pages = 0;
+    /// Spans of large allocations and of small pools
+    size_t used_spans = 0;
+    size_t used_pages = 0;
+};
+
+/// Breakdown of the memory of an lcore by small pool size class and
+/// span order.
+struct size_class_statistics {
+    std::vector<small_pool_statistics> small_pools;
+    std::vector<span_statistics> spans;
+
+    /// Share of the free memory outside the largest free span, from 0 to 1.
+    /// High values mean large allocations may fail although there's
+    /// plenty of free memory.
+    double free_memory_fragmentation() const noexcept;
+};
+
+/// Capture a breakdown of the memory of this lcore by size class.
+///
+/// Walks all the spans of the lcore, so it's meant for diagnostics and
+/// periodic monitoring rather than frequent calls. Empty when the default
+/// (system) allocator is being used.
+size_class_statistics size_class_stats();
+
+/// How the memory of an lcore is placed in huge page sized regions.
+struct huge_page_statistics {
+    /// Huge page sized regions of the memory of the lcore
+    size_t regions = 0;
+    /// Regions without allocated pages
+    size_t free_regions = 0;
+    /// Regions holding both small pool spans and large allocations
+    size_t mixed_regions = 0;
+    /// Memory of the lcore the kernel backs with transparent huge pages,
+    /// in bytes. Only filled in by huge_page_stats(true).
+    size_t huge_page_backed_memory = 0;
+
+    /// Share of the memory of the lcore backed by huge pages, from 0 to 1
+    double huge_page_backed_fraction() const noexcept;
+};
+
+/// Capture how the memory of this lcore is placed in huge page sized
+/// regions.
+///
+/// The allocator keeps small pool spans and large allocations in separate
+/// regions where it can, since mixed regions are less likely to be backed
+/// by transparent huge pages. With \c include_backing, also asks the kernel
+/// how much of the memory is backed by them, by reading /proc/self/smaps.
+/// That walks the page tables of the whole process, so it's meant for
+/// diagnostics only. Empty when the default (system) allocator is being used.
+huge_page_statistics huge_page_stats(bool include_backing = false);
+
 struct memory_layout {
     uintptr_t start;
     uintptr_t end;
@@ -406,5 +498,40 @@ class scoped_heap_profiling {
     ~scoped_heap_profiling();
 };
 
+/// Estimated allocations of one call site, from the samples of the
+/// sampling heap profiler.
+struct sampled_allocation_site {
+    /// Return addresses of the call stack of the allocations, innermost
+    /// first
+    std::vector<uintptr_t> backtrace;
+    /// Allocations not freed yet
+    double live_objects = 0;
+    double live_bytes = 0;
+    /// All allocations since sampling was enabled
+    double allocated_objects = 0;
+    double allocated_bytes = 0;
+};
+
+/// Enable the sampling heap profiler on this lcore.
+///
+/// Unlike \ref set_heap_profiling_enabled(), the sampling profiler needs
+/// no special build, and its overhead is low enough to leave it on in
+/// production. It records the backtrace of one allocation per
+/// \c sample_rate allocated bytes on average, picked at random, and
+/// estimates the allocations of each call site from the samples.
+///
+/// A rate of 0 stops sampling. Allocations sampled before are tracked
+/// until they are freed.
+void set_heap_sampling_rate(size_t sample_rate);
+
+/// The sampling rate of the heap profiler of this lcore, 0 when disabled.
+size_t get_heap_sampling_rate();
+
+/// The estimated allocations of this lcore, by call site.
+///
+/// See \ref seastar/core/heap_profiler.hh for a profile of all lcores in
+/// a format pprof reads.
+std::vector<sampled_allocation_site> sampled_heap_profile();
+
 }
 }
@@ -133,6 +133,7 @@ namespace internal {
 
 class reactor_stall_sampler;
 class cpu_stall_detector;
+class idle_governor;
 class buffer_allocator;
 
 template <typename Func> // signature: bool ()
@@ -286,6 +287,7 @@ class reactor {
     uint64_t _global_tasks_processed = 0;
     uint64_t _polls = 0;
     std::unique_ptr<internal::cpu_stall_detector> _cpu_stall_detector;
+    std::unique_ptr<internal::idle_governor> _idle_governor;
 
     unsigned _max_task_backlog = 1000;
     timer_set<timer<>, &timer<>::_link> _timers;
@@ -296,6 +298,11 @@ class reactor {
     timer_set<timer<manual_clock>, &timer<manual_clock>::_link>::timer_list_t _expired_manual_timers;
     io_stats _io_stats;
     uint64_t _fsyncs = 0;
+    std::vector<std::pair<file_desc, std::unique_ptr<internal::zerocopy_tracker>>> _parked_zerocopy;
+    // Watches the error queues of sockets with zero-copy sends, where the
+    // kernel reports the sends' completions (see --zerocopy-send-threshold)
+    std::optional<pollable_fd> _zerocopy_epollfd;
+    std::optional<file_desc> _zerocopy_stop_eventfd;
     uint64_t _cxx_exceptions = 0;
     uint64_t _abandoned_failed_futures = 0;
     struct task_queue {
@@ -372,6 +379,8 @@ class reactor {
     void expire_manual_timers() noexcept;
     void start_aio_eventfd_loop();
     void stop_aio_eventfd_loop();
+    void start_zerocopy_loop();
+    void stop_zerocopy_loop();
     template <typename T, typename E, typename EnableFunc>
     void complete_timers(T&, E&, EnableFunc&& enable_fn) noexcept(noexcept(enable_fn()));
 
@@ -439,6 +448,14 @@ class reactor {
     void start_handling_signal();
     void reset_preemption_monitor();
     void service_highres_timer() noexcept;
+    // Let the backend pre-register a disk file descriptor with the kernel
+    // (or drop such a registration before the descriptor is closed).
+    void register_file(int fd) noexcept;
+    void unregister_file(int fd) noexcept;
+    // Same for an O_DIRECT block device whose I/O may complete by polling
+    void register_polled_file(int fd, dev_t device_id) noexcept;
+    bool registers_files() const noexcept;
+    bool have_linked_fdatasync() const noexcept;
 
     future<std::tuple<pollable_fd, socket_address>>
     do_accept(pollable_fd_state& listen_fd);
@@ -455,6 +472,26 @@ class reactor {
     do_send(pollable_fd_state& fd, const void* buffer, size_t size);
     future<size_t>
     do_sendmsg(pollable_fd_state& fd, net::packet& p);
+    future<size_t>
+    do_sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p);
+    future<size_t>
+    do_recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n);
+    future<size_t>
+    do_sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n);
+    // Keeps the zero-copy sent data of a socket being closed until the
+    // kernel releases it
+    void park_zerocopy(pollable_fd_state& fd) noexcept;
+    // Reaps the tracker's completions as soon as the kernel reports them,
+    // until unwatch_zerocopy() is called for the descriptor. Returns false
+    // if the completions can only be reaped by the socket's next sends.
+    bool watch_zerocopy(int fd, internal::zerocopy_tracker& zc) noexcept;
+    void unwatch_zerocopy(int fd) noexcept;
+    void reap_zerocopy_errors() noexcept;
+    // Sends a file range to a socket with sendfile(2); the file must
+    // have a valid sendfile_fd()
+    future<> do_send_file(pollable_fd_state& fd, file& f, uint64_t pos, uint64_t len);
+    future<size_t> do_sendfile_some(pollable_fd_state& fd, int in_fd, uint64_t pos, uint64_t len);
+    static int sendfile_fd(file& f) noexcept;
 
     future<temporary_buffer<char>>
     do_recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba);
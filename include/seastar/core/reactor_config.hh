@@ -31,6 +31,15 @@ namespace seastar {
 struct reactor_config {
     bool auto_handle_sigint_sigterm = true;
     unsigned max_networking_aio_io_control_blocks = 10000;
+    bool io_uring_register_buffers = false;
+    bool io_uring_register_files = false;
+    bool io_uring_sqpoll = false;
+    bool io_uring_sqpoll_pin_to_sibling = false;
+    unsigned io_uring_sqpoll_idle_ms = 0;
+    unsigned io_uring_queue_len = 0;
+    bool io_uring_multishot = false;
+    bool io_uring_iopoll = false;
+    unsigned zerocopy_send_threshold = 0;
 };
 /// \endcond
 
@@ -53,6 +62,12 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Reduce for overprovisioned environments or laptops.
     program_options::value<unsigned> idle_poll_time_us;
+    /// \brief Adapt the idle polling time to the shard's load.
+    ///
+    /// Learns how long the shard stays idle between requests and polls
+    /// for up to \ref idle_poll_time_us only when that is likely to catch
+    /// the next request; sleeps right away otherwise.
+    program_options::value<bool> idle_poll_governor;
     /// \brief Busy-poll for disk I/O.
     ///
     /// Reduces latency and increases throughput.
@@ -65,6 +80,50 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 1.5 * task_quota_ms value
     program_options::value<double> io_latency_goal_ms;
+    /// \brief Mean time (ms) I/O requests should spend in the disk.
+    ///
+    /// When set, the dispatch rate of every I/O group is scaled down when
+    /// the disk takes longer than this to complete requests, and back up
+    /// when it is faster, within \ref io_rate_min_ratio and
+    /// \ref io_rate_max_ratio of the rates from the I/O properties. Only
+    /// applies to disks with configured I/O properties.
+    ///
+    /// Default: not set (the rates are fixed).
+    program_options::value<double> io_latency_target_ms;
+    /// \brief Lowest fraction of the configured disk rates the I/O
+    /// scheduler may go down to (see \ref io_latency_target_ms).
+    ///
+    /// Default: 0.1.
+    program_options::value<double> io_rate_min_ratio;
+    /// \brief Highest fraction of the configured disk rates the I/O
+    /// scheduler may go up to (see \ref io_latency_target_ms).
+    ///
+    /// Default: 1.0.
+    program_options::value<double> io_rate_max_ratio;
+    /// \brief Let shards borrow I/O dispatch capacity from idle siblings.
+    ///
+    /// By default every shard dispatches at most its 1/smp::count part of
+    /// the capacity of its I/O group per poll. With this option the
+    /// capacity is split between the shards that have requests queued, in
+    /// proportion to the shares of their backlogged priority classes.
+    ///
+    /// Default: false.
+    program_options::value<bool> io_capacity_borrowing;
+    /// \brief Merge queued adjacent reads into one disk request.
+    ///
+    /// Reads of the same file and priority class that are queued while
+    /// an earlier read ending where they start (or at most
+    /// \ref io_merge_max_gap bytes before) is still queued are submitted
+    /// together with it as a single vectored read.
+    ///
+    /// Default: false.
+    program_options::value<bool> io_merge_reads;
+    /// \brief Largest hole, in bytes, between merged reads.
+    ///
+    /// The hole is read from the disk and thrown away (see \ref io_merge_reads).
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> io_merge_max_gap;
     /// \brief Maximum number of task backlog to allow.
     ///
     /// When the number of tasks grow above this, we stop polling (e.g. I/O)
@@ -145,10 +204,101 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 10000.
     program_options::value<unsigned> max_networking_io_control_blocks;
+    /// \brief Register the shard's memory with the io_uring instance and use
+    /// fixed-buffer read/write operations for disk I/O.
+    ///
+    /// Saves the kernel from pinning user pages on every request, at the cost
+    /// of locking all of the shard's memory up front. Requires enough
+    /// \p RLIMIT_MEMLOCK (or \p CAP_IPC_LOCK). Only valid for the \p io_uring
+    /// reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_register_buffers;
+    /// \brief Register open disk files with the io_uring instance and submit
+    /// disk I/O against the fixed file table.
+    ///
+    /// Saves the kernel a file descriptor lookup on every request. Only valid
+    /// for the \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_register_files;
+    /// \brief Let a kernel thread poll the io_uring submission queue.
+    ///
+    /// The reactor then only fills in submission entries and does not need
+    /// a system call to submit them, at the cost of a kernel thread per shard
+    /// spinning for \ref io_uring_sqpoll_idle_ms after the last submission.
+    /// Requires Linux 5.11 or later. Only valid for the \p io_uring reactor
+    /// backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_sqpoll;
+    /// \brief Pin the submission queue polling thread to a hyperthread sibling
+    /// of the shard's CPU.
+    ///
+    /// Only meaningful together with \ref io_uring_sqpoll and thread affinity.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_sqpoll_pin_to_sibling;
+    /// \brief Time (ms) the submission queue polling thread keeps spinning
+    /// without new submissions before going to sleep.
+    ///
+    /// Default: 0 (kernel default).
+    program_options::value<unsigned> io_uring_sqpoll_idle_ms;
+    /// \brief Number of submission queue entries of the io_uring ring.
+    ///
+    /// The completion queue is twice as long. With 0 the length is derived
+    /// from the request rate and latency goal of the configured disks
+    /// (see \p io_properties in \ref smp_options), so that the ring can hold
+    /// all the requests the I/O scheduler may have in flight. Only valid
+    /// for the \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: 0 (automatic).
+    program_options::value<unsigned> io_uring_queue_len;
+    /// \brief Use multishot accept and multishot receive for sockets.
+    ///
+    /// A single submission keeps accepting connections (or receiving data)
+    /// until it is cancelled, instead of one submission per operation.
+    /// Received data lands in buffers the reactor provides to the kernel up
+    /// front, so the sizes suggested by the connection's buffer allocator
+    /// are not used. Requires Linux 6.0 or later. Only valid for the
+    /// \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_multishot;
+    /// \brief Complete reads and writes of raw block devices by polling.
+    ///
+    /// Such requests go to a second io_uring ring set up with
+    /// \p IORING_SETUP_IOPOLL, whose completions the reactor polls for
+    /// every loop instead of waiting for the device interrupt. The reactor
+    /// does not sleep while polled requests are in flight. Only devices
+    /// with polling queues (\p /sys/block/<dev>/queue/io_poll, e.g. NVMe with
+    /// the \p nvme.poll_queues module parameter) are polled. Requires Linux
+    /// 5.10 or later. Only valid for the \p io_uring reactor backend
+    /// (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_iopoll;
+    /// Send TCP payloads of at least this many bytes without copying them
+    /// into the kernel, 0 to always copy.
+    ///
+    /// Uses \p IORING_OP_SENDMSG_ZC with the \p io_uring reactor backend
+    /// (Linux 6.1 or later) and \p MSG_ZEROCOPY otherwise (Linux 4.14 or
+    /// later). The sent data is kept alive until the kernel is done with it,
+    /// which may be well after the send completes. Zero-copy only pays off
+    /// for large payloads, a threshold of 16kB or more is advisable.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> zerocopy_send_threshold;
     /// \brief Enable seastar heap profiling.
     ///
     /// \note Unused when seastar was compiled without heap profiling support.
     program_options::value<> heapprof;
+    /// \brief Sample one allocation per this many allocated bytes on
+    /// average for the sampling heap profiler, see
+    /// \ref memory::set_heap_sampling_rate().
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> heap_sampling_rate;
     /// Ignore SIGINT (for gdb).
     program_options::value<> no_handle_interrupt;
 
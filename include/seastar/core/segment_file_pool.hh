@@ -0,0 +1,115 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/sstring.hh>
+#include <deque>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Keeps segment files of an append-heavy workload ready for use.
+///
+/// Creating a file and growing it as it's appended to both update file
+/// system metadata, and on XFS size changes serialize with the writes
+/// in flight. The pool keeps a reserve of segment files in a directory that
+/// already have their full size and have been written with zeros, so
+/// writes into them change no metadata. A background fiber creates new
+/// segments whenever the reserve runs low.
+///
+/// A segment is taken with acquire(), which renames a free segment to the
+/// requested name. When the writer is done with a segment and has closed
+/// it, recycle() renames it back to a free segment and keeps it for reuse
+/// instead of creating a new file. Recycled segments keep their old
+/// contents, so writers must be able to tell stale data from theirs, e.g.
+/// by checksums or sequence numbers.
+///
+/// Free segments are named with the configured prefix and picked up again
+/// by start() after a restart. Pools of different shards sharing a
+/// directory need distinct prefixes.
+class segment_file_pool {
+public:
+    struct config {
+        sstring directory;
+        uint64_t segment_size = 32 << 20;
+        /// Free segments to keep ready
+        unsigned reserve = 2;
+        /// Recycled segments beyond this many free ones are removed
+        unsigned max_free = 4;
+        /// Name prefix of free segments
+        sstring prefix = "free-segment-";
+        file_open_options open_options;
+        ::seastar::io_priority_class io_priority_class = default_priority_class();
+    };
+
+    struct stats {
+        uint64_t created = 0;
+        uint64_t acquired = 0;
+        /// Segments created on acquire() because none was free
+        uint64_t misses = 0;
+        uint64_t recycled = 0;
+        uint64_t removed = 0;
+    };
+private:
+    struct free_segment {
+        sstring path;
+        file f;
+    };
+
+    config _config;
+    std::deque<free_segment> _free;
+    uint64_t _next_id = 0;
+    condition_variable _refill;
+    future<> _filler = make_ready_future<>();
+    bool _stopping = false;
+    stats _stats;
+
+    sstring path_of(std::string_view name) const;
+    sstring next_free_path();
+    future<> fill_loop();
+    future<free_segment> create(bool zero);
+    future<> zero_fill(file f);
+public:
+    explicit segment_file_pool(config cfg);
+    segment_file_pool(segment_file_pool&&) = delete;
+
+    /// Picks up the free segments left in the directory and starts
+    /// filling the reserve
+    future<> start();
+    /// Stops filling the reserve and closes the free segments, leaving
+    /// them in the directory for the next start()
+    future<> stop();
+
+    /// Takes a free segment and renames it to the given name in the
+    /// directory of the pool. Creates the segment if none is free.
+    future<file> acquire(sstring name);
+    /// Returns a closed segment with the given name to the pool
+    future<> recycle(sstring name);
+
+    size_t free_segments() const noexcept { return _free.size(); }
+    const stats& get_stats() const noexcept { return _stats; }
+};
+
+/// @}
+
+}
@@ -88,6 +88,7 @@ struct smp_options : public program_options::option_group {
     /// * \ref smp_options::hugepages
     /// * \ref smp_options::mbind
     /// * \ref reactor_options::heapprof
+    /// * \ref reactor_options::heap_sampling_rate
     /// * \ref reactor_options::abort_on_seastar_bad_alloc
     /// * \ref reactor_options::dump_memory_diagnostics_on_alloc_failure_kind
     seastar::memory_allocator memory_allocator = memory_allocator::seastar;
@@ -104,6 +104,7 @@ class connection : public boost::intrusive::list_base_hook<> {
     void generate_error_reply_and_close(std::unique_ptr<http::request> req, http::reply::status_type status, const sstring& msg);
 
     future<> write_body();
+    future<> write_file_body();
 
     output_stream<char>& out();
 };
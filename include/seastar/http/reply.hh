@@ -35,6 +35,7 @@
 #include <unordered_map>
 #include <seastar/http/mime_types.hh>
 #include <seastar/core/iostream.hh>
+#include <seastar/core/file.hh>
 #include <seastar/util/noncopyable_function.hh>
 
 namespace seastar {
@@ -215,11 +216,27 @@ struct reply {
      */
     void write_body(const sstring& content_type, sstring content);
 
+    /*!
+     * \brief Reply with the contents of a file
+     *
+     * The file is sent with connected_socket::send_file(), so where the
+     * network stack supports it the content goes from the file to the
+     * socket without being copied through userspace.
+     *
+     * \param content_type - is used to choose the content type of the body. Use the file extension
+     *  you would have used for such a content, (i.e. "txt", "html", "json", etc')
+     * \param f - an open file; the reply takes ownership of it and closes it once sent
+     * \param size - the number of bytes to send, from the beginning of the file
+     */
+    void write_body(const sstring& content_type, file f, uint64_t size);
+
 private:
     future<> write_reply_to_connection(httpd::connection& con);
     future<> write_reply_headers(httpd::connection& connection);
 
     noncopyable_function<future<>(output_stream<char>&&)> _body_writer;
+    file _body_file;
+    uint64_t _body_file_size = 0;
     friend class httpd::routes;
     friend class httpd::connection;
 };
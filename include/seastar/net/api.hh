@@ -38,6 +38,8 @@
 
 namespace seastar {
 
+class file;
+
 inline
 bool is_ip_unspecified(const ipv4_addr& addr) noexcept {
     return addr.is_ip_unspecified();
@@ -104,6 +106,12 @@ class udp_datagram final {
     packet& get_data() { return _impl->get_data(); }
 };
 
+/// A datagram to send with \ref udp_channel::send_batch()
+struct udp_outgoing_datagram {
+    socket_address dst;
+    packet data;
+};
+
 class udp_channel {
 private:
     std::unique_ptr<udp_channel_impl> _impl;
@@ -120,6 +128,18 @@ class udp_channel {
     future<udp_datagram> receive();
     future<> send(const socket_address& dst, const char* msg);
     future<> send(const socket_address& dst, packet p);
+    /// Waits for at least one datagram and returns it, along with any
+    /// others already queued, up to \c max_datagrams.
+    ///
+    /// Where the network stack supports it, all of them are received with a
+    /// single system call. It is a cheaper alternative to calling receive()
+    /// repeatedly when datagrams arrive faster than they are processed.
+    future<std::vector<udp_datagram>> receive_batch(size_t max_datagrams);
+    /// Sends several datagrams, with as few system calls as the network
+    /// stack allows. Consecutive datagrams of equal size sent to the same
+    /// destination may be handed to the kernel as a single segmentation
+    /// offload (UDP GSO) message.
+    future<> send_batch(std::vector<udp_outgoing_datagram> datagrams);
     bool is_closed() const;
     /// Causes a pending receive() to complete (possibly with an exception)
     void shutdown_input();
@@ -221,6 +241,24 @@ class connected_socket {
     /// Local address of the socket
     socket_address local_address() const noexcept;
 
+    /// Sends a range of a file to the remote endpoint.
+    ///
+    /// Where the network stack supports it (the posix stack, for files
+    /// opened with \ref open_file_dma()), the data is handed to the kernel
+    /// with sendfile(2) and never copied through userspace. Otherwise the
+    /// file is read into memory and written to the socket.
+    ///
+    /// The data is written directly to the socket, bypassing any
+    /// \ref output_stream obtained from \ref output(); such a stream
+    /// must be flushed before calling this, and must not be written to
+    /// until the returned future resolves.
+    ///
+    /// \param f the file to send from; it must not be closed until the returned future resolves
+    /// \param pos offset of the first byte to send
+    /// \param len number of bytes to send; the file must hold at least \c pos + \c len bytes
+    /// \return a future that resolves once all the data was handed to the network stack
+    future<> send_file(file f, uint64_t pos, uint64_t len);
+
     /// Disables output to the socket.
     ///
     /// Current or future writes that have not been successfully flushed
@@ -48,6 +48,7 @@ class connected_socket_impl {
     virtual int get_sockopt(int level, int optname, void* data, size_t len) const = 0;
     virtual socket_address local_address() const noexcept = 0;
     virtual future<> wait_input_shutdown() = 0;
+    virtual future<> send_file(file f, uint64_t pos, uint64_t len);
 };
 
 class socket_impl {
@@ -75,6 +76,8 @@ class udp_channel_impl {
     virtual future<udp_datagram> receive() = 0;
     virtual future<> send(const socket_address& dst, const char* msg) = 0;
     virtual future<> send(const socket_address& dst, packet p) = 0;
+    virtual future<std::vector<udp_datagram>> receive_batch(size_t max_datagrams);
+    virtual future<> send_batch(std::vector<udp_outgoing_datagram> datagrams);
     virtual void shutdown_input() = 0;
     virtual void shutdown_output() = 0;
     virtual bool is_closed() const = 0;
@@ -0,0 +1,418 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/metrics.hh>
+#include <boost/range/irange.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace seastar {
+
+static constexpr uint64_t whole_file = std::numeric_limits<uint64_t>::max();
+
+block_cache::block_cache(config cfg)
+        : _config(std::move(cfg))
+        , _reclaimer([this] (memory::reclaimer::request req) { return reclaim(req); }, memory::reclaimer_scope::async)
+{
+    _config.block_size = align_up<size_t>(std::max<size_t>(_config.block_size, 1), 4096);
+    _config.protected_share = std::clamp(_config.protected_share, 0.0f, 1.0f);
+
+    namespace sm = seastar::metrics;
+    auto cache_label = sm::label("cache");
+    std::vector<sm::label_instance> labels = { cache_label(_config.name) };
+    _metrics.add_group("block_cache", {
+            sm::make_counter("hits", _stats.hits,
+                    sm::description("Total number of block reads served from the cache"), labels),
+            sm::make_counter("misses", _stats.misses,
+                    sm::description("Total number of blocks read from the underlying files"), labels),
+            sm::make_counter("coalesced_reads", _stats.coalesced,
+                    sm::description("Total number of block reads that waited for a read of the same block already in flight"), labels),
+            sm::make_counter("evictions", _stats.evictions,
+                    sm::description("Total number of blocks evicted to make room or to give memory back"), labels),
+            sm::make_counter("invalidations", _stats.invalidations,
+                    sm::description("Total number of blocks dropped because the file was modified"), labels),
+            sm::make_gauge("blocks", _stats.blocks,
+                    sm::description("Number of cached blocks"), labels),
+            sm::make_current_bytes("bytes", _stats.bytes,
+                    sm::description("Memory taken by the cached blocks"), labels),
+            sm::make_current_bytes("capacity", [this] { return _config.capacity; },
+                    sm::description("Memory the cached blocks may take"), labels),
+    });
+}
+
+block_cache::~block_cache() {
+    assert(_pending.empty());
+    _probationary.clear();
+    _protected.clear();
+    _blocks.clear();
+}
+
+future<temporary_buffer<char>> block_cache::get_block(cached_file_impl& f, uint64_t index, const io_priority_class& pc) {
+    key k{f._id, index};
+    if (auto it = _blocks.find(k); it != _blocks.end()) {
+        _stats.hits++;
+        touch(*it->second);
+        return make_ready_future<temporary_buffer<char>>(it->second->data.share());
+    }
+    if (auto it = _pending.find(k); it != _pending.end()) {
+        _stats.coalesced++;
+        auto pr = it->second;
+        return pr->ready.get_shared_future().then([pr] {
+            return pr->data.share();
+        });
+    }
+
+    _stats.misses++;
+    auto pr = make_lw_shared<pending_read>();
+    _pending.emplace(k, pr);
+    auto generation = f._generation;
+    // The read is shared by all the readers of the block, so it isn't
+    // bound to the intent of any of them
+    return f.underlying_file().dma_read_bulk<char>(index * _config.block_size, _config.block_size, pc).then_wrapped(
+            [this, &f, k, pr, generation] (future<temporary_buffer<char>> fut) {
+        if (auto it = _pending.find(k); it != _pending.end() && it->second == pr) {
+            _pending.erase(it);
+        }
+        if (fut.failed()) {
+            auto ex = fut.get_exception();
+            pr->ready.set_exception(ex);
+            return make_exception_future<temporary_buffer<char>>(std::move(ex));
+        }
+        pr->data = fut.get0();
+        if (f._generation == generation) {
+            try {
+                insert(f, k.index, pr->data.share());
+            } catch (...) {
+                // Not caching the block is fine
+            }
+        }
+        pr->ready.set_value();
+        return make_ready_future<temporary_buffer<char>>(pr->data.share());
+    });
+}
+
+void block_cache::insert(cached_file_impl& f, uint64_t index, temporary_buffer<char> data) {
+    if (data.size() > _config.capacity) {
+        return;
+    }
+    auto b = std::make_unique<block>(key{f._id, index}, std::move(data));
+    auto& ref = *b;
+    if (!_blocks.emplace(ref.k, std::move(b)).second) {
+        return;
+    }
+    _probationary.push_back(ref);
+    f._blocks.push_back(ref);
+    _stats.blocks++;
+    _stats.bytes += ref.data.size();
+    evict_to(_config.capacity);
+}
+
+void block_cache::touch(block& b) noexcept {
+    b.lru_hook.unlink();
+    if (!b.is_protected) {
+        b.is_protected = true;
+        _protected_bytes += b.data.size();
+    }
+    _protected.push_back(b);
+
+    // Blocks pushed out of the protected segment get another chance in
+    // the probationary one
+    auto limit = _config.capacity * _config.protected_share;
+    while (_protected_bytes > limit) {
+        auto& victim = _protected.front();
+        _protected.pop_front();
+        victim.is_protected = false;
+        _protected_bytes -= victim.data.size();
+        _probationary.push_back(victim);
+    }
+}
+
+void block_cache::erase(block& b) noexcept {
+    if (b.is_protected) {
+        _protected_bytes -= b.data.size();
+    }
+    _stats.blocks--;
+    _stats.bytes -= b.data.size();
+    // The hooks unlink the block from its lists when it's destroyed
+    auto k = b.k;
+    _blocks.erase(k);
+}
+
+uint64_t block_cache::drop(cached_file_impl& f, uint64_t first, uint64_t last) noexcept {
+    uint64_t dropped = 0;
+    if (last - first < 64) {
+        for (auto idx = first; idx <= last; idx++) {
+            if (auto it = _blocks.find(key{f._id, idx}); it != _blocks.end()) {
+                erase(*it->second);
+                dropped++;
+            }
+        }
+    } else {
+        for (auto it = f._blocks.begin(); it != f._blocks.end();) {
+            auto& b = *it++;
+            if (b.k.index >= first && b.k.index <= last) {
+                erase(b);
+                dropped++;
+            }
+        }
+    }
+    // Readers already waiting for these get what was read, the next ones
+    // must read the block again
+    for (auto it = _pending.begin(); it != _pending.end();) {
+        if (it->first.file_id == f._id && it->first.index >= first && it->first.index <= last) {
+            it = _pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return dropped;
+}
+
+void block_cache::evict_to(size_t bytes) noexcept {
+    while (_stats.bytes > bytes) {
+        auto& lru = _probationary.empty() ? _protected : _probationary;
+        if (lru.empty()) {
+            break;
+        }
+        _stats.evictions++;
+        erase(lru.front());
+    }
+}
+
+size_t block_cache::evict(size_t bytes) noexcept {
+    auto before = _stats.bytes;
+    evict_to(bytes < before ? before - bytes : 0);
+    return before - _stats.bytes;
+}
+
+void block_cache::set_capacity(size_t capacity) noexcept {
+    _config.capacity = capacity;
+    evict_to(capacity);
+}
+
+memory::reclaiming_result block_cache::reclaim(memory::reclaimer::request req) noexcept {
+    return evict(req.bytes_to_reclaim) ? memory::reclaiming_result::reclaimed_something
+                                       : memory::reclaiming_result::reclaimed_nothing;
+}
+
+cached_file_impl::cached_file_impl(file underlying_file, block_cache& cache)
+        : layered_file_impl(std::move(underlying_file))
+        , _cache(cache)
+        , _id(cache.register_file())
+{
+}
+
+cached_file_impl::~cached_file_impl() {
+    _cache.drop(*this, 0, whole_file);
+}
+
+void cached_file_impl::invalidate(uint64_t pos, uint64_t len) noexcept {
+    _generation++;
+    if (!len) {
+        return;
+    }
+    auto bs = _cache.block_size();
+    auto last = len > whole_file - pos ? whole_file : pos + len - 1;
+    _cache._stats.invalidations += _cache.drop(*this, pos / bs, last / bs);
+}
+
+template <typename Func>
+futurize_t<std::invoke_result_t<Func>> cached_file_impl::modify(uint64_t pos, uint64_t len, Func&& op) noexcept {
+    // Blocks read while the operation is in flight may have missed it,
+    // so the invalidation happens once it's done
+    return futurize_invoke(std::forward<Func>(op)).finally([this, pos, len] {
+        invalidate(pos, len);
+    });
+}
+
+future<std::vector<temporary_buffer<char>>>
+cached_file_impl::read_blocks(uint64_t pos, size_t len, const io_priority_class& pc) {
+    if (!len) {
+        return make_ready_future<std::vector<temporary_buffer<char>>>();
+    }
+    auto bs = _cache.block_size();
+    auto first = pos / bs;
+    auto last = (pos + len - 1) / bs;
+    return with_gate(_gate, [this, pos, len, bs, first, last, &pc] {
+        return do_with(std::vector<temporary_buffer<char>>(last - first + 1), [this, pos, len, bs, first, last, &pc] (auto& blocks) {
+            return parallel_for_each(boost::irange<uint64_t>(first, last + 1), [this, &blocks, first, &pc] (uint64_t idx) {
+                return _cache.get_block(*this, idx, pc).then([&blocks, idx, first] (temporary_buffer<char> b) {
+                    blocks[idx - first] = std::move(b);
+                });
+            }).then([&blocks, pos, len, bs, first] {
+                // Cut the blocks to the range, a short block is the end of the file
+                std::vector<temporary_buffer<char>> ret;
+                ret.reserve(blocks.size());
+                auto end = pos + len;
+                for (size_t i = 0; i < blocks.size(); i++) {
+                    auto& b = blocks[i];
+                    auto start = (first + i) * bs;
+                    bool eof = b.size() < bs;
+                    auto front = std::max(pos, start) - start;
+                    if (b.size() <= front) {
+                        break;
+                    }
+                    b.trim_front(front);
+                    b.trim(std::min<uint64_t>(b.size(), end - (start + front)));
+                    ret.push_back(std::move(b));
+                    if (eof) {
+                        break;
+                    }
+                }
+                return ret;
+            });
+        });
+    });
+}
+
+future<size_t> cached_file_impl::read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) {
+    return read_blocks(pos, len, pc).then([buffer] (std::vector<temporary_buffer<char>> blocks) {
+        auto dst = static_cast<char*>(buffer);
+        size_t done = 0;
+        for (auto& b : blocks) {
+            std::copy_n(b.get(), b.size(), dst + done);
+            done += b.size();
+        }
+        return done;
+    });
+}
+
+future<size_t> cached_file_impl::read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) {
+    size_t len = 0;
+    for (auto& v : iov) {
+        len += v.iov_len;
+    }
+    return read_blocks(pos, len, pc).then([iov = std::move(iov)] (std::vector<temporary_buffer<char>> blocks) {
+        size_t done = 0;
+        auto v = iov.begin();
+        size_t v_off = 0;
+        for (auto& b : blocks) {
+            size_t b_off = 0;
+            while (b_off < b.size()) {
+                auto n = std::min(b.size() - b_off, v->iov_len - v_off);
+                std::copy_n(b.get() + b_off, n, static_cast<char*>(v->iov_base) + v_off);
+                b_off += n;
+                v_off += n;
+                if (v_off == v->iov_len) {
+                    ++v;
+                    v_off = 0;
+                }
+            }
+            done += b.size();
+        }
+        return done;
+    });
+}
+
+future<temporary_buffer<uint8_t>> cached_file_impl::dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) {
+    return read_blocks(offset, range_size, pc).then([this] (std::vector<temporary_buffer<char>> blocks) {
+        if (blocks.size() == 1) {
+            auto& b = blocks.front();
+            return temporary_buffer<uint8_t>(reinterpret_cast<uint8_t*>(b.get_write()), b.size(), b.release());
+        }
+        size_t len = 0;
+        for (auto& b : blocks) {
+            len += b.size();
+        }
+        if (!len) {
+            return temporary_buffer<uint8_t>();
+        }
+        auto ret = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, len);
+        size_t done = 0;
+        for (auto& b : blocks) {
+            std::copy_n(reinterpret_cast<const uint8_t*>(b.get()), b.size(), ret.get_write() + done);
+            done += b.size();
+        }
+        return ret;
+    });
+}
+
+future<size_t> cached_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) {
+    return write_dma(pos, buffer, len, pc, nullptr);
+}
+
+future<size_t> cached_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) {
+    return write_dma(pos, std::move(iov), pc, nullptr);
+}
+
+future<size_t> cached_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) {
+    return modify(pos, len, [this, pos, buffer, len, &pc, intent] {
+        return _underlying_file.dma_write(pos, static_cast<const char*>(buffer), len, pc, intent);
+    });
+}
+
+future<size_t> cached_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) {
+    size_t len = 0;
+    for (auto& v : iov) {
+        len += v.iov_len;
+    }
+    return modify(pos, len, [this, pos, iov = std::move(iov), &pc, intent] () mutable {
+        return _underlying_file.dma_write(pos, std::move(iov), pc, intent);
+    });
+}
+
+future<> cached_file_impl::flush() {
+    return _underlying_file.flush();
+}
+
+future<struct stat> cached_file_impl::stat() {
+    return _underlying_file.stat();
+}
+
+// Changing the size changes the last block, wherever it was
+future<> cached_file_impl::truncate(uint64_t length) {
+    return modify(0, whole_file, [this, length] {
+        return _underlying_file.truncate(length);
+    });
+}
+
+future<> cached_file_impl::discard(uint64_t offset, uint64_t length) {
+    return modify(offset, length, [this, offset, length] {
+        return _underlying_file.discard(offset, length);
+    });
+}
+
+future<> cached_file_impl::allocate(uint64_t position, uint64_t length) {
+    return modify(0, whole_file, [this, position, length] {
+        return _underlying_file.allocate(position, length);
+    });
+}
+
+future<uint64_t> cached_file_impl::size() {
+    return _underlying_file.size();
+}
+
+future<> cached_file_impl::close() {
+    return _gate.close().then([this] {
+        _cache.drop(*this, 0, whole_file);
+        return _underlying_file.close();
+    });
+}
+
+subscription<directory_entry> cached_file_impl::list_directory(std::function<future<> (directory_entry de)> next) {
+    return _underlying_file.list_directory(std::move(next));
+}
+
+file make_cached_file(file f, block_cache& cache) {
+    return file(make_shared<cached_file_impl>(std::move(f), cache));
+}
+
+}
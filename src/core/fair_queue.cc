@@ -39,7 +39,7 @@
 namespace seastar {
 
 static_assert(sizeof(fair_queue_ticket) == sizeof(uint64_t), "unexpected fair_queue_ticket size");
-static_assert(sizeof(fair_queue_entry) <= 3 * sizeof(void*), "unexpected fair_queue_entry::_hook size");
+static_assert(sizeof(fair_queue_entry) <= 7 * sizeof(void*), "unexpected fair_queue_entry size");
 static_assert(sizeof(fair_queue_entry::container_list_t) == 2 * sizeof(void*), "unexpected priority_class::_queue size");
 
 fair_queue_ticket::fair_queue_ticket(uint32_t weight, uint32_t size) noexcept
@@ -98,6 +98,8 @@ fair_group::fair_group(config cfg)
                         std::max<capacity_t>(cfg.rate_factor * fixed_point_factor * token_bucket_t::rate_cast(cfg.rate_limit_duration).count(), ticket_capacity(fair_queue_ticket(cfg.limit_min_weight, cfg.limit_min_size))),
                         ticket_capacity(fair_queue_ticket(cfg.min_weight, cfg.min_size))
                        )
+        , _base_rate(_token_bucket.rate())
+        , _capacity_borrowing(cfg.capacity_borrowing)
 {
     assert(_cost_capacity.is_non_zero());
     seastar_logger.info("Created fair group {}, capacity rate {}, limit {}, rate {} (factor {}), threshold {}", cfg.label,
@@ -117,6 +119,18 @@ auto fair_group::grab_capacity(capacity_t cap) noexcept -> capacity_t {
     return _token_bucket.grab(cap);
 }
 
+void fair_group::scale_rate(double scale) noexcept {
+    _token_bucket.update_rate(std::max<capacity_t>(_base_rate * scale, 1));
+}
+
+auto fair_group::dispatch_quota(uint64_t shares) const noexcept -> capacity_t {
+    if (!_capacity_borrowing || !shares) {
+        return maximum_capacity() / smp::count;
+    }
+    auto total = std::max(_backlog_shares.load(std::memory_order_relaxed), shares);
+    return maximum_capacity() * (double(shares) / total);
+}
+
 void fair_group::release_capacity(capacity_t cap) noexcept {
     _token_bucket.release(cap);
 }
@@ -150,11 +164,16 @@ class fair_queue::priority_class_data {
     capacity_t _accumulated = 0;
     capacity_t _pure_accumulated = 0;
     fair_queue_entry::container_list_t _queue;
+    fair_queue_entry::deadline_set_t _deadlines;
     bool _queued = false;
     bool _plugged = true;
 
 public:
     explicit priority_class_data(uint32_t shares) noexcept : _shares(std::max(shares, 1u)) {}
+
+    bool empty() const noexcept {
+        return _queue.empty();
+    }
     priority_class_data(const priority_class_data&) = delete;
     priority_class_data(priority_class_data&&) = delete;
 
@@ -185,6 +204,9 @@ fair_queue::fair_queue(fair_queue&& other)
     , _handles(std::move(other._handles))
     , _priority_classes(std::move(other._priority_classes))
     , _last_accumulated(other._last_accumulated)
+    , _nr_deadlines(std::exchange(other._nr_deadlines, 0))
+    , _backlog_shares(std::exchange(other._backlog_shares, 0))
+    , _published_backlog_shares(std::exchange(other._published_backlog_shares, 0))
 {
 }
 
@@ -192,6 +214,7 @@ fair_queue::~fair_queue() {
     for (const auto& fq : _priority_classes) {
         assert(!fq);
     }
+    _group.update_backlog_shares(-int64_t(_published_backlog_shares));
 }
 
 void fair_queue::push_priority_class(priority_class_data& pc) noexcept {
@@ -207,7 +230,7 @@ void fair_queue::push_priority_class_from_idle(priority_class_data& pc) noexcept
         // duration. For this estimate how many capacity units can be
         // accumulated with the current class shares per rate resulution
         // and scale it up to tau.
-        capacity_t max_deviation = fair_group::fixed_point_factor / pc._shares * fair_group::token_bucket_t::rate_cast(_config.tau).count();
+        capacity_t max_deviation = this->max_deviation(pc);
         // On start this deviation can go to negative values, so not to
         // introduce extra if's for that short corner case, use signed
         // arithmetics and make sure the _accumulated value doesn't grow
@@ -219,16 +242,25 @@ void fair_queue::push_priority_class_from_idle(priority_class_data& pc) noexcept
     }
 }
 
+auto fair_queue::max_deviation(const priority_class_data& pc) const noexcept -> capacity_t {
+    return fair_group::fixed_point_factor / pc._shares * fair_group::token_bucket_t::rate_cast(_config.tau).count();
+}
+
 void fair_queue::pop_priority_class(priority_class_data& pc) noexcept {
     assert(pc._plugged && pc._queued);
     pc._queued = false;
-    _handles.pop();
+    if (_handles.top() == &pc) {
+        _handles.pop();
+    } else {
+        _handles.remove(&pc);
+    }
 }
 
 void fair_queue::plug_priority_class(priority_class_data& pc) noexcept {
     assert(!pc._plugged && !pc._queued);
     pc._plugged = true;
-    if (!pc._queue.empty()) {
+    if (!pc.empty()) {
+        _backlog_shares += pc._shares;
         push_priority_class_from_idle(pc);
     }
 }
@@ -242,6 +274,9 @@ void fair_queue::unplug_priority_class(priority_class_data& pc) noexcept {
     if (pc._queued) {
         pop_priority_class(pc);
     }
+    if (!pc.empty()) {
+        _backlog_shares -= pc._shares;
+    }
     pc._plugged = false;
 }
 
@@ -249,7 +284,7 @@ void fair_queue::unplug_class(class_id cid) noexcept {
     unplug_priority_class(*_priority_classes[cid]);
 }
 
-auto fair_queue::grab_pending_capacity(const fair_queue_entry& ent) noexcept -> grab_result {
+auto fair_queue::grab_pending_capacity(const priority_class_data& pc, const fair_queue_entry& ent) noexcept -> grab_result {
     _group.maybe_replenish_capacity(_group_replenish);
 
     if (_group.capacity_deficiency(_pending->head)) {
@@ -258,7 +293,16 @@ auto fair_queue::grab_pending_capacity(const fair_queue_entry& ent) noexcept ->
 
     capacity_t cap = _group.ticket_capacity(ent._ticket);
     if (cap > _pending->cap) {
-        return grab_result::cant_preempt;
+        if (&pc != _pending->pc) {
+            return grab_result::cant_preempt;
+        }
+        // The class' next entry grew while waiting, e.g. by having reads
+        // merged into it, or a bigger one due soon overtook it
+        _pending->head = _group.grab_capacity(cap - _pending->cap);
+        _pending->cap = cap;
+        if (_group.capacity_deficiency(_pending->head)) {
+            return grab_result::pending;
+        }
     }
 
     if (cap < _pending->cap) {
@@ -269,15 +313,15 @@ auto fair_queue::grab_pending_capacity(const fair_queue_entry& ent) noexcept ->
     return grab_result::grabbed;
 }
 
-auto fair_queue::grab_capacity(const fair_queue_entry& ent) noexcept -> grab_result {
+auto fair_queue::grab_capacity(const priority_class_data& pc, const fair_queue_entry& ent) noexcept -> grab_result {
     if (_pending) {
-        return grab_pending_capacity(ent);
+        return grab_pending_capacity(pc, ent);
     }
 
     capacity_t cap = _group.ticket_capacity(ent._ticket);
     capacity_t want_head = _group.grab_capacity(cap);
     if (_group.capacity_deficiency(want_head)) {
-        _pending.emplace(want_head, cap);
+        _pending.emplace(want_head, cap, &pc);
         return grab_result::pending;
     }
 
@@ -298,7 +342,7 @@ void fair_queue::register_priority_class(class_id id, uint32_t shares) {
 
 void fair_queue::unregister_priority_class(class_id id) {
     auto& pclass = _priority_classes[id];
-    assert(pclass && pclass->_queue.empty());
+    assert(pclass && pclass->empty());
     pclass.reset();
     _nr_classes--;
 }
@@ -307,7 +351,13 @@ void fair_queue::update_shares_for_class(class_id id, uint32_t shares) {
     assert(id < _priority_classes.size());
     auto& pc = _priority_classes[id];
     assert(pc);
-    pc->update_shares(shares);
+    if (pc->_plugged && !pc->empty()) {
+        _backlog_shares -= pc->_shares;
+        pc->update_shares(shares);
+        _backlog_shares += pc->_shares;
+    } else {
+        pc->update_shares(shares);
+    }
 }
 
 size_t fair_queue::waiters() const {
@@ -332,9 +382,16 @@ void fair_queue::queue(class_id id, fair_queue_entry& ent) noexcept {
     // Since we don't know which queue we will use to execute the next request - if ours or
     // someone else's, we need a separate promise at this point.
     if (pc._plugged) {
+        if (pc.empty()) {
+            _backlog_shares += pc._shares;
+        }
         push_priority_class_from_idle(pc);
     }
     pc._queue.push_back(ent);
+    if (ent.has_deadline()) {
+        pc._deadlines.insert(ent);
+        _nr_deadlines++;
+    }
     _resources_queued += ent._ticket;
     _requests_queued++;
 }
@@ -350,6 +407,12 @@ void fair_queue::notify_request_cancelled(fair_queue_entry& ent) noexcept {
     ent._ticket = fair_queue_ticket();
 }
 
+void fair_queue::update_request_ticket(fair_queue_entry& ent, fair_queue_ticket ticket) noexcept {
+    _resources_queued -= ent._ticket;
+    _resources_queued += ticket;
+    ent._ticket = ticket;
+}
+
 fair_queue::clock_type::time_point fair_queue::next_pending_aio() const noexcept {
     if (_pending) {
         /*
@@ -370,19 +433,94 @@ fair_queue::clock_type::time_point fair_queue::next_pending_aio() const noexcept
     return std::chrono::steady_clock::time_point::max();
 }
 
+// Within a class, requests go in the order they were queued, except that
+// the ones close to their deadline jump the queue
+fair_queue_entry& fair_queue::next_entry(priority_class_data& pc, clock_type::time_point now) noexcept {
+    if (!pc._deadlines.empty() && pc._deadlines.begin()->_deadline <= now + _config.deadline_horizon) {
+        return *pc._deadlines.begin();
+    }
+    return pc._queue.front();
+}
+
+void fair_queue::pop_entry(priority_class_data& pc, fair_queue_entry& ent) noexcept {
+    pc._queue.erase(pc._queue.iterator_to(ent));
+    if (ent.has_deadline()) {
+        pc._deadlines.erase(pc._deadlines.iterator_to(ent));
+        _nr_deadlines--;
+    }
+    if (pc._plugged && pc.empty()) {
+        _backlog_shares -= pc._shares;
+    }
+}
+
+// The class with the least accumulated capacity goes next, unless another
+// one has a request due within the horizon and is not more than tau worth
+// of its shares ahead. Then the most urgent of those goes.
+auto fair_queue::pick_class(clock_type::time_point now) noexcept -> priority_class_data& {
+    priority_class_data& top = *_handles.top();
+    if (!_nr_deadlines) {
+        return top;
+    }
+    auto due = now + _config.deadline_horizon;
+    priority_class_data* best = &top;
+    for (auto pc : _handles.classes()) {
+        if (pc->_deadlines.empty() || pc->_accumulated > top._accumulated + max_deviation(*pc)) {
+            continue;
+        }
+        auto deadline = pc->_deadlines.begin()->_deadline;
+        if (deadline <= due && (best->_deadlines.empty() || deadline < best->_deadlines.begin()->_deadline)) {
+            best = pc;
+        }
+    }
+    return *best;
+}
+
+void fair_queue::expire_requests(clock_type::time_point now, const std::function<void(fair_queue_entry&)>& expired) {
+    for (auto& pc : _priority_classes) {
+        if (!pc) {
+            continue;
+        }
+        while (!pc->_deadlines.empty() && pc->_deadlines.begin()->_deadline < now) {
+            auto& ent = *pc->_deadlines.begin();
+            pop_entry(*pc, ent);
+            _resources_queued -= ent._ticket;
+            _requests_queued--;
+            expired(ent);
+        }
+    }
+}
+
+void fair_queue::publish_backlog_shares() noexcept {
+    if (_group.capacity_borrowing() && _backlog_shares != _published_backlog_shares) {
+        _group.update_backlog_shares(int64_t(_backlog_shares) - int64_t(_published_backlog_shares));
+        _published_backlog_shares = _backlog_shares;
+    }
+}
+
 void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
+    dispatch_requests(std::move(cb), {});
+}
+
+void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb, std::function<void(fair_queue_entry&)> expired) {
     capacity_t dispatched = 0;
     boost::container::small_vector<priority_class_ptr, 2> preempt;
+    auto now = _nr_deadlines ? clock_type::now() : clock_type::time_point();
 
-    while (!_handles.empty() && (dispatched < _group.maximum_capacity() / smp::count)) {
-        priority_class_data& h = *_handles.top();
-        if (h._queue.empty()) {
-            pop_priority_class(h);
+    if (_nr_deadlines && expired) {
+        expire_requests(now, expired);
+    }
+
+    publish_backlog_shares();
+    auto quota = _group.dispatch_quota(_published_backlog_shares);
+    while (!_handles.empty() && (dispatched < quota)) {
+        if (_handles.top()->empty()) {
+            pop_priority_class(*_handles.top());
             continue;
         }
+        priority_class_data& h = pick_class(now);
 
-        auto& req = h._queue.front();
-        auto gr = grab_capacity(req);
+        auto& req = next_entry(h, now);
+        auto gr = grab_capacity(h, req);
         if (gr == grab_result::pending) {
             break;
         }
@@ -395,7 +533,7 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
 
         _last_accumulated = std::max(h._accumulated, _last_accumulated);
         pop_priority_class(h);
-        h._queue.pop_front();
+        pop_entry(h, req);
 
         _resources_executing += req._ticket;
         _resources_queued -= req._ticket;
@@ -427,7 +565,7 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
         dispatched += _group.ticket_capacity(req._ticket);
         cb(req);
 
-        if (h._plugged && !h._queue.empty()) {
+        if (h._plugged && !h.empty()) {
             push_priority_class(h);
         }
     }
@@ -435,6 +573,7 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
     for (auto&& h : preempt) {
         push_priority_class(*h);
     }
+    publish_backlog_shares();
 }
 
 std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::metrics(class_id c) {
@@ -78,6 +78,8 @@ class posix_file_impl : public file_impl {
     const open_flags _open_flags;
 protected:
     int _fd;
+    // The reactor the descriptor is registered with (see reactor::register_file())
+    reactor* _registered_with = nullptr;
 
     posix_file_impl(int fd, open_flags, file_open_options options, dev_t device_id, bool nowait_works);
     posix_file_impl(int fd, open_flags, file_open_options options, dev_t device_id, const internal::fs_info& fsi);
@@ -130,8 +132,23 @@ class posix_file_impl : public file_impl {
     open_flags flags() const {
         return _open_flags;
     }
+    // The descriptor the kernel can send the file contents from directly
+    // (see connected_socket::send_file()), or -1 if the kernel view of the
+    // file may lag behind what was written through this object
+    virtual int sendfile_fd() const noexcept {
+        return _fd;
+    }
+    // Resolves to a descriptor of sendfile_fd()'s file that sendfile(2) can
+    // read from at any offset. That is a descriptor without O_DIRECT, which
+    // is opened on first use and kept until the file is closed.
+    future<int> sendfile_source() noexcept;
 private:
+    // See sendfile_source(); equal to _fd if _fd has no O_DIRECT
+    int _sendfile_source_fd = -1;
+
     void configure_dma_alignment(const internal::fs_info& fsi);
+    void register_file() noexcept;
+    void unregister_file(int fd) noexcept;
     void configure_io_lengths() noexcept;
 
     /**
@@ -160,6 +177,7 @@ class posix_file_impl : public file_impl {
 protected:
     future<size_t> do_write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept;
     future<size_t> do_write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept;
+    future<size_t> do_write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept;
     future<size_t> do_read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept;
     future<size_t> do_read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept;
     future<temporary_buffer<uint8_t>> do_dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) noexcept;
@@ -178,6 +196,7 @@ class posix_file_real_impl final : public posix_file_impl {
     using posix_file_impl::write_dma;
     virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override;
     virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override;
+    virtual future<size_t> write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override;
     using posix_file_impl::dma_read_bulk;
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) noexcept override;
 };
@@ -276,6 +295,10 @@ class append_challenged_posix_file_impl final : public posix_file_impl, public e
     future<uint64_t> size() noexcept override;
     virtual future<> allocate(uint64_t position, uint64_t length) noexcept override;
     future<> close() noexcept override;
+    int sendfile_fd() const noexcept override {
+        // Appends may still be queued, or the file size not yet updated
+        return -1;
+    }
 };
 
 class blockdev_file_impl final : public posix_file_impl {
@@ -291,6 +314,7 @@ class blockdev_file_impl final : public posix_file_impl {
     using posix_file_impl::write_dma;
     virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override;
     virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override;
+    virtual future<size_t> write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override;
     using posix_file_impl::dma_read_bulk;
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) noexcept override;
 };
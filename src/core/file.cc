@@ -107,6 +107,7 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
         , _fd(fd)
 {
     configure_io_lengths();
+    register_file();
 }
 
 posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, const internal::fs_info& fsi)
@@ -116,6 +117,12 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
 }
 
 posix_file_impl::~posix_file_impl() {
+    if (_fd != -1) {
+        unregister_file(_fd);
+    }
+    if (_sendfile_source_fd != -1 && _sendfile_source_fd != _fd) {
+        ::close(_sendfile_source_fd);
+    }
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         return;
     }
@@ -175,6 +182,23 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, std::atomic<unsigned>* re
     _disk_write_dma_alignment = disk_write_dma_alignment;
     _disk_overwrite_dma_alignment = disk_overwrite_dma_alignment;
     configure_io_lengths();
+    register_file();
+}
+
+void posix_file_impl::register_file() noexcept {
+    // Files may also be opened and closed off the reactor threads
+    if (engine_is_ready() && engine().registers_files()) {
+        _registered_with = &engine();
+        _registered_with->register_file(_fd);
+    }
+}
+
+void posix_file_impl::unregister_file(int fd) noexcept {
+    // The registration is gone with the reactor that held it
+    if (_registered_with && engine_is_ready() && &engine() == _registered_with) {
+        _registered_with->unregister_file(fd);
+    }
+    _registered_with = nullptr;
 }
 
 future<>
@@ -294,6 +318,11 @@ posix_file_impl::close() noexcept {
     }
     auto fd = _fd;
     _fd = -1;  // Prevent a concurrent close (which is illegal) from closing another file's fd
+    unregister_file(fd);
+    if (auto sfd = std::exchange(_sendfile_source_fd, -1); sfd != -1 && sfd != fd) {
+        // Nothing was written through it, so there is no writeback to wait for
+        ::close(sfd);
+    }
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         _refcount = nullptr;
         return make_ready_future<>();
@@ -319,6 +348,32 @@ posix_file_impl::close() noexcept {
     });
 }
 
+future<int>
+posix_file_impl::sendfile_source() noexcept {
+    if (_sendfile_source_fd != -1) {
+        return make_ready_future<int>(_sendfile_source_fd);
+    }
+    // sendfile() from an O_DIRECT descriptor fails unless the range is
+    // aligned to the disk block size. A dup() would share the file status
+    // flags with _fd, so clearing O_DIRECT needs a new open file description.
+    return engine()._thread_pool->submit<syscall_result<int>>([fd = _fd] {
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags == -1 || !(flags & O_DIRECT)) {
+            return wrap_syscall<int>(flags == -1 ? -1 : fd);
+        }
+        return wrap_syscall<int>(::open(fmt::format("/proc/self/fd/{}", fd).c_str(), O_RDONLY | O_CLOEXEC));
+    }).then([this] (syscall_result<int> sr) {
+        sr.throw_if_error();
+        if (_sendfile_source_fd == -1) {
+            _sendfile_source_fd = sr.result;
+        } else if (sr.result != _fd) {
+            // A concurrent transfer got there first
+            ::close(sr.result);
+        }
+        return _sendfile_source_fd;
+    });
+}
+
 future<uint64_t>
 blockdev_file_impl::size(void) noexcept {
     return engine()._thread_pool->submit<syscall_result_extra<size_t>>([this] {
@@ -426,6 +481,31 @@ posix_file_impl::do_write_dma(uint64_t pos, const void* buffer, size_t len, cons
     return _io_queue.submit_io_write(io_priority_class, len, std::move(req), intent);
 }
 
+future<size_t>
+posix_file_impl::do_write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& io_priority_class, io_intent* intent) noexcept {
+    auto& r = engine();
+    if ((_open_flags & open_flags::dsync) != open_flags{} || r._bypass_fsync) {
+        return do_write_dma(pos, buffer, len, io_priority_class, intent);
+    }
+    // The linked request cannot be split, so the long ones go the slow way
+    if (!r.have_linked_fdatasync() || len > _write_max_length) {
+        return file_impl::write_dma_and_sync(pos, buffer, len, io_priority_class, intent);
+    }
+    ++r._fsyncs;
+    // Only the write is charged, the sync is not accounted by the io_queue
+    // when submitted on its own either
+    auto req = internal::io_request::make_write_fdatasync(_fd, pos, buffer, len, _nowait_works);
+    return _io_queue.submit_io_write(io_priority_class, len, std::move(req), intent).then([this, len] (size_t ret) {
+        if (ret < len) {
+            // The sync was cancelled along with the rest of the write
+            return flush().then([ret] {
+                return ret;
+            });
+        }
+        return make_ready_future<size_t>(ret);
+    });
+}
+
 future<size_t>
 posix_file_impl::do_write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& io_priority_class, io_intent* intent) noexcept {
     auto len = internal::sanitize_iovecs(iov, _disk_write_dma_alignment);
@@ -456,6 +536,11 @@ posix_file_real_impl::write_dma(uint64_t pos, std::vector<iovec> iov, const io_p
     return posix_file_impl::do_write_dma(pos, std::move(iov), pc, intent);
 }
 
+future<size_t>
+posix_file_real_impl::write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept {
+    return posix_file_impl::do_write_dma_and_sync(pos, buffer, len, pc, intent);
+}
+
 future<size_t>
 posix_file_real_impl::read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept {
     return posix_file_impl::do_read_dma(pos, buffer, len, pc, intent);
@@ -589,6 +674,10 @@ static bool blockdev_nowait_works(dev_t device_id) {
 blockdev_file_impl::blockdev_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, size_t block_size)
         : posix_file_impl(fd, f, options, device_id, blockdev_nowait_works(device_id)) {
     // FIXME -- configure file_impl::_..._dma_alignment's from block_size
+    // O_DIRECT is set by fcntl() after open(), so it is not in f
+    if (_registered_with && (::fcntl(_fd, F_GETFL) & O_DIRECT)) {
+        _registered_with->register_polled_file(_fd, device_id);
+    }
 }
 
 future<>
@@ -623,6 +712,11 @@ blockdev_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, const io_pri
     return posix_file_impl::do_write_dma(pos, std::move(iov), pc, intent);
 }
 
+future<size_t>
+blockdev_file_impl::write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept {
+    return posix_file_impl::do_write_dma_and_sync(pos, buffer, len, pc, intent);
+}
+
 future<size_t>
 blockdev_file_impl::read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept {
     return posix_file_impl::do_read_dma(pos, buffer, len, pc, intent);
@@ -1237,6 +1331,15 @@ file::dma_write_impl(uint64_t pos, const uint8_t* buffer, size_t len, const io_p
   }
 }
 
+future<size_t>
+file::dma_write_and_sync_impl(uint64_t pos, const uint8_t* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept {
+  try {
+    return _file_impl->write_dma_and_sync(pos, buffer, len, pc, intent);
+  } catch (...) {
+    return current_exception_as_future<size_t>();
+  }
+}
+
 future<size_t> file::dma_read(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept {
   try {
     return _file_impl->read_dma(pos, std::move(iov), pc, intent);
@@ -1290,6 +1393,16 @@ file_impl::dup() {
     throw std::runtime_error("this file type cannot be duplicated");
 }
 
+future<size_t> file_impl::write_dma_and_sync(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept {
+    return futurize_invoke([this, pos, buffer, len, &pc, intent] {
+        return write_dma(pos, buffer, len, pc, intent);
+    }).then([this] (size_t ret) {
+        return flush().then([ret] {
+            return ret;
+        });
+    });
+}
+
 future<int> file_impl::ioctl(uint64_t cmd, void* argp) noexcept {
     return make_exception_future<int>(std::runtime_error("this file type does not support ioctl"));
 }
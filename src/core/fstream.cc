@@ -59,6 +59,68 @@ static inline T select_buffer_size(T configured_value, T maximum_value) noexcept
     }
 }
 
+namespace internal {
+
+void read_ahead_engine::on_stream_start(uint64_t pos) noexcept {
+    if (_last_start) {
+        auto p = access_pattern::random;
+        int64_t diff = pos - *_last_start;
+        if (pos == _last_end && diff != 0) {
+            p = access_pattern::sequential;
+        } else if (diff != 0 && diff == _stride) {
+            p = diff > 0 ? access_pattern::strided : access_pattern::reverse;
+        }
+        _stride = diff;
+        if (p == _candidate) {
+            _hits++;
+        } else {
+            _candidate = p;
+            _hits = 1;
+        }
+    }
+    _last_start = pos;
+    _last_end = pos;
+}
+
+void read_ahead_engine::on_stream_end(uint64_t pos) noexcept {
+    // Another stream may have started since, then it's the one to follow
+    if (_last_start && pos >= *_last_start) {
+        _last_end = std::max(_last_end, pos);
+    }
+}
+
+void read_ahead_engine::on_consumed(size_t bytes, clock_type::duration elapsed) noexcept {
+    auto sec = std::chrono::duration<double>(elapsed).count();
+    if (sec <= 0) {
+        return;
+    }
+    auto rate = bytes / sec;
+    _consume_rate = _consume_rate ? _consume_rate + smoothing * (rate - _consume_rate) : rate;
+}
+
+void read_ahead_engine::on_read(clock_type::duration latency) noexcept {
+    auto sec = std::chrono::duration<double>(latency).count();
+    _read_latency = _read_latency ? _read_latency + smoothing * (sec - _read_latency) : sec;
+    // Follow drops at once, but rises only slowly, so that the reads that
+    // waited in the queue don't count as the disk getting slower
+    if (!_idle_latency || sec < _idle_latency) {
+        _idle_latency = sec;
+    } else {
+        _idle_latency += smoothing / 8 * (sec - _idle_latency);
+    }
+}
+
+unsigned read_ahead_engine::wanted_read_ahead(size_t buffer_size) const noexcept {
+    if (!_consume_rate || !_idle_latency || !buffer_size) {
+        return 0;
+    }
+    // What's consumed while a read is in flight, plus the buffer being consumed
+    auto buffers = std::ceil(_consume_rate * _idle_latency / buffer_size) + 1;
+    return std::min(buffers, 1024.0);
+}
+
+}
+
 class file_data_source_impl : public data_source_impl {
     struct issued_read {
         uint64_t _pos;
@@ -82,6 +144,7 @@ class file_data_source_impl : public data_source_impl {
     size_t _current_buffer_size;
     bool _in_slow_start = false;
     io_intent _intent;
+    std::optional<internal::read_ahead_engine::clock_type::time_point> _last_get;
     using unused_ratio_target = std::ratio<25, 100>;
 private:
     size_t minimal_buffer_size() const {
@@ -91,7 +154,10 @@ class file_data_source_impl : public data_source_impl {
     void try_increase_read_ahead() {
         // Read-ahead can be increased up to user-specified limit if the
         // consumer has to wait for a buffer and we are not in a slow start
-        // phase.
+        // phase. More reads won't make a backlogged disk any faster though.
+        if (_options.dynamic_adjustments && _options.dynamic_adjustments->engine.backlogged()) {
+            return;
+        }
         if (_current_read_ahead < _options.read_ahead && !_in_slow_start) {
             _current_read_ahead++;
             if (_options.dynamic_adjustments) {
@@ -100,10 +166,34 @@ class file_data_source_impl : public data_source_impl {
             }
         }
     }
+    // The consumer is behind if it hasn't taken buffers that are already
+    // read. Give back read-ahead it doesn't need at its current pace.
+    void try_decrease_read_ahead() {
+        if (!_options.dynamic_adjustments || _read_buffers.size() < 2 || !_read_buffers[1]._ready.available()) {
+            return;
+        }
+        auto& h = *_options.dynamic_adjustments;
+        auto wanted = h.engine.wanted_read_ahead(_current_buffer_size);
+        if (wanted && _current_read_ahead > wanted) {
+            _current_read_ahead--;
+            h.read_ahead = std::min(h.read_ahead, std::max(_current_read_ahead, 1u));
+        }
+    }
     unsigned get_initial_read_ahead() const {
-        return _options.dynamic_adjustments
-               ? std::min(_options.dynamic_adjustments->read_ahead, _options.read_ahead)
-               : !!_options.read_ahead;
+        if (!_options.dynamic_adjustments) {
+            return !!_options.read_ahead;
+        }
+        auto& h = *_options.dynamic_adjustments;
+        switch (h.engine.pattern()) {
+        case internal::read_ahead_engine::access_pattern::sequential:
+        case internal::read_ahead_engine::access_pattern::strided:
+        case internal::read_ahead_engine::access_pattern::reverse:
+            // Streams of this file are read through, no need to wait for
+            // this one to ask for more
+            return std::min(std::max(h.read_ahead, h.engine.wanted_read_ahead(_options.buffer_size)), _options.read_ahead);
+        default:
+            return std::min(h.read_ahead, _options.read_ahead);
+        }
     }
 
     void update_history(uint64_t unused, uint64_t total) {
@@ -191,9 +281,13 @@ class file_data_source_impl : public data_source_impl {
     }
 public:
     file_data_source_impl(file f, uint64_t offset, uint64_t len, file_input_stream_options options)
-            : _file(std::move(f)), _options(options), _pos(offset), _remain(len), _current_read_ahead(get_initial_read_ahead())
+            : _file(std::move(f)), _options(options), _pos(offset), _remain(len)
     {
         _options.buffer_size = select_buffer_size(_options.buffer_size, _file.disk_read_max_length());
+        if (_options.dynamic_adjustments) {
+            _options.dynamic_adjustments->engine.on_stream_start(offset);
+        }
+        _current_read_ahead = get_initial_read_ahead();
         _current_buffer_size = _options.buffer_size;
         // prevent wraparounds
         set_new_buffer_size(after_skip::no);
@@ -207,11 +301,20 @@ class file_data_source_impl : public data_source_impl {
     virtual future<temporary_buffer<char>> get() override {
         if (!_read_buffers.empty() && !_read_buffers.front()._ready.available()) {
             try_increase_read_ahead();
+        } else {
+            try_decrease_read_ahead();
         }
         issue_read_aheads(1);
         auto ret = std::move(_read_buffers.front());
         _read_buffers.pop_front();
         update_history_consumed(ret._size);
+        if (_options.dynamic_adjustments) {
+            auto now = internal::read_ahead_engine::clock_type::now();
+            if (_last_get) {
+                _options.dynamic_adjustments->engine.on_consumed(ret._size, now - *_last_get);
+            }
+            _last_get = now;
+        }
         _reactor._io_stats.fstream_reads += 1;
         _reactor._io_stats.fstream_read_bytes += ret._size;
         if (!ret._ready.available()) {
@@ -251,6 +354,9 @@ class file_data_source_impl : public data_source_impl {
         return make_ready_future<temporary_buffer<char>>();
     }
     virtual future<> close() override {
+        if (_options.dynamic_adjustments) {
+            _options.dynamic_adjustments->engine.on_stream_end(_read_buffers.empty() ? _pos : _read_buffers.front()._pos);
+        }
         _done.emplace();
         if (!_reads_in_progress) {
             _done->set_value();
@@ -265,6 +371,12 @@ class file_data_source_impl : public data_source_impl {
                 ignore_read_future(std::move(c._ready));
             }
             update_history_unused(dropped);
+            if (dropped && _options.dynamic_adjustments) {
+                // Closed before the read-ahead got used, the next streams
+                // shouldn't start with as much
+                auto& h = *_options.dynamic_adjustments;
+                h.read_ahead = std::max(h.read_ahead / 2, 1u);
+            }
             return std::move(_dropped_reads);
         });
     }
@@ -291,11 +403,15 @@ class file_data_source_impl : public data_source_impl {
             auto end = std::min(align_up(start + _current_buffer_size, align), _pos + _remain);
             auto len = end - start;
             auto actual_size = std::min(end - _pos, _remain);
+            auto issued = internal::read_ahead_engine::clock_type::now();
             _read_buffers.emplace_back(_pos, actual_size, futurize_invoke([&] {
                     return _file.dma_read_bulk<char>(start, len, _options.io_priority_class, &_intent);
             }).then_wrapped(
-                    [this, start, pos = _pos, remain = _remain] (future<temporary_buffer<char>> ret) {
+                    [this, start, pos = _pos, remain = _remain, issued] (future<temporary_buffer<char>> ret) {
                 --_reads_in_progress;
+                if (_options.dynamic_adjustments && !ret.failed()) {
+                    _options.dynamic_adjustments->engine.on_read(internal::read_ahead_engine::clock_type::now() - issued);
+                }
                 if (_done && !_reads_in_progress) {
                     _done->set_value();
                 }
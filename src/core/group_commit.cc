@@ -0,0 +1,263 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <seastar/core/group_commit.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/loop.hh>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+namespace seastar {
+
+// Weight of a new sample in the moving averages
+static constexpr double smoothing = 0.125;
+
+group_commit_writer::group_commit_writer(file f, group_commit_options options, uint64_t pos)
+        : _file(std::move(f))
+        , _options(options)
+        , _alignment(_file.disk_write_dma_alignment())
+        , _pos(pos)
+{
+    if (pos & (_alignment - 1)) {
+        throw std::invalid_argument("group_commit_writer position must be aligned");
+    }
+    _options.max_batch_size = align_up(std::max(_options.max_batch_size, _alignment), _alignment);
+}
+
+group_commit_writer::~group_commit_writer() {
+    assert(!_committing);
+}
+
+future<uint64_t> group_commit_writer::append(std::string_view data) noexcept {
+    if (_failure) {
+        return make_exception_future<uint64_t>(_failure);
+    }
+    if (_closing) {
+        return make_exception_future<uint64_t>(std::logic_error("append to a closed group_commit_writer"));
+    }
+    auto pos = _pos;
+    if (data.empty()) {
+        return flush().then([pos] {
+            return pos;
+        });
+    }
+  try {
+    auto& b = batch_for(data.size());
+    std::copy_n(data.data(), data.size(), b.buf.get_write() + b.len);
+    b.len += data.size();
+    b.appended += data.size();
+    _pos += data.size();
+    _appended_since_commit += data.size();
+    _stats.appends++;
+    _stats.bytes += data.size();
+    auto f = b.durable.get_shared_future();
+    if (batch_ready()) {
+        _batch_ready.signal();
+    }
+    start_committer();
+    return f.then([pos] {
+        return pos;
+    });
+  } catch (...) {
+    return current_exception_as_future<uint64_t>();
+  }
+}
+
+group_commit_writer::batch& group_commit_writer::batch_for(size_t len) {
+    if (_open && _open->len + len > _open->buf.size()) {
+        seal();
+    }
+    if (!_open) {
+        auto b = std::make_unique<batch>();
+        auto tail = _tail.size();
+        b->buf = temporary_buffer<char>::aligned(_file.memory_dma_alignment(),
+                align_up(std::max(_options.max_batch_size, tail + len), _alignment));
+        std::copy_n(_tail.get(), tail, b->buf.get_write());
+        b->pos = _pos - tail;
+        b->len = tail;
+        _open = std::move(b);
+    }
+    return *_open;
+}
+
+void group_commit_writer::seal() {
+    auto& b = *_open;
+    auto aligned = align_down(b.len, _alignment);
+    _tail = temporary_buffer<char>(b.buf.get() + aligned, b.len - aligned);
+    _sealed.push_back(std::move(_open));
+}
+
+bool group_commit_writer::batch_ready() const noexcept {
+    return !_sealed.empty() || _closing || _urgent || (_open && _open->appended >= _stats.target_batch_size);
+}
+
+void group_commit_writer::start_committer() {
+    if (_committing) {
+        return;
+    }
+    _committing = true;
+    _committer = _committer.then([this] {
+        return commit_loop();
+    });
+}
+
+future<> group_commit_writer::commit_loop() {
+    return repeat([this] {
+        if (_sealed.empty() && !_open) {
+            _committing = false;
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        return hold_batch().then([this] {
+            if (_sealed.empty()) {
+                if (!_open) {
+                    // Failed while holding
+                    return make_ready_future<stop_iteration>(stop_iteration::no);
+                }
+                seal();
+            }
+            _urgent = _urgent && _open;
+            auto b = std::move(_sealed.front());
+            _sealed.pop_front();
+            return commit(std::move(b)).then([] {
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
+future<> group_commit_writer::hold_batch() noexcept {
+    auto delay = std::min<clock_type::duration>(_options.max_delay, _stats.commit_latency / 2);
+    if (batch_ready() || delay <= clock_type::duration::zero()) {
+        return make_ready_future<>();
+    }
+    return _batch_ready.wait(delay, [this] {
+        return batch_ready();
+    }).handle_exception_type([] (const condition_variable_timed_out&) {});
+}
+
+future<> group_commit_writer::commit(std::unique_ptr<batch> b) {
+    auto start = clock_type::now();
+    if (_last_commit_start) {
+        auto elapsed = std::chrono::duration<double>(start - *_last_commit_start).count();
+        if (elapsed > 0) {
+            auto rate = _appended_since_commit / elapsed;
+            _append_rate = _append_rate ? _append_rate + smoothing * (rate - _append_rate) : rate;
+        }
+    }
+    _last_commit_start = start;
+    _appended_since_commit = 0;
+
+    // The padding up to the alignment is overwritten by the next batch,
+    // or truncated away on close
+    auto len = align_up(b->len, _alignment);
+    std::fill(b->buf.get_write() + b->len, b->buf.get_write() + len, 0);
+    _inflight = b.get();
+    auto& ref = *b;
+    return write(ref.pos, ref.buf.get(), len).then([this] {
+        return _file.flush();
+    }).then_wrapped([this, b = std::move(b), start] (future<> f) {
+        _inflight = nullptr;
+        if (f.failed()) {
+            auto ex = f.get_exception();
+            b->durable.set_exception(ex);
+            fail(std::move(ex));
+            return;
+        }
+        _stats.batches++;
+        update_estimates(clock_type::now() - start);
+        b->durable.set_value();
+    });
+}
+
+future<> group_commit_writer::write(uint64_t pos, const char* buf, size_t len) {
+    return _file.dma_write(pos, buf, len, _options.io_priority_class).then([this, pos, buf, len] (size_t written) {
+        if (written == 0) {
+            // Nothing was written, and retrying would get nowhere
+            return make_exception_future<>(std::system_error(EIO, std::system_category(), "group_commit_writer: short write"));
+        }
+        if (written < len) {
+            return write(pos + written, buf + written, len - written);
+        }
+        return make_ready_future<>();
+    });
+}
+
+void group_commit_writer::update_estimates(clock_type::duration latency) noexcept {
+    auto& avg = _stats.commit_latency;
+    if (avg == clock_type::duration::zero()) {
+        avg = latency;
+    } else {
+        avg += std::chrono::duration_cast<clock_type::duration>((latency - avg) * smoothing);
+    }
+    // Hold batches until they carry what arrives during a commit
+    auto target = _append_rate * std::chrono::duration<double>(avg).count();
+    _stats.target_batch_size = std::min<double>(target, _options.max_batch_size);
+}
+
+void group_commit_writer::fail(std::exception_ptr ex) noexcept {
+    _failure = ex;
+    for (auto& b : _sealed) {
+        b->durable.set_exception(ex);
+    }
+    _sealed.clear();
+    if (_open) {
+        _open->durable.set_exception(ex);
+        _open.reset();
+    }
+    _tail = {};
+}
+
+future<> group_commit_writer::flush() noexcept {
+    if (_failure) {
+        return make_exception_future<>(_failure);
+    }
+    if (_open) {
+        _urgent = true;
+        _batch_ready.signal();
+        return _open->durable.get_shared_future();
+    }
+    if (!_sealed.empty()) {
+        return _sealed.back()->durable.get_shared_future();
+    }
+    if (_inflight) {
+        return _inflight->durable.get_shared_future();
+    }
+    return make_ready_future<>();
+}
+
+future<> group_commit_writer::close() noexcept {
+    _closing = true;
+    _batch_ready.signal();
+    return flush().then_wrapped([this] (future<> f) {
+        f.ignore_ready_future();
+        return std::exchange(_committer, make_ready_future<>());
+    }).then([this] {
+        if (_failure) {
+            return make_exception_future<>(_failure);
+        }
+        if (_pos & (_alignment - 1)) {
+            return _file.truncate(_pos);
+        }
+        return make_ready_future<>();
+    }).finally([this] {
+        return _file.close();
+    });
+}
+
+}
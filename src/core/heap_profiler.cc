@@ -0,0 +1,136 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <seastar/core/heap_profiler.hh>
+#include <seastar/core/map_reduce.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/http/function_handlers.hh>
+#include <boost/lexical_cast.hpp>
+#include <boost/range/irange.hpp>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace seastar {
+
+namespace heap_profiler {
+
+using sites_type = std::vector<memory::sampled_allocation_site>;
+
+future<sites_type> collect(unsigned shard) {
+    return smp::submit_to(shard, [] {
+        return memory::sampled_heap_profile();
+    });
+}
+
+future<sites_type> collect() {
+    using merged_type = std::map<std::vector<uintptr_t>, memory::sampled_allocation_site>;
+    return map_reduce(boost::irange(0u, smp::count), [] (unsigned shard) {
+        return collect(shard);
+    }, merged_type(), [] (merged_type merged, sites_type sites) {
+        for (auto& site : sites) {
+            auto& m = merged[site.backtrace];
+            m.live_objects += site.live_objects;
+            m.live_bytes += site.live_bytes;
+            m.allocated_objects += site.allocated_objects;
+            m.allocated_bytes += site.allocated_bytes;
+        }
+        return merged;
+    }).then([] (merged_type merged) {
+        sites_type ret;
+        ret.reserve(merged.size());
+        for (auto& [backtrace, site] : merged) {
+            site.backtrace = backtrace;
+            ret.push_back(std::move(site));
+        }
+        return ret;
+    });
+}
+
+// One "<objects>: <bytes> [<objects>: <bytes>]" record, the estimates
+// rounded to whole numbers
+static void write_counts(std::ostream& os, double live_objects, double live_bytes, double allocated_objects, double allocated_bytes) {
+    auto round = [] (double v) { return uint64_t(std::max(v, 0.0) + 0.5); };
+    os << round(live_objects) << ": " << round(live_bytes)
+       << " [" << round(allocated_objects) << ": " << round(allocated_bytes) << "]";
+}
+
+void write_pprof(std::ostream& os, const sites_type& sites) {
+    memory::sampled_allocation_site total;
+    for (auto& site : sites) {
+        total.live_objects += site.live_objects;
+        total.live_bytes += site.live_bytes;
+        total.allocated_objects += site.allocated_objects;
+        total.allocated_bytes += site.allocated_bytes;
+    }
+    // The counts are estimates of all allocations already, so the profile
+    // claims a sampling period of 1 and pprof doesn't scale them again
+    os << "heap profile: ";
+    write_counts(os, total.live_objects, total.live_bytes, total.allocated_objects, total.allocated_bytes);
+    os << " @ heapprofile\n";
+    for (auto& site : sites) {
+        write_counts(os, site.live_objects, site.live_bytes, site.allocated_objects, site.allocated_bytes);
+        os << " @";
+        for (auto pc : site.backtrace) {
+            os << " 0x" << std::hex << pc << std::dec;
+        }
+        os << "\n";
+    }
+    os << "\nMAPPED_LIBRARIES:\n";
+    std::ifstream maps("/proc/self/maps");
+    os << maps.rdbuf();
+}
+
+static future<std::unique_ptr<http::reply>> handle_heap_profile(std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+    auto profile = futurize_invoke([shard = req->get_query_param("shard")] {
+        if (shard.empty()) {
+            return collect();
+        }
+        unsigned id;
+        try {
+            id = boost::lexical_cast<unsigned>(shard);
+        } catch (const boost::bad_lexical_cast&) {
+            throw httpd::bad_param_exception("shard must be a number");
+        }
+        if (id >= smp::count) {
+            throw httpd::bad_param_exception("shard out of range");
+        }
+        return collect(id);
+    });
+    return profile.then([rep = std::move(rep)] (sites_type sites) mutable {
+        std::ostringstream os;
+        write_pprof(os, sites);
+        rep->_content = os.str();
+        return std::move(rep);
+    });
+}
+
+future<> add_heap_profile_routes(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new httpd::function_handler(handle_heap_profile, "txt"));
+    return make_ready_future<>();
+}
+
+future<> add_heap_profile_routes(distributed<httpd::http_server>& server, sstring path) {
+    return server.invoke_on_all([path] (httpd::http_server& s) {
+        return add_heap_profile_routes(s, path);
+    });
+}
+
+}
+}
@@ -26,10 +26,13 @@
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/io_intent.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/timed_out_error.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/linux-aio.hh>
 #include <seastar/core/internal/io_desc.hh>
+#include <seastar/core/internal/io_rate_controller.hh>
+#include <seastar/core/internal/latency_histogram.hh>
 #include <seastar/core/internal/io_sink.hh>
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/util/log.hh>
@@ -95,9 +98,13 @@ class io_queue::priority_class_data {
             ops++;
             bytes += len;
         }
-    } _rwstat[2] = {}, _splits = {};
+    } _rwstat[2] = {}, _splits = {}, _merges = {};
+    // Per direction time spent in the queue and in the disk
+    internal::latency_histogram _queue_latency[2];
+    internal::latency_histogram _disk_latency[2];
     uint32_t _nr_queued;
     uint32_t _nr_executing;
+    uint64_t _nr_expired = 0;
     std::chrono::duration<double> _queue_time;
     std::chrono::duration<double> _total_queue_time;
     std::chrono::duration<double> _total_execution_time;
@@ -154,6 +161,7 @@ class io_queue::priority_class_data {
 
     void on_dispatch(io_direction_and_length dnl, std::chrono::duration<double> lat) noexcept {
         _rwstat[dnl.rw_idx()].add(dnl.length());
+        _queue_latency[dnl.rw_idx()].add(lat);
         _queue_time = lat;
         _total_queue_time += lat;
         _nr_queued--;
@@ -176,7 +184,13 @@ class io_queue::priority_class_data {
         _nr_queued--;
     }
 
-    void on_complete(std::chrono::duration<double> lat) noexcept {
+    void on_expire() noexcept {
+        _nr_queued--;
+        _nr_expired++;
+    }
+
+    void on_complete(io_direction_and_length dnl, std::chrono::duration<double> lat) noexcept {
+        _disk_latency[dnl.rw_idx()].add(lat);
         _total_execution_time += lat;
         _nr_executing--;
         if (_nr_executing == 0 && _nr_queued != 0) {
@@ -195,6 +209,10 @@ class io_queue::priority_class_data {
         _splits.add(dnl.length());
     }
 
+    void on_merge(size_t len) noexcept {
+        _merges.add(len);
+    }
+
     fair_queue::class_id fq_class() const noexcept { return _pc.id(); }
 
     std::vector<seastar::metrics::impl::metric_definition_impl> metrics();
@@ -206,10 +224,19 @@ class io_desc_read_write final : public io_completion {
     io_queue::priority_class_data& _pclass;
     io_queue::clock_type::time_point _ts;
     const stream_id _stream;
-    const io_direction_and_length _dnl;
-    const fair_queue_ticket _fq_ticket;
+    io_direction_and_length _dnl;
+    fair_queue_ticket _fq_ticket;
     promise<size_t> _pr;
     iovec_keeper _iovs;
+    // Length of the request itself, without the reads merged into it
+    const size_t _length;
+
+    struct merged_read {
+        size_t offset;
+        size_t length;
+        promise<size_t> pr;
+    };
+    std::vector<merged_read> _merged;
 
 public:
     io_desc_read_write(io_queue& ioq, io_queue::priority_class_data& pc, stream_id stream, io_direction_and_length dnl, fair_queue_ticket ticket, iovec_keeper iovs)
@@ -220,6 +247,7 @@ class io_desc_read_write final : public io_completion {
         , _dnl(dnl)
         , _fq_ticket(ticket)
         , _iovs(std::move(iovs))
+        , _length(dnl.length())
     {
         io_log.trace("dev {} : req {} queue  len {} ticket {}", _ioq.dev_id(), fmt::ptr(this), _dnl.length(), _fq_ticket);
     }
@@ -228,6 +256,9 @@ class io_desc_read_write final : public io_completion {
         io_log.trace("dev {} : req {} error", _ioq.dev_id(), fmt::ptr(this));
         _pclass.on_error();
         _ioq.complete_request(*this);
+        for (auto& m : _merged) {
+            m.pr.set_exception(eptr);
+        }
         _pr.set_exception(eptr);
         delete this;
     }
@@ -235,9 +266,15 @@ class io_desc_read_write final : public io_completion {
     virtual void complete(size_t res) noexcept override {
         io_log.trace("dev {} : req {} complete", _ioq.dev_id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
-        _pclass.on_complete(std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
+        auto lat = std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts);
+        _pclass.on_complete(_dnl, lat);
+        _ioq.account_latency(lat);
         _ioq.complete_request(*this);
-        _pr.set_value(res);
+        // Every merged read gets what was read into its part of the range
+        for (auto& m : _merged) {
+            m.pr.set_value(res > m.offset ? std::min(res - m.offset, m.length) : 0);
+        }
+        _pr.set_value(_merged.empty() ? res : std::min(res, _length));
         delete this;
     }
 
@@ -247,6 +284,12 @@ class io_desc_read_write final : public io_completion {
         delete this;
     }
 
+    void expire() noexcept {
+        _pclass.on_expire();
+        _pr.set_exception(std::make_exception_ptr(timed_out_error()));
+        delete this;
+    }
+
     void dispatch() noexcept {
         io_log.trace("dev {} : req {} submit", _ioq.dev_id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
@@ -258,8 +301,22 @@ class io_desc_read_write final : public io_completion {
         return _pr.get_future();
     }
 
+    // Extends the request by a read of the given length at the given offset
+    // from its start. The returned future resolves with the part of the
+    // result that falls into the added range.
+    future<size_t> add_merged(size_t offset, size_t length, fair_queue_ticket ticket) {
+        _merged.push_back(merged_read{offset, length, {}});
+        auto fut = _merged.back().pr.get_future();
+        _dnl = io_direction_and_length(_dnl.rw_idx(), offset + length);
+        _fq_ticket = ticket;
+        return fut;
+    }
+
     fair_queue_ticket ticket() const noexcept { return _fq_ticket; }
     stream_id stream() const noexcept { return _stream; }
+    size_t length() const noexcept { return _dnl.length(); }
+    size_t nr_merged() const noexcept { return _merged.size(); }
+    iovec_keeper& iovs() noexcept { return _iovs; }
 };
 
 class queued_io_request : private internal::io_request {
@@ -268,6 +325,8 @@ class queued_io_request : private internal::io_request {
     fair_queue_entry _fq_entry;
     internal::cancellable_queue::link _intent;
     std::unique_ptr<io_desc_read_write> _desc;
+    // Set while later reads may be merged into this one
+    std::optional<io_queue::merge_key> _merge_key;
 
     bool is_cancelled() const noexcept { return !_desc; }
 
@@ -291,6 +350,9 @@ class queued_io_request : private internal::io_request {
         }
 
         _intent.maybe_dequeue();
+        if (_merge_key) {
+            _ioq.forget_merge_target(*_merge_key);
+        }
         _desc->dispatch();
         _ioq.submit_request(_desc.release(), std::move(*this));
         delete this;
@@ -301,10 +363,56 @@ class queued_io_request : private internal::io_request {
         _desc.release()->cancel();
     }
 
+    // The deadline passed before the request could be dispatched
+    void expire() noexcept {
+        if (!is_cancelled()) {
+            _intent.maybe_dequeue();
+            _ioq.expire_request();
+            _desc.release()->expire();
+        }
+        delete this;
+    }
+
     void set_intent(internal::cancellable_queue& cq) noexcept {
         _intent.enqueue(cq);
     }
 
+    // Both this request and the merged read must be plain or merged reads
+    // of the same file, the merged one starting gap bytes past this end.
+    // The request turns into a vectored read, with the gap read into
+    // gap_buffer and dropped.
+    future<size_t> merge_read(const io_request& req, size_t gap, char* gap_buffer, const io_queue::config& cfg) {
+        const auto& op = req.as<operation::read>();
+        auto& iovs = _desc->iovs();
+        if (opcode() == operation::read && iovs.empty()) {
+            const auto& own = as<operation::read>();
+            iovs.push_back(::iovec{own.addr, own.size});
+        }
+        iovs.reserve(iovs.size() + 2);
+        auto offset = _desc->length() + gap;
+        auto ticket = make_ticket(io_direction_and_length(io_direction_read, offset + op.size), cfg);
+        auto fut = _desc->add_merged(offset, op.size, ticket);
+
+        if (gap) {
+            iovs.push_back(::iovec{gap_buffer, gap});
+        }
+        iovs.push_back(::iovec{op.addr, op.size});
+        auto fd = op.fd;
+        auto pos = opcode() == operation::read ? as<operation::read>().pos : as<operation::readv>().pos;
+        auto nowait_works = opcode() == operation::read ? as<operation::read>().nowait_works : as<operation::readv>().nowait_works;
+        static_cast<io_request&>(*this) = io_request::make_readv(fd, pos, iovs, nowait_works);
+        return fut;
+    }
+
+    void set_merge_key(io_queue::merge_key key) noexcept {
+        _merge_key = key;
+    }
+
+    std::optional<io_queue::merge_key>& merge_key() noexcept { return _merge_key; }
+    size_t length() const noexcept { return _desc->length(); }
+    size_t nr_merged() const noexcept { return _desc->nr_merged(); }
+    fair_queue_ticket ticket() const noexcept { return _desc->ticket(); }
+
     future<size_t> get_future() noexcept { return _desc->get_future(); }
     fair_queue_entry& queue_entry() noexcept { return _fq_entry; }
     stream_id stream() const noexcept { return _stream; }
@@ -471,6 +579,8 @@ sstring io_request::opname() const {
     switch (_op) {
     case io_request::operation::fdatasync:
         return "fdatasync";
+    case io_request::operation::write_fdatasync:
+        return "write and fdatasync";
     case io_request::operation::write:
         return "write";
     case io_request::operation::writev:
@@ -509,6 +619,102 @@ io_queue::complete_request(io_desc_read_write& desc) noexcept {
     _streams[desc.stream()].notify_request_finished(desc.ticket());
 }
 
+namespace internal {
+
+io_rate_controller::io_rate_controller(config cfg) noexcept
+        : _config(cfg)
+        , _scale(cfg.max_scale)
+{
+}
+
+double io_rate_controller::update(uint64_t nr, std::chrono::duration<double> total) noexcept {
+    if (nr == 0) {
+        return _scale;
+    }
+    auto mean = total / nr;
+    if (mean > _config.latency_target) {
+        _scale *= std::max(0.5, _config.latency_target / mean);
+    } else {
+        _scale += increase_step * (_config.max_scale - _config.min_scale);
+    }
+    _scale = std::clamp(_scale, _config.min_scale, _config.max_scale);
+    return _scale;
+}
+
+std::chrono::milliseconds io_rate_controller::period() const noexcept {
+    // Long enough for the disk to react to the previous change
+    return std::max(std::chrono::milliseconds(20), std::chrono::duration_cast<std::chrono::milliseconds>(10 * _config.latency_target));
+}
+
+metrics::histogram latency_histogram::to_metrics() const {
+    metrics::histogram h;
+    h.sample_count = _count;
+    h.sample_sum = _sum.count();
+    // The last bucket is open-ended and only shows up as +Inf
+    h.buckets.resize(nr_buckets - 1);
+    uint64_t total = 0;
+    for (unsigned b = 0; b < nr_buckets - 1; b++) {
+        total += _buckets[b];
+        h.buckets[b].count = total;
+        h.buckets[b].upper_bound = bucket_limit(b) * 1e-6;
+    }
+    return h;
+}
+
+} // internal namespace
+
+void io_queue::account_latency(std::chrono::duration<double> lat) noexcept {
+    if (!_group->_rate_controller) {
+        return;
+    }
+    _unreported_latency += lat;
+    // The group counters are shared, so don't touch them on every completion
+    if (++_unreported_completions >= 16) {
+        report_latency();
+    }
+}
+
+void io_queue::report_latency() noexcept {
+    _group->_completions.fetch_add(std::exchange(_unreported_completions, 0), std::memory_order_relaxed);
+    auto usec = std::chrono::duration_cast<std::chrono::microseconds>(std::exchange(_unreported_latency, {}));
+    _group->_completion_usec.fetch_add(usec.count(), std::memory_order_relaxed);
+}
+
+void io_queue::start_rate_controller() {
+    _rate_controller_timer.set_callback([this] {
+        report_latency();
+        _group->update_rate();
+    });
+    _rate_controller_timer.arm_periodic(_group->_rate_controller->period());
+
+    namespace sm = seastar::metrics;
+    auto mnt_l = sm::label("mountpoint")(mountpoint());
+    _rate_controller_metrics.add_group("io_queue", {
+        sm::make_gauge("rate_scale", [this] {
+            return _group->_rate_controller->scale();
+        }, sm::description("Fraction of the configured disk rates the I/O group dispatches requests at"), {mnt_l}),
+        sm::make_gauge("effective_request_rate", [this] {
+            return _group->_rate_controller->scale() * get_config().req_count_rate / read_request_base_count;
+        }, sm::description("Read requests per second the I/O group dispatches"), {mnt_l}),
+        sm::make_gauge("effective_bandwidth", [this] {
+            return _group->_rate_controller->scale() * (get_config().blocks_count_rate << block_size_shift) / read_request_base_count;
+        }, sm::description("Read bytes per second the I/O group dispatches"), {mnt_l}),
+    });
+}
+
+void io_group::update_rate() noexcept {
+    auto nr = _completions.exchange(0, std::memory_order_relaxed);
+    auto usec = _completion_usec.exchange(0, std::memory_order_relaxed);
+    auto prev = _rate_controller->scale();
+    auto scale = _rate_controller->update(nr, std::chrono::microseconds(usec));
+    if (scale != prev) {
+        io_log.debug("dev {}: mean latency {}us over {} requests, scaling rate to {:.3f}", _config.devid, nr ? usec / nr : 0, nr, scale);
+        for (auto& fg : _fgs) {
+            fg->scale_rate(scale);
+        }
+    }
+}
+
 fair_queue::config io_queue::make_fair_queue_config(const config& iocfg, sstring label) {
     fair_queue::config cfg;
     cfg.label = label;
@@ -547,6 +753,10 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
         }
         seastar_logger.info("Created io queue dev({}) capacities:{}", get_config().devid, caps_str);
     }
+
+    if (_group->_rate_controller && _group->_allocated_on == this_shard_id()) {
+        start_rate_controller();
+    }
 }
 
 fair_group::config io_group::make_fair_group_config(const io_queue::config& qcfg) noexcept {
@@ -560,6 +770,7 @@ fair_group::config io_group::make_fair_group_config(const io_queue::config& qcfg
     cfg.size_rate = qcfg.blocks_count_rate;
     cfg.rate_factor = qcfg.rate_factor;
     cfg.rate_limit_duration = qcfg.rate_limit_duration;
+    cfg.capacity_borrowing = qcfg.capacity_borrowing;
     return cfg;
 }
 
@@ -608,6 +819,14 @@ io_group::io_group(io_queue::config io_cfg)
     update_max_size(io_direction_write);
     update_max_size(io_direction_read);
 
+    if (_config.latency_target.count() > 0) {
+        _rate_controller = std::make_unique<internal::io_rate_controller>(internal::io_rate_controller::config{
+            .latency_target = _config.latency_target,
+            .min_scale = _config.min_rate_scale,
+            .max_scale = _config.max_rate_scale,
+        });
+    }
+
     seastar_logger.info("Created io group dev({}), length limit {}:{}, rate {}:{}", _config.devid,
             _max_request_length[io_direction_read],
             _max_request_length[io_direction_write],
@@ -738,6 +957,12 @@ std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_c
                     sm::description("Total number of requests split")),
             sm::make_counter("total_split_bytes", _splits.bytes,
                     sm::description("Total number of bytes split")),
+            sm::make_counter("total_merged_ops", _merges.ops,
+                    sm::description("Total number of reads merged into other queued reads")),
+            sm::make_counter("total_merged_bytes", _merges.bytes,
+                    sm::description("Total number of bytes in reads merged into other queued reads")),
+            sm::make_counter("total_expired_ops", _nr_expired,
+                    sm::description("Total number of requests dropped from the queue because their deadline passed")),
             sm::make_counter("total_delay_sec", [this] {
                     return _total_queue_time.count();
                 }, sm::description("Total time spent in the queue")),
@@ -766,7 +991,20 @@ std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_c
             sm::make_gauge("delay", [this] {
                 return _queue_time.count();
             }, sm::description("random delay time in the queue")),
-            sm::make_gauge("shares", _shares, sm::description("current amount of shares"))
+            sm::make_gauge("shares", _shares, sm::description("current amount of shares")),
+
+            sm::make_histogram("read_queue_latency", sm::description("Time read requests spent in the queue (seconds)"), [this] {
+                return _queue_latency[io_direction_read].to_metrics();
+            }),
+            sm::make_histogram("write_queue_latency", sm::description("Time write requests spent in the queue (seconds)"), [this] {
+                return _queue_latency[io_direction_write].to_metrics();
+            }),
+            sm::make_histogram("read_disk_latency", sm::description("Time read requests spent in the disk (seconds)"), [this] {
+                return _disk_latency[io_direction_read].to_metrics();
+            }),
+            sm::make_histogram("write_disk_latency", sm::description("Time write requests spent in the disk (seconds)"), [this] {
+                return _disk_latency[io_direction_write].to_metrics();
+            }),
     });
 }
 
@@ -881,11 +1119,23 @@ future<size_t> io_queue::queue_one_request(const io_priority_class& pc, io_direc
         // First time will hit here, and then we create the class. It is important
         // that we create the shared pointer in the same shard it will be used at later.
         auto& pclass = find_or_create_class(pc);
+        std::optional<merge_key> key;
+        if (get_config().merge_reads && intent == nullptr && req.opcode() == internal::io_request::operation::read) {
+            if (auto fut = try_merge_read(pclass, req)) {
+                return std::move(*fut);
+            }
+            const auto& op = req.as<internal::io_request::operation::read>();
+            key.emplace(op.fd, pclass.fq_class(), op.pos + op.size);
+        }
         auto queued_req = std::make_unique<queued_io_request>(std::move(req), *this, pclass, std::move(dnl), std::move(iovs));
+        if (key && _merge_targets.emplace(*key, queued_req.get()).second) {
+            queued_req->set_merge_key(*key);
+        }
         auto fut = queued_req->get_future();
         if (intent != nullptr) {
             auto& cq = intent->find_or_create_cancellable_queue(dev_id(), pc.id());
             queued_req->set_intent(cq);
+            queued_req->queue_entry().set_deadline(intent->deadline());
         }
 
         _streams[queued_req->stream()].queue(pclass.fq_class(), queued_req->queue_entry());
@@ -896,6 +1146,49 @@ future<size_t> io_queue::queue_one_request(const io_priority_class& pc, io_direc
     });
 }
 
+// Reads without an intent may be merged into a queued read of the same
+// file and class that ends at most read_merge_gap bytes before they start,
+// as long as the result stays within the request size limits. The merged
+// request is charged to the fair queue as one.
+std::optional<future<size_t>> io_queue::try_merge_read(priority_class_data& pclass, const internal::io_request& req) {
+    static constexpr unsigned max_merged_reads = 16;
+    const auto& op = req.as<internal::io_request::operation::read>();
+    auto it = _merge_targets.upper_bound(merge_key(op.fd, pclass.fq_class(), op.pos));
+    if (it == _merge_targets.begin()) {
+        return std::nullopt;
+    }
+    --it;
+    auto [fd, cls, end] = it->first;
+    if (fd != op.fd || cls != pclass.fq_class() || op.pos - end > get_config().read_merge_gap) {
+        return std::nullopt;
+    }
+    auto& target = *it->second;
+    auto gap = op.pos - end;
+    if (target.length() + gap + op.size > get_request_limits().max_read || target.nr_merged() >= max_merged_reads) {
+        return std::nullopt;
+    }
+    if (gap && !_merge_gap_buffer) {
+        _merge_gap_buffer = allocate_aligned_buffer<char>(get_config().read_merge_gap, 4096);
+    }
+
+    auto fut = target.merge_read(req, gap, _merge_gap_buffer.get(), get_config());
+    _streams[target.stream()].update_request_ticket(target.queue_entry(), target.ticket());
+    auto node = _merge_targets.extract(it);
+    node.key() = merge_key(fd, cls, op.pos + op.size);
+    auto res = _merge_targets.insert(std::move(node));
+    if (res.inserted) {
+        target.set_merge_key(res.position->first);
+    } else {
+        target.merge_key().reset();
+    }
+    pclass.on_merge(op.size);
+    return fut;
+}
+
+void io_queue::forget_merge_target(const merge_key& key) noexcept {
+    _merge_targets.erase(key);
+}
+
 future<size_t> io_queue::queue_request(const io_priority_class& pc, io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
     size_t max_length = _group->_max_request_length[dnl.rw_idx()];
 
@@ -973,6 +1266,8 @@ void io_queue::poll_io_queue() {
     for (auto&& st : _streams) {
         st.dispatch_requests([] (fair_queue_entry& fqe) {
             queued_io_request::from_fq_entry(fqe).dispatch();
+        }, [] (fair_queue_entry& fqe) {
+            queued_io_request::from_fq_entry(fqe).expire();
         });
     }
 }
@@ -988,6 +1283,10 @@ void io_queue::cancel_request(queued_io_request& req) noexcept {
     _streams[req.stream()].notify_request_cancelled(req.queue_entry());
 }
 
+void io_queue::expire_request() noexcept {
+    _queued_requests--;
+}
+
 void io_queue::complete_cancelled_request(queued_io_request& req) noexcept {
     _streams[req.stream()].notify_request_finished(req.queue_entry().ticket());
 }
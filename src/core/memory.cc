@@ -62,6 +62,10 @@
 #include <seastar/core/aligned_buffer.hh>
 #include <unordered_set>
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <cmath>
+#include <execinfo.h>
 #include <thread>
 
 #include <dlfcn.h>
@@ -104,6 +108,27 @@ void enable_abort_on_allocation_failure() {
     set_abort_on_allocation_failure(true);
 }
 
+double small_pool_statistics::fragmentation() const noexcept {
+    auto held = pages * page_size;
+    return held ? double(held - live_objects * object_size) / held : 0;
+}
+
+double size_class_statistics::free_memory_fragmentation() const noexcept {
+    size_t free_pages = 0;
+    size_t largest = 0;
+    for (auto& s : spans) {
+        free_pages += s.free_pages;
+        if (s.free_spans) {
+            largest = size_t(1) << s.order;
+        }
+    }
+    return free_pages ? 1 - double(std::min(largest, free_pages)) / free_pages : 0;
+}
+
+double huge_page_statistics::huge_page_backed_fraction() const noexcept {
+    return regions ? double(huge_page_backed_memory) / (regions * huge_page_size) : 0;
+}
+
 static std::pmr::polymorphic_allocator<char> static_malloc_allocator{std::pmr::get_default_resource()};;
 std::pmr::polymorphic_allocator<char>* malloc_allocator{&static_malloc_allocator};
 
@@ -224,7 +249,7 @@ static thread_local bool is_reactor_thread = false;
 
 namespace alloc_stats {
 
-enum class types { allocs, frees, cross_cpu_frees, reclaims, large_allocs, failed_allocs,
+enum class types { allocs, frees, cross_cpu_frees, cross_cpu_free_batches, reclaims, large_allocs, failed_allocs,
     foreign_mallocs, foreign_frees, foreign_cross_frees, enum_size };
 
 using stats_array = std::array<uint64_t, static_cast<std::size_t>(types::enum_size)>;
@@ -295,7 +320,6 @@ class page_list_link {
     uint32_t _prev;
     uint32_t _next;
     friend class page_list;
-    friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
 };
 
 constexpr size_t mem_base_alloc = size_t(1) << 44;
@@ -342,7 +366,8 @@ struct free_object {
 };
 
 struct page {
-    bool free;
+    bool free : 1;
+    bool sampled : 1; // holds the start of an allocation sampled by heap_sampler
     uint8_t offset_in_span;
     uint16_t nr_small_alloc;
     uint32_t span_size; // in pages, if we're the head or the tail
@@ -392,7 +417,22 @@ class page_list {
         }
         _front = ary[_front].link._next;
     }
-    friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
+    template <typename Func>
+    void for_each(page* ary, Func func) const {
+        for (auto idx = _front; idx; idx = ary[idx].link._next) {
+            func(ary[idx]);
+        }
+    }
+    // Looks at the first max_pages pages of the list only
+    template <typename Pred>
+    page* find_if(page* ary, unsigned max_pages, Pred pred) const {
+        for (auto idx = _front; idx && max_pages; idx = ary[idx].link._next, --max_pages) {
+            if (pred(ary[idx])) {
+                return &ary[idx];
+            }
+        }
+        return nullptr;
+    }
 };
 
 class small_pool {
@@ -406,6 +446,9 @@ class small_pool {
     size_t _free_count = 0;
     unsigned _min_free;
     unsigned _max_free;
+    unsigned _default_max_free;
+    // Free list refills since the last compaction
+    unsigned _refills = 0;
     unsigned _pages_in_use = 0;
     page_list _span_list;
     static constexpr unsigned idx_frac_bits = 2;
@@ -419,10 +462,12 @@ class small_pool {
     static constexpr unsigned size_to_idx(unsigned size);
     static constexpr unsigned idx_to_size(unsigned idx);
     allocation_site_ptr& alloc_site_holder(void* ptr);
+    small_pool_statistics stats() const noexcept;
+    unsigned preferred_span_size() const noexcept { return _span_sizes.preferred; }
+    void compact();
 private:
     void add_more_objects();
-    void trim_free_list();
-    friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
+    void trim_free_list(size_t goal);
 };
 
 // index 0b0001'1100 -> size (1 << 4) + 0b11 << (4 - 2)
@@ -498,14 +543,119 @@ static_assert(object_size_with_alloc_site(max_small_allocation - sizeof(allocati
 static_assert(object_size_with_alloc_site(max_small_allocation - sizeof(allocation_site_ptr) - 2) == max_small_allocation - 2, "");
 #endif
 
+// Which allocations a span is for, see cpu_pages::find_and_unlink_span()
+enum class span_kind : uint8_t {
+    large,
+    small_pool,
+};
+
+static constexpr unsigned pages_per_huge_page = huge_page_size / page_size;
+
+// Allocated pages of a huge page sized region, by the kind of their spans
+struct huge_page_usage {
+    uint16_t large_pages = 0;
+    uint16_t small_pool_pages = 0;
+
+    uint16_t& of(span_kind kind) {
+        return kind == span_kind::large ? large_pages : small_pool_pages;
+    }
+};
+
+static_assert(pages_per_huge_page <= std::numeric_limits<uint16_t>::max());
+
+static size_t nr_huge_pages(size_t nr_pages) {
+    return align_up<size_t>(nr_pages, pages_per_huge_page) / pages_per_huge_page;
+}
+
+// The page array is followed by the sentinel page structure, and then by
+// the usage of the huge page sized regions
+static size_t page_array_size(size_t nr_pages) {
+    return sizeof(page) * (nr_pages + 1) + sizeof(huge_page_usage) * nr_huge_pages(nr_pages);
+}
+
+// The sampling heap profiler. Every allocated byte has the same chance,
+// 1 / rate, to be picked, so the distances between the picked bytes are
+// exponentially distributed and the allocation holding a picked byte is
+// sampled. A sample stands for 1 / (1 - exp(-size / rate)) allocations
+// of its size at its call site.
+struct heap_sampler {
+    static constexpr unsigned max_depth = 64;
+    // Frames of the sampler and of allocate()
+    static constexpr unsigned skipped_frames = 2;
+
+    struct site_key {
+        std::array<uintptr_t, max_depth> pcs;
+        unsigned depth = 0;
+        size_t hash = 0;
+
+        bool operator==(const site_key& o) const noexcept {
+            return hash == o.hash && std::equal(pcs.begin(), pcs.begin() + depth, o.pcs.begin(), o.pcs.begin() + o.depth);
+        }
+    };
+    struct site_key_hash {
+        size_t operator()(const site_key& k) const noexcept { return k.hash; }
+    };
+    struct site_totals {
+        double live_objects = 0;
+        double live_bytes = 0;
+        double allocated_objects = 0;
+        double allocated_bytes = 0;
+    };
+    using sites_type = std::unordered_map<site_key, site_totals, site_key_hash>;
+    struct sample {
+        sites_type::value_type* site;
+        double objects;
+        size_t size;
+    };
+
+    size_t rate = 0;
+    int64_t bytes_until_sample = std::numeric_limits<int64_t>::max();
+    uint64_t random_state = 0;
+    // Set while the sampler allocates or frees for itself
+    bool busy = false;
+    // Frees of sampled pages' objects while busy. The objects are kept
+    // until the sampler is done, then their samples are forgotten and they
+    // are freed, see cpu_pages::sampler_done().
+    free_object* deferred_frees = nullptr;
+    bool freeing_deferred = false;
+    sites_type sites;
+    // By address, so that a page keeps its mark while it holds samples
+    std::map<uintptr_t, sample> samples;
+
+    int64_t next_distance() noexcept {
+        if (!rate) {
+            return std::numeric_limits<int64_t>::max();
+        }
+        // xorshift64*
+        random_state ^= random_state >> 12;
+        random_state ^= random_state << 25;
+        random_state ^= random_state >> 27;
+        auto r = random_state * 0x2545f4914f6cdd1dull;
+        // Uniform in (0, 1]
+        auto u = ((r >> 11) + 1) * 0x1.0p-53;
+        return -std::log(u) * rate;
+    }
+};
+
 struct cross_cpu_free_item {
     cross_cpu_free_item* next;
 };
 
+// Objects freed by a reactor thread for one other cpu, pushed to the
+// cpu's xcpu_freelist together, with a single atomic operation
+struct cross_cpu_free_batch {
+    static constexpr unsigned max_size = 64;
+    cross_cpu_free_item* head = nullptr;
+    cross_cpu_free_item* tail = nullptr;
+    unsigned size = 0;
+    bool listed = false; // in cpu_pages::xcpu_batch_cpus
+};
+
 struct cpu_pages {
     uint32_t min_free_pages = 20000000 / page_size;
     char* memory;
     page* pages;
+    huge_page_usage* huge_pages;
     uint32_t nr_pages;
     uint32_t nr_free_pages;
     uint32_t current_min_free_pages = 0;
@@ -516,6 +666,11 @@ struct cpu_pages {
     static constexpr unsigned nr_span_lists = 32;
     page_list free_spans[nr_span_lists];  // contains aligned spans with span_size == 2^idx
     small_pool_array small_pools;
+    unsigned next_pool_to_compact = 0;
+    heap_sampler sampler;
+    cross_cpu_free_batch xcpu_batches[max_cpus];
+    unsigned xcpu_batch_cpus[max_cpus]; // cpus with a non-empty batch
+    unsigned nr_xcpu_batch_cpus = 0;
     alignas(seastar::cache_line_size) std::atomic<cross_cpu_free_item*> xcpu_freelist;
     static std::atomic<unsigned> cpu_id_gen;
     static cpu_pages* all_cpus[max_cpus];
@@ -537,12 +692,16 @@ struct cpu_pages {
         unsigned nr_pages;
     };
     void maybe_reclaim();
-    void* allocate_large_and_trim(unsigned nr_pages);
-    void* allocate_large(unsigned nr_pages);
+    void* allocate_large_and_trim(unsigned nr_pages, span_kind kind);
+    void* allocate_large(unsigned nr_pages, span_kind kind = span_kind::large);
     void* allocate_large_aligned(unsigned align_pages, unsigned nr_pages);
-    page* find_and_unlink_span(unsigned nr_pages);
-    page* find_and_unlink_span_reclaiming(unsigned n_pages);
+    page* find_and_unlink_span(unsigned nr_pages, span_kind kind);
+    page* find_and_unlink_span_reclaiming(unsigned n_pages, span_kind kind);
+    void account_huge_pages(pageidx start, uint32_t nr_pages, span_kind kind, bool allocated);
     void free_large(void* ptr);
+    void sample_allocation(void* ptr, size_t size) noexcept;
+    bool forget_sample(void* ptr, page* span) noexcept;
+    void sampler_done() noexcept;
     bool grow_span(pageidx& start, uint32_t& nr_pages, unsigned idx);
     void free_span(pageidx start, uint32_t nr_pages);
     void free_span_no_merge(pageidx start, uint32_t nr_pages);
@@ -553,8 +712,15 @@ struct cpu_pages {
     static bool try_foreign_free(void* ptr);
     void shrink(void* ptr, size_t new_size);
     static void free_cross_cpu(unsigned cpu_id, void* ptr);
+    static void push_cross_cpu(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail);
+    void flush_cross_cpu_batch(unsigned cpu_id);
+    bool flush_cross_cpu_batches();
     bool drain_cross_cpu_freelist();
+    bool compact_small_pools(bool (*should_stop)());
     size_t object_size(void* ptr);
+    // Fills one entry per span order, doesn't allocate
+    void span_stats(std::array<span_statistics, nr_span_lists>& out) const noexcept;
+    huge_page_statistics huge_page_stats() const noexcept;
     page* to_page(void* p) {
         return &pages[(reinterpret_cast<char*>(p) - mem()) / page_size];
     }
@@ -693,31 +859,70 @@ void cpu_pages::free_span_unaligned(uint32_t span_start, uint32_t nr_pages) {
     }
 }
 
+void cpu_pages::account_huge_pages(pageidx start, uint32_t n_pages, span_kind kind, bool allocated) {
+    while (n_pages) {
+        auto region = start / pages_per_huge_page;
+        auto now = std::min<uint32_t>(n_pages, (region + 1) * pages_per_huge_page - start);
+        auto& used = huge_pages[region].of(kind);
+        used = allocated ? used + now : used - now;
+        start += now;
+        n_pages -= now;
+    }
+}
+
+// Small pool spans live long and are scattered over memory, so when they
+// share huge page sized regions with large allocations, the kernel can
+// back few of the regions with transparent huge pages. Spans of each kind
+// are therefore taken from regions without spans of the other kind where
+// possible: the smallest free span in such a region, among the first few
+// spans of each list. Spans of a huge page or larger fill their regions,
+// so all of them qualify. Only when no span qualifies does a span go to
+// a region of the other kind.
+static constexpr unsigned max_span_candidates = 8;
+
 page*
-cpu_pages::find_and_unlink_span(unsigned n_pages) {
+cpu_pages::find_and_unlink_span(unsigned n_pages, span_kind kind) {
     auto idx = index_of(n_pages);
     if (n_pages >= (2u << idx)) {
         return nullptr;
     }
-    while (idx < nr_span_lists && free_spans[idx].empty()) {
-        ++idx;
+    auto other = kind == span_kind::large ? span_kind::small_pool : span_kind::large;
+    page_list* fallback = nullptr;
+    for (; idx < nr_span_lists; ++idx) {
+        auto& list = free_spans[idx];
+        if (list.empty()) {
+            continue;
+        }
+        if (!fallback) {
+            fallback = &list;
+        }
+        if ((1u << idx) >= pages_per_huge_page) {
+            break;
+        }
+        auto span = list.find_if(pages, max_span_candidates, [this, other] (page& span) {
+            return !huge_pages[(&span - pages) / pages_per_huge_page].of(other);
+        });
+        if (span) {
+            unlink(list, span);
+            return span;
+        }
     }
-    if (idx == nr_span_lists) {
+    if (idx == nr_span_lists && !fallback) {
         if (initialize()) {
-            return find_and_unlink_span(n_pages);
+            return find_and_unlink_span(n_pages, kind);
         }
         return nullptr;
     }
-    auto& list = free_spans[idx];
+    auto& list = idx < nr_span_lists ? free_spans[idx] : *fallback;
     page* span = &list.front(pages);
     unlink(list, span);
     return span;
 }
 
 page*
-cpu_pages::find_and_unlink_span_reclaiming(unsigned n_pages) {
+cpu_pages::find_and_unlink_span_reclaiming(unsigned n_pages, span_kind kind) {
     while (true) {
-        auto span = find_and_unlink_span(n_pages);
+        auto span = find_and_unlink_span(n_pages, kind);
         if (span) {
             return span;
         }
@@ -740,13 +945,13 @@ void cpu_pages::maybe_reclaim() {
 }
 
 void*
-cpu_pages::allocate_large_and_trim(unsigned n_pages) {
+cpu_pages::allocate_large_and_trim(unsigned n_pages, span_kind kind) {
     // Avoid exercising the reclaimers for requests we'll not be able to satisfy
     // nr_pages might be zero during startup, so check for that too
     if (nr_pages && n_pages >= nr_pages) {
         return nullptr;
     }
-    page* span = find_and_unlink_span_reclaiming(n_pages);
+    page* span = find_and_unlink_span_reclaiming(n_pages, kind);
     if (!span) {
         return nullptr;
     }
@@ -762,6 +967,7 @@ cpu_pages::allocate_large_and_trim(unsigned n_pages) {
     span->free = span_end->free = false;
     span->span_size = span_end->span_size = span_size;
     span->pool = nullptr;
+    account_huge_pages(span_idx, span_size, kind, true);
 #ifdef SEASTAR_HEAPPROF
     auto alloc_site = get_allocation_site();
     span->alloc_site = alloc_site;
@@ -790,16 +996,16 @@ cpu_pages::check_large_allocation(size_t size) {
 }
 
 void*
-cpu_pages::allocate_large(unsigned n_pages) {
+cpu_pages::allocate_large(unsigned n_pages, span_kind kind) {
     check_large_allocation(n_pages * page_size);
-    return allocate_large_and_trim(n_pages);
+    return allocate_large_and_trim(n_pages, kind);
 }
 
 void*
 cpu_pages::allocate_large_aligned(unsigned align_pages, unsigned n_pages) {
     check_large_allocation(n_pages * page_size);
     // buddy allocation is always aligned
-    return allocate_large_and_trim(n_pages);
+    return allocate_large_and_trim(n_pages, span_kind::large);
 }
 
 disable_backtrace_temporarily::disable_backtrace_temporarily() {
@@ -877,6 +1083,7 @@ void cpu_pages::free_large(void* ptr) {
         alloc_site->size -= span->span_size * page_size;
     }
 #endif
+    account_huge_pages(idx, span->span_size, span_kind::large, false);
     free_span(idx, span->span_size);
 }
 
@@ -903,17 +1110,79 @@ void cpu_pages::free_cross_cpu(unsigned cpu_id, void* ptr) {
         return;
     }
     auto p = reinterpret_cast<cross_cpu_free_item*>(ptr);
+    if (!is_reactor_thread) {
+        // Nothing would ever flush a batch of this thread
+        push_cross_cpu(cpu_id, p, p);
+        alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+        alloc_stats::increment(alloc_stats::types::cross_cpu_free_batches);
+        return;
+    }
+    // Reactor threads batch their frees and flush them when polling, so
+    // the cache line of xcpu_freelist bounces once per batch
+    auto& batch = cpu_mem.xcpu_batches[cpu_id];
+    p->next = batch.head;
+    batch.head = p;
+    if (!batch.size++) {
+        batch.tail = p;
+    }
+    if (!batch.listed) {
+        batch.listed = true;
+        cpu_mem.xcpu_batch_cpus[cpu_mem.nr_xcpu_batch_cpus++] = cpu_id;
+    }
+    alloc_stats::increment_local(alloc_stats::types::cross_cpu_frees);
+    if (batch.size == cross_cpu_free_batch::max_size) {
+        cpu_mem.flush_cross_cpu_batch(cpu_id);
+    }
+}
+
+void cpu_pages::push_cross_cpu(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail) {
     auto& list = all_cpus[cpu_id]->xcpu_freelist;
     auto old = list.load(std::memory_order_relaxed);
     do {
-        p->next = old;
-    } while (!list.compare_exchange_weak(old, p, std::memory_order_release, std::memory_order_relaxed));
-    alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+        tail->next = old;
+    } while (!list.compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void cpu_pages::flush_cross_cpu_batch(unsigned cpu_id) {
+    auto& batch = xcpu_batches[cpu_id];
+    if (!batch.size) {
+        return;
+    }
+    if (live_cpus[cpu_id].load(std::memory_order_relaxed)) {
+        push_cross_cpu(cpu_id, batch.head, batch.tail);
+        alloc_stats::increment_local(alloc_stats::types::cross_cpu_free_batches);
+    }
+    batch.head = batch.tail = nullptr;
+    batch.size = 0;
+}
+
+bool cpu_pages::flush_cross_cpu_batches() {
+    if (!nr_xcpu_batch_cpus) {
+        return false;
+    }
+    for (unsigned i = 0; i < nr_xcpu_batch_cpus; i++) {
+        flush_cross_cpu_batch(xcpu_batch_cpus[i]);
+        xcpu_batches[xcpu_batch_cpus[i]].listed = false;
+    }
+    nr_xcpu_batch_cpus = 0;
+    return true;
+}
+
+bool cpu_pages::compact_small_pools(bool (*should_stop)()) {
+    while (next_pool_to_compact < small_pool_array::nr_small_pools) {
+        small_pools[next_pool_to_compact++].compact();
+        if (should_stop && should_stop()) {
+            return false;
+        }
+    }
+    next_pool_to_compact = 0;
+    return true;
 }
 
 bool cpu_pages::drain_cross_cpu_freelist() {
+    auto flushed = flush_cross_cpu_batches();
     if (!xcpu_freelist.load(std::memory_order_relaxed)) {
-        return false;
+        return flushed;
     }
     auto p = xcpu_freelist.exchange(nullptr, std::memory_order_acquire);
     while (p) {
@@ -927,6 +1196,9 @@ bool cpu_pages::drain_cross_cpu_freelist() {
 
 void cpu_pages::free(void* ptr) {
     page* span = to_page(ptr);
+    if (__builtin_expect(span->sampled, false) && !forget_sample(ptr, span)) {
+        return;
+    }
     if (span->pool) {
         small_pool& pool = *span->pool;
 #ifdef SEASTAR_HEAPPROF
@@ -943,6 +1215,10 @@ void cpu_pages::free(void* ptr) {
 }
 
 void cpu_pages::free(void* ptr, size_t size) {
+    // Only look at the page when there are samples, it's not needed otherwise
+    if (__builtin_expect(!sampler.samples.empty(), false) && to_page(ptr)->sampled && !forget_sample(ptr, to_page(ptr))) {
+        return;
+    }
     // match action on allocate() so hit the right pool
     if (size <= sizeof(free_object)) {
         size = sizeof(free_object);
@@ -963,6 +1239,81 @@ void cpu_pages::free(void* ptr, size_t size) {
     }
 }
 
+// Called once the allocations since the last sample reached the sampling
+// distance, the allocation of ptr is the one holding the picked byte
+void cpu_pages::sample_allocation(void* ptr, size_t size) noexcept {
+    auto& s = sampler;
+    s.bytes_until_sample = s.next_distance();
+    if (!ptr || s.busy || !s.rate) {
+        return;
+    }
+    s.busy = true;
+    try {
+        heap_sampler::site_key key;
+        void* frames[heap_sampler::max_depth + heap_sampler::skipped_frames];
+        int n = ::backtrace(frames, std::size(frames));
+        for (int i = heap_sampler::skipped_frames; i < n; ++i) {
+            auto pc = reinterpret_cast<uintptr_t>(frames[i]);
+            key.pcs[key.depth++] = pc;
+            key.hash = key.hash * 31 + pc;
+        }
+        auto objects = 1 / (1 - std::exp(-double(size) / s.rate));
+        auto& site = *s.sites.try_emplace(key).first;
+        s.samples.emplace(reinterpret_cast<uintptr_t>(ptr), heap_sampler::sample{&site, objects, size});
+        site.second.live_objects += objects;
+        site.second.live_bytes += objects * size;
+        site.second.allocated_objects += objects;
+        site.second.allocated_bytes += objects * size;
+        to_page(ptr)->sampled = true;
+    } catch (...) {
+        // Not enough memory to keep the sample
+    }
+    sampler_done();
+}
+
+// Returns false if the object must not be freed yet
+bool cpu_pages::forget_sample(void* ptr, page* span) noexcept {
+    auto& s = sampler;
+    // The sampler may be freeing its own objects, or be called back while
+    // it allocates and a reclaimer frees. The object can be a sample, so
+    // look it up once the sampler's containers are consistent again.
+    if (s.busy) {
+        auto obj = new (ptr) free_object;
+        obj->next = s.deferred_frees;
+        s.deferred_frees = obj;
+        return false;
+    }
+    s.busy = true;
+    auto addr = reinterpret_cast<uintptr_t>(ptr);
+    auto i = s.samples.find(addr);
+    if (i != s.samples.end()) {
+        auto& sample = i->second;
+        sample.site->second.live_objects -= sample.objects;
+        sample.site->second.live_bytes -= sample.objects * sample.size;
+        s.samples.erase(i);
+    }
+    auto page_start = align_down<uintptr_t>(addr, page_size);
+    auto next = s.samples.lower_bound(page_start);
+    span->sampled = next != s.samples.end() && next->first < page_start + page_size;
+    sampler_done();
+    return true;
+}
+
+void cpu_pages::sampler_done() noexcept {
+    auto& s = sampler;
+    s.busy = false;
+    // Freeing a deferred object ends in here again
+    if (s.freeing_deferred) {
+        return;
+    }
+    s.freeing_deferred = true;
+    while (auto obj = s.deferred_frees) {
+        s.deferred_frees = obj->next;
+        free(obj);
+    }
+    s.freeing_deferred = false;
+}
+
 bool
 cpu_pages::try_foreign_free(void* ptr) {
     // fast path for local free
@@ -1007,10 +1358,17 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
     span[new_size_pages - 1].free = false;
     span[new_size_pages - 1].span_size = new_size_pages;
     pageidx idx = span - pages;
+    account_huge_pages(idx + new_size_pages, old_size_pages - new_size_pages, span_kind::large, false);
     free_span_unaligned(idx + new_size_pages, old_size_pages - new_size_pages);
 }
 
 cpu_pages::~cpu_pages() {
+    // Freeing the sampler's nodes must not look samples up in the
+    // containers being destroyed. Objects of sampled pages freed from now
+    // on are never freed for real, which doesn't matter on the way out.
+    sampler.rate = 0;
+    sampler.busy = true;
+    flush_cross_cpu_batches();
     if (is_initialized()) {
         live_cpus[cpu_id].store(false, std::memory_order_relaxed);
     }
@@ -1044,11 +1402,14 @@ bool cpu_pages::initialize() {
     nr_pages = size / page_size;
     // we reserve the end page so we don't have to special case
     // the last span.
-    auto reserved = align_up(sizeof(page) * (nr_pages + 1), page_size) / page_size;
+    auto reserved = align_up(page_array_size(nr_pages), page_size) / page_size;
     reserved = 1u << log2ceil(reserved);
     for (pageidx i = 0; i < reserved; ++i) {
         pages[i].free = false;
     }
+    huge_pages = reinterpret_cast<huge_page_usage*>(pages + nr_pages + 1);
+    std::uninitialized_fill_n(huge_pages, nr_huge_pages(nr_pages), huge_page_usage{});
+    account_huge_pages(0, reserved, span_kind::large, true);
     pages[nr_pages].free = false;
     free_span_unaligned(reserved, nr_pages - reserved);
     live_cpus[cpu_id].store(true, std::memory_order_relaxed);
@@ -1102,7 +1463,7 @@ void cpu_pages::do_resize(size_t new_size, allocate_system_memory_fn alloc_sys_m
     mem.release();
     ::madvise(mmap_start, mmap_size, MADV_HUGEPAGE);
     // one past last page structure is a sentinel
-    auto new_page_array_pages = align_up(sizeof(page[new_pages + 1]), page_size) / page_size;
+    auto new_page_array_pages = align_up(page_array_size(new_pages), page_size) / page_size;
     auto new_page_array
         = reinterpret_cast<page*>(allocate_large(new_page_array_pages));
     if (!new_page_array) {
@@ -1111,11 +1472,16 @@ void cpu_pages::do_resize(size_t new_size, allocate_system_memory_fn alloc_sys_m
     std::copy(pages, pages + nr_pages, new_page_array);
     // mark new one-past-last page as taken to avoid boundary conditions
     new_page_array[new_pages].free = false;
+    auto new_huge_pages = reinterpret_cast<huge_page_usage*>(new_page_array + new_pages + 1);
+    auto old_nr_huge_pages = nr_huge_pages(nr_pages);
+    std::copy(huge_pages, huge_pages + old_nr_huge_pages, new_huge_pages);
+    std::uninitialized_fill_n(new_huge_pages + old_nr_huge_pages, nr_huge_pages(new_pages) - old_nr_huge_pages, huge_page_usage{});
     auto old_pages = reinterpret_cast<char*>(pages);
     auto old_nr_pages = nr_pages;
-    auto old_pages_size = align_up(sizeof(page[nr_pages + 1]), page_size);
+    auto old_pages_size = align_up(page_array_size(nr_pages), page_size);
     old_pages_size = size_t(1) << log2ceil(old_pages_size);
     pages = new_page_array;
+    huge_pages = new_huge_pages;
     nr_pages = new_pages;
     auto old_pages_start = (old_pages - memory) / page_size;
     if (old_pages_start == 0) {
@@ -1124,6 +1490,7 @@ void cpu_pages::do_resize(size_t new_size, allocate_system_memory_fn alloc_sys_m
         old_pages_size -= page_size;
     }
     if (old_pages_size != 0) {
+        account_huge_pages(old_pages_start, old_pages_size / page_size, span_kind::large, false);
         free_span_unaligned(old_pages_start, old_pages_size / page_size);
     }
     free_span_unaligned(old_nr_pages, new_pages - old_nr_pages);
@@ -1223,13 +1590,13 @@ small_pool::small_pool(unsigned object_size) noexcept
     }
     _span_sizes.preferred = min_waste_span_size ? min_waste_span_size : _span_sizes.fallback;
 
-    _max_free = std::max<unsigned>(100, span_bytes() * 2 / _object_size);
+    _default_max_free = _max_free = std::max<unsigned>(100, span_bytes() * 2 / _object_size);
     _min_free = _max_free / 2;
 }
 
 small_pool::~small_pool() {
     _min_free = _max_free = 0;
-    trim_free_list();
+    trim_free_list(0);
 }
 
 // Should not throw in case of running out of memory to avoid infinite recursion,
@@ -1256,13 +1623,14 @@ small_pool::deallocate(void* object) {
     _free = o;
     ++_free_count;
     if (_free_count >= _max_free) {
-        trim_free_list();
+        trim_free_list((_min_free + _max_free) / 2);
     }
 }
 
 void
 small_pool::add_more_objects() {
     auto goal = (_min_free + _max_free) / 2;
+    ++_refills;
     while (!_span_list.empty() && _free_count < goal) {
         page& span = _span_list.front(get_cpu_mem().pages);
         _span_list.pop_front(get_cpu_mem().pages);
@@ -1278,10 +1646,10 @@ small_pool::add_more_objects() {
     while (_free_count < goal) {
         disable_backtrace_temporarily dbt;
         auto span_size = _span_sizes.preferred;
-        auto data = reinterpret_cast<char*>(get_cpu_mem().allocate_large(span_size));
+        auto data = reinterpret_cast<char*>(get_cpu_mem().allocate_large(span_size, span_kind::small_pool));
         if (!data) {
             span_size = _span_sizes.fallback;
-            data = reinterpret_cast<char*>(get_cpu_mem().allocate_large(span_size));
+            data = reinterpret_cast<char*>(get_cpu_mem().allocate_large(span_size, span_kind::small_pool));
             if (!data) {
                 return;
             }
@@ -1306,8 +1674,7 @@ small_pool::add_more_objects() {
 }
 
 void
-small_pool::trim_free_list() {
-    auto goal = (_min_free + _max_free) / 2;
+small_pool::trim_free_list(size_t goal) {
     while (_free && _free_count > goal) {
         auto obj = _free;
         _free = _free->next;
@@ -1323,11 +1690,102 @@ small_pool::trim_free_list() {
         if (--span->nr_small_alloc == 0) {
             _pages_in_use -= span->span_size;
             _span_list.erase(get_cpu_mem().pages, *span);
+            get_cpu_mem().account_huge_pages(span - get_cpu_mem().pages, span->span_size, span_kind::small_pool, false);
             get_cpu_mem().free_span(span - get_cpu_mem().pages, span->span_size);
         }
     }
 }
 
+// Objects on the free list of the pool keep their spans allocated, so after
+// a burst of allocations the pool holds on to memory it may never need
+// again. A pool which didn't have to refill its free list since the last
+// compaction is idle: it halves its watermarks and returns all its free
+// objects to their spans, handing the spans left empty back to the page
+// allocator. A busy pool grows its watermarks back, so it refills less
+// often.
+void
+small_pool::compact() {
+    if (_refills) {
+        _refills = 0;
+        _max_free = std::min(_max_free * 2, _default_max_free);
+    } else {
+        _max_free = std::max(_max_free / 2, std::max(_default_max_free / 8, 2u));
+        trim_free_list(0);
+    }
+    _min_free = _max_free / 2;
+}
+
+small_pool_statistics small_pool::stats() const noexcept {
+    small_pool_statistics ret;
+    ret.object_size = _object_size;
+    ret.pages = _pages_in_use;
+    // Free objects are on the pool free list, or on the free lists of the
+    // spans once the pool free list grew too long
+    ret.free_objects = _free_count;
+    _span_list.for_each(get_cpu_mem().pages, [&] (const page& span) {
+        ret.free_objects += span.span_size * page_size / _object_size - span.nr_small_alloc;
+    });
+    ret.live_objects = _pages_in_use * page_size / _object_size - ret.free_objects;
+    return ret;
+}
+
+huge_page_statistics cpu_pages::huge_page_stats() const noexcept {
+    huge_page_statistics ret;
+    ret.regions = nr_huge_pages(nr_pages);
+    for (size_t i = 0; i < ret.regions; i++) {
+        auto& usage = huge_pages[i];
+        ret.free_regions += !usage.large_pages && !usage.small_pool_pages;
+        ret.mixed_regions += usage.large_pages && usage.small_pool_pages;
+    }
+    return ret;
+}
+
+// Sums AnonHugePages of the mappings overlapping [start, end), scaling
+// those partly outside of it
+static size_t huge_page_backed_memory(uintptr_t start, uintptr_t end) {
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    uintptr_t map_start = 0, map_end = 0;
+    double ret = 0;
+    while (std::getline(smaps, line)) {
+        unsigned long from, to, kb;
+        if (std::sscanf(line.c_str(), "%lx-%lx ", &from, &to) == 2) {
+            map_start = from;
+            map_end = to;
+        } else if (std::sscanf(line.c_str(), "AnonHugePages: %lu kB", &kb) == 1 && kb) {
+            auto overlap_start = std::max(start, map_start);
+            auto overlap_end = std::min(end, map_end);
+            if (overlap_start < overlap_end) {
+                ret += double(kb << 10) * (overlap_end - overlap_start) / (map_end - map_start);
+            }
+        }
+    }
+    return ret;
+}
+
+void cpu_pages::span_stats(std::array<span_statistics, nr_span_lists>& out) const noexcept {
+    for (unsigned i = 0; i < nr_span_lists; i++) {
+        out[i] = span_statistics{};
+        out[i].order = i;
+    }
+    for (unsigned i = 0; i < nr_pages;) {
+        auto& span = pages[i];
+        if (!span.span_size) {
+            ++i;
+            continue;
+        }
+        auto& s = out[log2ceil(span.span_size)];
+        if (span.free) {
+            s.free_spans++;
+            s.free_pages += span.span_size;
+        } else {
+            s.used_spans++;
+            s.used_pages += span.span_size;
+        }
+        i += span.span_size;
+    }
+}
+
 void
 abort_on_underflow(size_t size) {
     if (std::make_signed_t<size_t>(size) < 0) {
@@ -1398,6 +1856,7 @@ void* allocate(size_t size) {
     if (size <= sizeof(free_object)) {
         size = sizeof(free_object);
     }
+    auto requested = size;
     void* ptr;
     if (size <= max_small_allocation) {
         size = object_size_with_alloc_site(size);
@@ -1412,6 +1871,9 @@ void* allocate(size_t size) {
         std::memset(ptr, debug_allocation_pattern, size);
 #endif
     }
+    if (__builtin_expect((cpu_mem.sampler.bytes_until_sample -= requested) < 0, false)) {
+        cpu_mem.sample_allocation(ptr, requested);
+    }
     alloc_stats::increment_local(alloc_stats::types::allocs);
     return ptr;
 }
@@ -1429,6 +1891,7 @@ void* allocate_aligned(size_t align, size_t size) {
     if (size <= sizeof(free_object)) {
         size = std::max(sizeof(free_object), align);
     }
+    auto requested = size;
     void* ptr;
     if (size <= max_small_allocation && align <= page_size) {
         // Our small allocator only guarantees alignment for power-of-two
@@ -1445,6 +1908,9 @@ void* allocate_aligned(size_t align, size_t size) {
         std::memset(ptr, debug_allocation_pattern, size);
 #endif
     }
+    if (__builtin_expect((cpu_mem.sampler.bytes_until_sample -= requested) < 0, false)) {
+        cpu_mem.sample_allocation(ptr, requested);
+    }
     alloc_stats::increment_local(alloc_stats::types::allocs);
     return ptr;
 }
@@ -1564,6 +2030,7 @@ void configure(std::vector<resource::memory> m, bool mbind,
 
 statistics stats() {
     return statistics{alloc_stats::get(alloc_stats::types::allocs), alloc_stats::get(alloc_stats::types::frees), alloc_stats::get(alloc_stats::types::cross_cpu_frees),
+        alloc_stats::get(alloc_stats::types::cross_cpu_free_batches),
         cpu_mem.nr_pages * page_size, cpu_mem.nr_free_pages * page_size, alloc_stats::get(alloc_stats::types::reclaims), alloc_stats::get(alloc_stats::types::large_allocs),
         alloc_stats::get(alloc_stats::types::failed_allocs), alloc_stats::get(alloc_stats::types::foreign_mallocs), alloc_stats::get(alloc_stats::types::foreign_frees),
         alloc_stats::get(alloc_stats::types::foreign_cross_frees)};
@@ -1577,10 +2044,76 @@ bool drain_cross_cpu_freelist() {
     return get_cpu_mem().drain_cross_cpu_freelist();
 }
 
+bool compact_small_pools(bool (*should_stop)()) {
+    return get_cpu_mem().compact_small_pools(should_stop);
+}
+
 memory_layout get_memory_layout() {
     return get_cpu_mem().memory_layout();
 }
 
+size_class_statistics size_class_stats() {
+    size_class_statistics ret;
+    auto& cpu = get_cpu_mem();
+    for (unsigned i = 0; i < cpu.small_pools.nr_small_pools; i++) {
+        auto& sp = cpu.small_pools[i];
+        // Pools of objects too small to hold a free_object are never used
+        if (sp.object_size() >= sizeof(free_object)) {
+            ret.small_pools.push_back(sp.stats());
+        }
+    }
+    std::array<span_statistics, cpu_pages::nr_span_lists> spans;
+    cpu.span_stats(spans);
+    ret.spans.assign(spans.begin(), spans.end());
+    return ret;
+}
+
+void set_heap_sampling_rate(size_t sample_rate) {
+    auto& s = get_cpu_mem().sampler;
+    if (!s.random_state) {
+        s.random_state = 0x9e3779b97f4a7c15ull ^ (uint64_t(cpu_mem.cpu_id) << 32);
+    }
+    s.rate = std::min<size_t>(sample_rate, std::numeric_limits<int32_t>::max());
+    s.bytes_until_sample = s.next_distance();
+}
+
+size_t get_heap_sampling_rate() {
+    return get_cpu_mem().sampler.rate;
+}
+
+std::vector<sampled_allocation_site> sampled_heap_profile() {
+    auto& s = get_cpu_mem().sampler;
+    std::vector<sampled_allocation_site> ret;
+    // Allocations of the copy must not add sites while iterating
+    s.busy = true;
+    try {
+        ret.reserve(s.sites.size());
+        for (auto& [key, totals] : s.sites) {
+            auto& site = ret.emplace_back();
+            site.backtrace.assign(key.pcs.begin(), key.pcs.begin() + key.depth);
+            site.live_objects = totals.live_objects;
+            site.live_bytes = totals.live_bytes;
+            site.allocated_objects = totals.allocated_objects;
+            site.allocated_bytes = totals.allocated_bytes;
+        }
+    } catch (...) {
+        get_cpu_mem().sampler_done();
+        throw;
+    }
+    get_cpu_mem().sampler_done();
+    return ret;
+}
+
+huge_page_statistics huge_page_stats(bool include_backing) {
+    auto& cpu = get_cpu_mem();
+    auto ret = cpu.huge_page_stats();
+    if (include_backing) {
+        auto start = reinterpret_cast<uintptr_t>(cpu.memory);
+        ret.huge_page_backed_memory = huge_page_backed_memory(start, start + size_t(cpu.nr_pages) * page_size);
+    }
+    return ret;
+}
+
 size_t min_free_memory() {
     return get_cpu_mem().min_free_pages * page_size;
 }
@@ -1707,30 +2240,15 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
         if (sp.object_size() < sizeof(free_object)) {
             continue;
         }
-
-        // For the small pools, there are two types of free objects:
-        // Pool freelist objects are poitned to by sp._free and their count is sp._free_count
-        // Span freelist objects are those removed from the pool freelist when that list
-        // becomes too large: they are instead attached to the spans allocated to this
-        // pool. To count this second category, we iterate over the spans below.
-        uint32_t span_freelist_objs = 0;
-        auto front = sp._span_list._front;
-        while (front) {
-            auto& span = get_cpu_mem().pages[front];
-            auto capacity_in_objects = span.span_size * page_size / sp.object_size();
-            span_freelist_objs += capacity_in_objects - span.nr_small_alloc;
-            front = span.link._next;
-        }
-        const auto free_objs = sp._free_count + span_freelist_objs; // pool + span free objects
-        const auto use_count = sp._pages_in_use * page_size / sp.object_size() - free_objs;
-        auto memory = sp._pages_in_use * page_size;
-        const auto unused = free_objs * sp.object_size();
+        const auto st = sp.stats();
+        const auto memory = st.pages * page_size;
+        const auto unused = st.free_objects * st.object_size;
         const auto wasted_percent = memory ? unused * 100 / memory : 0;
         it = fmt::format_to(it,
                 "{:>5}  {:>5}   {:>5}  {:>5}  {:>5} {:>4}\n",
-                sp.object_size(),
-                to_hr_size(sp._span_sizes.preferred * page_size),
-                to_hr_number(use_count),
+                st.object_size,
+                to_hr_size(sp.preferred_span_size() * page_size),
+                to_hr_number(st.live_objects),
                 to_hr_size(memory),
                 to_hr_size(unused),
                 unsigned(wasted_percent));
@@ -1738,37 +2256,16 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
     it = fmt::format_to(it, "\nPage spans:\n");
     it = fmt::format_to(it, "index  size  free  used spans\n");
 
-    std::array<uint32_t, cpu_pages::nr_span_lists> span_size_histogram;
-    span_size_histogram.fill(0);
-
-    for (unsigned i = 0; i < get_cpu_mem().nr_pages;) {
-        const auto span_size = get_cpu_mem().pages[i].span_size;
-        if (!span_size) {
-            ++i;
-            continue;
-        }
-        ++span_size_histogram[log2ceil(span_size)];
-        i += span_size;
-    }
-
-    for (unsigned i = 0; i< get_cpu_mem().nr_span_lists; i++) {
-        auto& span_list = get_cpu_mem().free_spans[i];
-        auto front = span_list._front;
-        uint32_t free_pages = 0;
-        while (front) {
-            auto& span = get_cpu_mem().pages[front];
-            free_pages += span.span_size;
-            front = span.link._next;
-        }
-        const auto total_spans = span_size_histogram[i];
-        const auto total_pages = total_spans * (1 << i);
+    std::array<span_statistics, cpu_pages::nr_span_lists> spans;
+    get_cpu_mem().span_stats(spans);
+    for (auto& st : spans) {
         it = fmt::format_to(it,
                 "{:>5} {:>5} {:>5} {:>5} {:>5}\n",
-                i,
-                to_hr_size((uint64_t(1) << i) * page_size),
-                to_hr_size(free_pages * page_size),
-                to_hr_size((total_pages - free_pages) * page_size),
-                to_hr_number(total_spans));
+                st.order,
+                to_hr_size((uint64_t(1) << st.order) * page_size),
+                to_hr_size(st.free_pages * page_size),
+                to_hr_size(st.used_pages * page_size),
+                to_hr_number(st.free_spans + st.used_spans));
     }
 
     return it;
@@ -2300,7 +2797,7 @@ void configure(std::vector<resource::memory> m, bool mbind, std::optional<std::s
 }
 
 statistics stats() {
-    return statistics{0, 0, 0, 1 << 30, 1 << 30, 0, 0, 0, 0, 0, 0};
+    return statistics{0, 0, 0, 0, 1 << 30, 1 << 30, 0, 0, 0, 0, 0, 0};
 }
 
 size_t free_memory() {
@@ -2311,10 +2808,34 @@ bool drain_cross_cpu_freelist() {
     return false;
 }
 
+bool compact_small_pools(bool (*should_stop)()) {
+    return true;
+}
+
 memory_layout get_memory_layout() {
     throw std::runtime_error("get_memory_layout() not supported");
 }
 
+size_class_statistics size_class_stats() {
+    return {};
+}
+
+huge_page_statistics huge_page_stats(bool include_backing) {
+    return {};
+}
+
+void set_heap_sampling_rate(size_t sample_rate) {
+    seastar_logger.warn("Seastar compiled with default allocator, sampling heap profiler not supported");
+}
+
+size_t get_heap_sampling_rate() {
+    return 0;
+}
+
+std::vector<sampled_allocation_site> sampled_heap_profile() {
+    return {};
+}
+
 size_t min_free_memory() {
     return 0;
 }
@@ -30,6 +30,7 @@
 #include <sys/resource.h>
 #include <sys/inotify.h>
 #include <sys/wait.h>
+#include <sys/sendfile.h>
 #include <fmt/ranges.h>
 #include <seastar/core/task.hh>
 #include <seastar/core/reactor.hh>
@@ -57,6 +58,8 @@
 #include <seastar/core/abort_on_ebadf.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/internal/idle_governor.hh>
+#include <seastar/core/bitops.hh>
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/uname.hh>
 #include <seastar/core/scheduling_specific.hh>
@@ -64,6 +67,7 @@
 #include <seastar/util/log.hh>
 #include <seastar/util/read_first_line.hh>
 #include "core/reactor_backend.hh"
+#include "core/file-impl.hh"
 #include "core/syscall_result.hh"
 #include "core/thread_pool.hh"
 #include "syscall_work_queue.hh"
@@ -74,6 +78,8 @@
 #include <fcntl.h>
 #include <sys/eventfd.h>
 #include <sys/poll.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/barrier.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -153,6 +159,17 @@ static_assert(posix::shutdown_mask(SHUT_RD) == posix::rcv_shutdown);
 static_assert(posix::shutdown_mask(SHUT_WR) == posix::snd_shutdown);
 static_assert(posix::shutdown_mask(SHUT_RDWR) == (posix::snd_shutdown | posix::rcv_shutdown));
 
+// Throughput of a mix of random reads and writes measured with the p99
+// latency staying within the target, as reported by iotune
+struct mixed_workload_params {
+    float read_ratio;
+    std::chrono::microseconds p99_latency;
+    uint64_t read_iops;
+    uint64_t read_bandwidth;
+    uint64_t write_iops;
+    uint64_t write_bandwidth;
+};
+
 struct mountpoint_params {
     std::string mountpoint = "none";
     uint64_t read_bytes_rate = std::numeric_limits<uint64_t>::max();
@@ -163,6 +180,7 @@ struct mountpoint_params {
     uint64_t write_saturation_length = std::numeric_limits<uint64_t>::max();
     bool duplex = false;
     float rate_factor = 1.0;
+    std::vector<mixed_workload_params> mixed_workloads;
 };
 
 }
@@ -189,6 +207,18 @@ struct convert<seastar::mountpoint_params> {
         if (node["rate_factor"]) {
             mp.rate_factor = node["rate_factor"].as<float>();
         }
+        if (node["mixed_workloads"]) {
+            for (auto&& w : node["mixed_workloads"]) {
+                mp.mixed_workloads.push_back(mixed_workload_params{
+                    .read_ratio = w["read_ratio"].as<float>(),
+                    .p99_latency = std::chrono::microseconds(w["p99_latency_us"].as<uint64_t>()),
+                    .read_iops = parse_memory_size(w["read_iops"].as<std::string>()),
+                    .read_bandwidth = parse_memory_size(w["read_bandwidth"].as<std::string>()),
+                    .write_iops = parse_memory_size(w["write_iops"].as<std::string>()),
+                    .write_bandwidth = parse_memory_size(w["write_bandwidth"].as<std::string>()),
+                });
+            }
+        }
         return true;
     }
 };
@@ -321,6 +351,93 @@ reactor::do_recvmsg(pollable_fd_state& fd, const std::vector<iovec>& iov) {
     });
 }
 
+namespace internal {
+
+// Keeps the packets sent with MSG_ZEROCOPY alive until the kernel reports,
+// via the socket error queue, that it no longer references their data.
+// The kernel numbers the successful zero-copy sends on a socket sequentially,
+// and each report covers a range of these numbers.
+class zerocopy_tracker {
+    struct pending_send {
+        uint32_t id;
+        bool done;
+        net::packet p;
+    };
+    std::deque<pending_send> _pending;
+    uint32_t _next_id = 0;
+    bool _enabled;
+    // The descriptor reactor::watch_zerocopy() watches for the tracker
+    int _watched_fd = -1;
+public:
+    explicit zerocopy_tracker(bool enabled) noexcept : _enabled(enabled) {}
+
+    static std::unique_ptr<zerocopy_tracker> create(file_desc& fd) {
+        int one = 1;
+        bool enabled = ::setsockopt(fd.get(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+        return std::make_unique<zerocopy_tracker>(enabled);
+    }
+
+    // False if the socket doesn't support zero-copy sends or the kernel
+    // turned out to copy the data anyway
+    bool enabled() const noexcept { return _enabled; }
+    bool empty() const noexcept { return _pending.empty(); }
+    int watched_fd() const noexcept { return _watched_fd; }
+    void set_watched_fd(int fd) noexcept { _watched_fd = fd; }
+
+    // Called before the send, and followed by sent() or failed()
+    void prepare(net::packet p) {
+        _pending.push_back(pending_send{_next_id, false, std::move(p)});
+    }
+    void sent() noexcept {
+        _next_id++;
+    }
+    void failed() noexcept {
+        _pending.pop_back();
+    }
+
+    // Picks up the completion reports without blocking
+    void reap(int fd) noexcept {
+        while (!_pending.empty()) {
+            alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(::sock_extended_err) + sizeof(::sockaddr_in6))];
+            ::msghdr mh = {};
+            mh.msg_control = control;
+            mh.msg_controllen = sizeof(control);
+            if (::recvmsg(fd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                return;
+            }
+            for (auto cm = CMSG_FIRSTHDR(&mh); cm != nullptr; cm = CMSG_NXTHDR(&mh, cm)) {
+                if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                        !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                    continue;
+                }
+                ::sock_extended_err serr;
+                std::memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+                if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                    continue;
+                }
+                if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    // Pages were copied anyway (e.g. loopback), zero-copy only adds overhead
+                    _enabled = false;
+                }
+                complete(serr.ee_info, serr.ee_data);
+            }
+        }
+    }
+private:
+    void complete(uint32_t lo, uint32_t hi) noexcept {
+        for (auto& s : _pending) {
+            if (int32_t(s.id - lo) >= 0 && int32_t(hi - s.id) >= 0) {
+                s.done = true;
+            }
+        }
+        while (!_pending.empty() && _pending.front().done) {
+            _pending.pop_front();
+        }
+    }
+};
+
+}
+
 future<size_t>
 reactor::do_send(pollable_fd_state& fd, const void* buffer, size_t len) {
     return writeable(fd).then([this, &fd, buffer, len] () mutable {
@@ -361,6 +478,210 @@ reactor::do_sendmsg(pollable_fd_state& fd, net::packet& p) {
     });
 }
 
+future<size_t>
+reactor::do_recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return readable(fd).then([this, &fd, msgs, n] {
+        auto r = ::recvmmsg(fd.fd.get(), msgs, n, MSG_DONTWAIT, nullptr);
+        if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return do_recvmmsg(fd, msgs, n);
+        }
+        throw_system_error_on(r == -1, "recvmmsg");
+        // Unlike with recvmsg() there's no need to always speculate: only
+        // a full batch suggests that more datagrams are queued
+        if (size_t(r) == n) {
+            fd.speculate_epoll(EPOLLIN);
+        }
+        return make_ready_future<size_t>(r);
+    });
+}
+
+future<size_t>
+reactor::do_sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return writeable(fd).then([this, &fd, msgs, n] {
+        auto r = ::sendmmsg(fd.fd.get(), msgs, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return do_sendmmsg(fd, msgs, n);
+        }
+        throw_system_error_on(r == -1, "sendmmsg");
+        if (size_t(r) == n) {
+            fd.speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(r);
+    });
+}
+
+future<size_t>
+reactor::do_sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) {
+    try {
+        if (!fd._zerocopy) {
+            fd._zerocopy = internal::zerocopy_tracker::create(fd.fd);
+            if (fd._zerocopy->enabled()) {
+                // Otherwise the next sends reap the completions
+                (void)watch_zerocopy(fd.fd.get(), *fd._zerocopy);
+            }
+        }
+    } catch (...) {
+        return current_exception_as_future<size_t>();
+    }
+    fd._zerocopy->reap(fd.fd.get());
+    if (!fd._zerocopy->enabled()) {
+        return do_sendmsg(fd, p);
+    }
+    return writeable(fd).then([this, &fd, &p] () mutable {
+        auto& zc = *fd._zerocopy;
+        msghdr mh = {};
+        mh.msg_iov = reinterpret_cast<iovec*>(p.fragment_array());
+        mh.msg_iovlen = std::min<size_t>(p.nr_frags(), IOV_MAX);
+        zc.prepare(p.share());
+        auto r = ::sendmsg(fd.fd.get(), &mh, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (r == -1) {
+            auto err = errno;
+            zc.failed();
+            if (err == EAGAIN || err == EWOULDBLOCK) {
+                return do_sendmsg_zerocopy(fd, p);
+            }
+            if (err == ENOBUFS) {
+                // Out of socket memory to pin the pages with, copy instead
+                return do_sendmsg(fd, p);
+            }
+            return make_exception_future<size_t>(std::system_error(err, std::system_category(), "sendmsg"));
+        }
+        zc.sent();
+        if (size_t(r) == p.len()) {
+            fd.speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(r);
+    });
+}
+
+void reactor::park_zerocopy(pollable_fd_state& fd) noexcept {
+    try {
+        // The socket must stay open to receive the completion reports
+        auto dup = fd.fd.dup();
+        _parked_zerocopy.reserve(_parked_zerocopy.size() + 1);
+        if (!watch_zerocopy(dup.get(), *fd._zerocopy)) {
+            throw std::system_error(errno, std::system_category(), "epoll_ctl");
+        }
+        _parked_zerocopy.emplace_back(std::move(dup), std::move(fd._zerocopy));
+    } catch (...) {
+        seastar_logger.warn("Releasing zero-copy sent data of a closed socket early: {}", std::current_exception());
+    }
+}
+
+bool reactor::watch_zerocopy(int fd, internal::zerocopy_tracker& zc) noexcept {
+    if (!_zerocopy_epollfd) {
+        errno = ENOTSUP;
+        return false;
+    }
+    // Only the error queue is of interest, and EPOLLERR is always reported.
+    // Edge triggering wakes up once per batch of new completion reports.
+    ::epoll_event eevt = {};
+    eevt.events = EPOLLET;
+    eevt.data.ptr = &zc;
+    if (::epoll_ctl(_zerocopy_epollfd->get_fd(), EPOLL_CTL_ADD, fd, &eevt) == -1) {
+        return false;
+    }
+    zc.set_watched_fd(fd);
+    return true;
+}
+
+void reactor::unwatch_zerocopy(int fd) noexcept {
+    if (_zerocopy_epollfd) {
+        ::epoll_ctl(_zerocopy_epollfd->get_fd(), EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+void reactor::reap_zerocopy_errors() noexcept {
+    std::array<::epoll_event, 64> events;
+    int nr;
+    do {
+        nr = ::epoll_wait(_zerocopy_epollfd->get_fd(), events.data(), events.size(), 0);
+        for (int i = 0; i < nr; i++) {
+            // The stop eventfd has no tracker
+            if (auto zc = static_cast<internal::zerocopy_tracker*>(events[i].data.ptr)) {
+                zc->reap(zc->watched_fd());
+            }
+        }
+    } while (nr == int(events.size()));
+    auto it = std::remove_if(_parked_zerocopy.begin(), _parked_zerocopy.end(), [this] (auto& parked) {
+        if (!parked.second->empty()) {
+            return false;
+        }
+        unwatch_zerocopy(parked.first.get());
+        return true;
+    });
+    _parked_zerocopy.erase(it, _parked_zerocopy.end());
+}
+
+void reactor::start_zerocopy_loop() {
+    if (!_zerocopy_epollfd) {
+        return;
+    }
+    future<> loop_done = repeat([this] {
+        return _zerocopy_epollfd->readable().then([this] {
+            reap_zerocopy_errors();
+            return _stopping ? stop_iteration::yes : stop_iteration::no;
+        });
+    });
+    // must use make_lw_shared, because at_exit expects a copyable function
+    at_exit([loop_done = make_lw_shared(std::move(loop_done))] {
+        return std::move(*loop_done);
+    });
+}
+
+void reactor::stop_zerocopy_loop() {
+    if (!_zerocopy_epollfd) {
+        return;
+    }
+    uint64_t one = 1;
+    ::write(_zerocopy_stop_eventfd->get(), &one, 8);
+}
+
+int reactor::sendfile_fd(file& f) noexcept {
+    auto* pf = dynamic_cast<posix_file_impl*>(f._file_impl.get());
+    return pf ? pf->sendfile_fd() : -1;
+}
+
+future<>
+reactor::do_send_file(pollable_fd_state& fd, file& f, uint64_t pos, uint64_t len) {
+    auto* pf = dynamic_cast<posix_file_impl*>(f._file_impl.get());
+    assert(pf && pf->sendfile_fd() != -1);
+    return pf->sendfile_source().then([this, &fd, pos, len] (int in_fd) {
+      return do_with(pos, len, [this, &fd, in_fd] (uint64_t& pos, uint64_t& len) {
+        return do_until([&len] { return len == 0; }, [this, &fd, in_fd, &pos, &len] {
+            return do_sendfile_some(fd, in_fd, pos, len).then([&pos, &len] (size_t sent) {
+                pos += sent;
+                len -= sent;
+            });
+        });
+      });
+    });
+}
+
+future<size_t>
+reactor::do_sendfile_some(pollable_fd_state& fd, int in_fd, uint64_t pos, uint64_t len) {
+    return writeable(fd).then([this, &fd, in_fd, pos, len] {
+        // The file pages may have to be read from disk first, so keep
+        // sendfile() off the reactor thread
+        return _thread_pool->submit<syscall_result<ssize_t>>([out_fd = fd.fd.get(), in_fd, pos, len] {
+            off_t off = pos;
+            return wrap_syscall<ssize_t>(::sendfile(out_fd, in_fd, &off, std::min<uint64_t>(len, 1 << 30)));
+        });
+    }).then([this, &fd, in_fd, pos, len] (syscall_result<ssize_t> sr) {
+        if (sr.result == -1 && (sr.error == EAGAIN || sr.error == EWOULDBLOCK)) {
+            return do_sendfile_some(fd, in_fd, pos, len);
+        }
+        sr.throw_if_error();
+        if (sr.result == 0) {
+            return make_exception_future<size_t>(std::system_error(ENODATA, std::system_category(), "sendfile: file ended before the requested range"));
+        }
+        if (size_t(sr.result) == len) {
+            fd.speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(sr.result);
+    });
+}
+
 future<>
 reactor::send_all_part(pollable_fd_state& fd, const void* buffer, size_t len, size_t completed) {
     if (completed == len) {
@@ -413,9 +734,31 @@ future<temporary_buffer<char>> pollable_fd_state::read_some(internal::buffer_all
 }
 
 future<size_t> pollable_fd_state::write_some(net::packet& p) {
+    if (zerocopy_eligible(p.len())) {
+        return engine()._backend->sendmsg_zerocopy(*this, p);
+    }
     return engine()._backend->sendmsg(*this, p);
 }
 
+bool pollable_fd_state::zerocopy_eligible(size_t len) const noexcept {
+    auto threshold = engine()._cfg.zerocopy_send_threshold;
+    return threshold != 0 && len >= threshold;
+}
+
+void pollable_fd_state::reap_zerocopy() noexcept {
+    if (_zerocopy && !_zerocopy->empty()) {
+        _zerocopy->reap(fd.get());
+    }
+}
+
+bool pollable_fd_state::can_send_file(file& f) noexcept {
+    return reactor::sendfile_fd(f) != -1;
+}
+
+future<> pollable_fd_state::send_file(file& f, uint64_t pos, uint64_t len) {
+    return engine().do_send_file(*this, f, pos, len);
+}
+
 future<> pollable_fd_state::write_all(const char* buffer, size_t size) {
     return engine().send_all(*this, buffer, size);
 }
@@ -499,6 +842,16 @@ future<size_t> pollable_fd_state::sendmsg(struct msghdr* msg) {
     });
 }
 
+future<size_t> pollable_fd_state::recvmmsg(struct mmsghdr* msgs, size_t n) {
+    maybe_no_more_recv();
+    return engine()._backend->recvmmsg(*this, msgs, n);
+}
+
+future<size_t> pollable_fd_state::sendmmsg(struct mmsghdr* msgs, size_t n) {
+    maybe_no_more_send();
+    return engine()._backend->sendmmsg(*this, msgs, n);
+}
+
 future<size_t> pollable_fd_state::sendto(socket_address addr, const void* buf, size_t len) {
     maybe_no_more_send();
     return engine().writeable(*this).then([this, buf, len, addr] () mutable {
@@ -1043,6 +1396,26 @@ future<> reactor::poll_rdhup(pollable_fd_state& fd) {
     return _backend->poll_rdhup(fd);
 }
 
+void reactor::register_file(int fd) noexcept {
+    _backend->register_file(fd);
+}
+
+void reactor::unregister_file(int fd) noexcept {
+    _backend->unregister_file(fd);
+}
+
+bool reactor::registers_files() const noexcept {
+    return _backend->registers_files();
+}
+
+void reactor::register_polled_file(int fd, dev_t device_id) noexcept {
+    _backend->register_polled_file(fd, device_id);
+}
+
+bool reactor::have_linked_fdatasync() const noexcept {
+    return _backend->have_linked_fdatasync();
+}
+
 void reactor::set_strict_dma(bool value) {
     _strict_o_direct = value;
 }
@@ -1349,6 +1722,64 @@ std::unique_ptr<cpu_stall_detector> make_cpu_stall_detector(cpu_stall_detector_c
     }
 }
 
+idle_governor::idle_governor(std::chrono::nanoseconds max_poll_time) noexcept
+        : _max_poll_time(max_poll_time)
+        , _poll_time(max_poll_time) {
+}
+
+unsigned idle_governor::bucket_of(std::chrono::nanoseconds gap) noexcept {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(gap).count();
+    if (us <= 0) {
+        return 0;
+    }
+    return std::min<unsigned>(log2floor(uint64_t(us)) + 1, nr_buckets - 1);
+}
+
+std::chrono::nanoseconds idle_governor::bucket_limit(unsigned bucket) noexcept {
+    if (bucket == nr_buckets - 1) {
+        return std::chrono::nanoseconds::max();
+    }
+    return std::chrono::microseconds(uint64_t(1) << bucket);
+}
+
+void idle_governor::on_idle_end(std::chrono::nanoseconds gap) noexcept {
+    _gaps[bucket_of(gap)] += 1;
+    _total += 1;
+    if (++_since_update == update_period) {
+        _since_update = 0;
+        update();
+    }
+}
+
+void idle_governor::on_wakeup(std::chrono::nanoseconds lateness) noexcept {
+    _wakeup_latency += (lateness - _wakeup_latency) / 8;
+}
+
+void idle_governor::update() noexcept {
+    unsigned bucket = 0;
+    double covered = _gaps[0];
+    while (bucket < nr_buckets - 1 && covered < target_quantile * _total) {
+        covered += _gaps[++bucket];
+    }
+    auto gap = bucket_limit(bucket);
+    if (gap <= _wakeup_latency) {
+        _mode = mode::spin;
+        _poll_time = _max_poll_time;
+    } else if (gap <= _max_poll_time) {
+        _mode = mode::poll_then_sleep;
+        _poll_time = gap;
+    } else {
+        _mode = mode::sleep;
+        _poll_time = std::chrono::nanoseconds(0);
+    }
+    // Halve the weight of the history, so that changes in the load
+    // are picked up within a few periods
+    for (auto& g : _gaps) {
+        g /= 2;
+    }
+    _total /= 2;
+}
+
 void cpu_stall_detector::generate_trace() {
     auto delta = reactor::now() - _run_started_at;
 
@@ -1498,10 +1929,21 @@ void reactor::configure(const reactor_options& opts) {
     if (opts.overprovisioned && opts.idle_poll_time_us.defaulted() && !opts.poll_mode) {
         _max_poll_time = 0us;
     }
+    if (opts.idle_poll_governor.get_value() && !opts.poll_mode && _max_poll_time > 0us) {
+        _idle_governor = std::make_unique<internal::idle_governor>(_max_poll_time);
+    }
     set_strict_dma(!opts.relaxed_dma);
     if (!opts.poll_aio.get_value() || (opts.poll_aio.defaulted() && opts.overprovisioned)) {
         _aio_eventfd = pollable_fd(file_desc::eventfd(0, 0));
     }
+    if (_cfg.zerocopy_send_threshold) {
+        _zerocopy_epollfd = pollable_fd(file_desc::epoll_create(EPOLL_CLOEXEC));
+        _zerocopy_stop_eventfd = file_desc::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        ::epoll_event eevt = {};
+        eevt.events = EPOLLIN;
+        eevt.data.ptr = nullptr;
+        throw_system_error_on(::epoll_ctl(_zerocopy_epollfd->get_fd(), EPOLL_CTL_ADD, _zerocopy_stop_eventfd->get(), &eevt) == -1, "epoll_ctl");
+    }
     set_bypass_fsync(opts.unsafe_bypass_fsync.get_value());
     _kernel_page_cache = opts.kernel_page_cache.get_value();
     _force_io_getevents_syscall = opts.force_aio_syscalls.get_value();
@@ -1575,7 +2017,20 @@ void pollable_fd_state::maybe_no_more_send() {
     }
 }
 
+pollable_fd_state::pollable_fd_state(file_desc fd, speculation speculate)
+    : fd(std::move(fd)), events_known(speculate.events) {
+}
+
+pollable_fd_state::~pollable_fd_state() {
+}
+
 void pollable_fd_state::forget() {
+    if (_zerocopy) {
+        engine().unwatch_zerocopy(fd.get());
+        if (!_zerocopy->empty()) {
+            engine().park_zerocopy(*this);
+        }
+    }
     engine()._backend->forget(*this);
 }
 
@@ -2384,6 +2839,7 @@ future<> reactor::run_exit_tasks() {
     _stop_requested.broadcast();
     _stopping = true;
     stop_aio_eventfd_loop();
+    stop_zerocopy_loop();
     return do_for_each(_exit_funcs.rbegin(), _exit_funcs.rend(), [] (auto& func) {
         return func();
     });
@@ -2467,19 +2923,80 @@ void reactor::register_metrics() {
 
     });
 
+    if (_idle_governor) {
+        _metric_groups.add_group("reactor", {
+            sm::make_gauge("idle_governor_mode", [this] { return int(_idle_governor->current_mode()); },
+                    sm::description("How the idle poll governor treats idle time: 0 - keep polling, 1 - poll for a while, then sleep, 2 - sleep right away")),
+            sm::make_gauge("idle_poll_time_us", [this] { return _max_poll_time / 1us; },
+                    sm::description("How long the reactor polls for work before going to sleep, in microseconds")),
+            sm::make_gauge("wakeup_latency_us", [this] { return _idle_governor->wakeup_latency() / 1us; },
+                    sm::description("Average time from a timer becoming due until the sleeping reactor wakes up, in microseconds")),
+        });
+    }
+
     _metric_groups.add_group("memory", {
             sm::make_counter("malloc_operations", [] { return memory::stats().mallocs(); },
                     sm::description("Total number of malloc operations")),
             sm::make_counter("free_operations", [] { return memory::stats().frees(); }, sm::description("Total number of free operations")),
             sm::make_counter("cross_cpu_free_operations", [] { return memory::stats().cross_cpu_frees(); }, sm::description("Total number of cross cpu free")),
+            sm::make_counter("cross_cpu_free_batches", [] { return memory::stats().cross_cpu_free_batches(); }, sm::description("Total number of batches cross cpu frees were handed to their cpus in")),
             sm::make_gauge("malloc_live_objects", [] { return memory::stats().live_objects(); }, sm::description("Number of live objects")),
             sm::make_current_bytes("free_memory", [] { return memory::stats().free_memory(); }, sm::description("Free memory size in bytes")),
             sm::make_current_bytes("total_memory", [] { return memory::stats().total_memory(); }, sm::description("Total memory size in bytes")),
             sm::make_current_bytes("allocated_memory", [] { return memory::stats().allocated_memory(); }, sm::description("Allocated memory size in bytes")),
             sm::make_counter("reclaims_operations", [] { return memory::stats().reclaims(); }, sm::description("Total reclaims operations")),
-            sm::make_counter("malloc_failed", [] { return memory::stats().failed_allocations(); }, sm::description("Total count of failed memory allocations"))
+            sm::make_counter("malloc_failed", [] { return memory::stats().failed_allocations(); }, sm::description("Total count of failed memory allocations")),
+            sm::make_gauge("huge_page_regions", [] { return memory::huge_page_stats().regions; }, sm::description("Number of huge page sized regions of memory")),
+            sm::make_gauge("free_huge_page_regions", [] { return memory::huge_page_stats().free_regions; }, sm::description("Number of huge page sized regions without allocated memory")),
+            sm::make_gauge("mixed_huge_page_regions", [] { return memory::huge_page_stats().mixed_regions; },
+                    sm::description("Number of huge page sized regions holding both small pool spans and large allocations"))
     });
 
+    // All series of the size classes read one snapshot, taken at most once
+    // a second, rather than walking the free spans of the shard each
+    struct size_class_snapshot {
+        memory::size_class_statistics stats = memory::size_class_stats();
+        lowres_clock::time_point taken = lowres_clock::now();
+
+        const memory::size_class_statistics& get() {
+            if (lowres_clock::now() - taken >= std::chrono::seconds(1)) {
+                stats = memory::size_class_stats();
+                taken = lowres_clock::now();
+            }
+            return stats;
+        }
+    };
+    auto size_classes = make_lw_shared<size_class_snapshot>();
+    std::vector<sm::metric_definition> size_class_metrics;
+    for (size_t i = 0; i < size_classes->stats.small_pools.size(); i++) {
+        auto object_size = sm::label("object_size")(size_classes->stats.small_pools[i].object_size);
+        size_class_metrics.emplace_back(sm::make_gauge("small_pool_live_objects", [size_classes, i] { return size_classes->get().small_pools[i].live_objects; },
+                sm::description("Number of allocated objects in the small pool"), {object_size}));
+        size_class_metrics.emplace_back(sm::make_gauge("small_pool_free_objects", [size_classes, i] { return size_classes->get().small_pools[i].free_objects; },
+                sm::description("Number of free objects held by the small pool"), {object_size}));
+        size_class_metrics.emplace_back(sm::make_current_bytes("small_pool_memory", [size_classes, i] { return size_classes->get().small_pools[i].pages * memory::page_size; },
+                sm::description("Memory held by the small pool in bytes"), {object_size}));
+        size_class_metrics.emplace_back(sm::make_gauge("small_pool_fragmentation", [size_classes, i] { return size_classes->get().small_pools[i].fragmentation(); },
+                sm::description("Share of the memory of the small pool not holding live objects"), {object_size}));
+    }
+    for (size_t i = 0; i < size_classes->stats.spans.size(); i++) {
+        auto span_pages = size_t(1) << size_classes->stats.spans[i].order;
+        // Spans larger than the shard's memory never exist
+        if (span_pages * memory::page_size > memory::stats().total_memory()) {
+            break;
+        }
+        auto label = sm::label("span_pages")(span_pages);
+        size_class_metrics.emplace_back(sm::make_gauge("free_spans", [size_classes, i] { return size_classes->get().spans[i].free_spans; },
+                sm::description("Number of free spans of the size"), {label}));
+        size_class_metrics.emplace_back(sm::make_current_bytes("free_span_memory", [size_classes, i] { return size_classes->get().spans[i].free_pages * memory::page_size; },
+                sm::description("Memory in free spans of the size in bytes"), {label}));
+    }
+    if (!size_class_metrics.empty()) {
+        size_class_metrics.emplace_back(sm::make_gauge("free_memory_fragmentation", [size_classes] { return size_classes->get().free_memory_fragmentation(); },
+                sm::description("Share of the free memory not in the largest free span")));
+        _metric_groups.add_group("memory", size_class_metrics);
+    }
+
     _metric_groups.add_group("reactor", {
             sm::make_counter("logging_failures", [] { return logging_failures; }, sm::description("Total number of logging failures")),
             // total_operations value:DERIVE:0:U
@@ -2719,7 +3236,8 @@ class reactor::io_queue_submission_pollfn final : public reactor::pollfn {
 };
 
 // Other cpus can queue items for us to free; and they won't notify
-// us about them.  But it's okay to ignore those items, freeing them
+// us about them. Polling also hands the items we freed for other cpus
+// over to them.  But it's okay to ignore those items, freeing them
 // doesn't have any side effects.
 //
 // We'll take care of those items when we wake up for another reason.
@@ -3063,6 +3581,7 @@ int reactor::do_run() {
     poller execution_stage_poller(std::make_unique<execution_stage_pollfn>());
 
     start_aio_eventfd_loop();
+    start_zerocopy_loop();
 
     if (_id == 0 && _cfg.auto_handle_sigint_sigterm) {
        if (_handle_sigint) {
@@ -3113,6 +3632,14 @@ int reactor::do_run() {
     });
     load_timer.arm_periodic(1s);
 
+    timer<lowres_clock> small_pool_compaction_timer([] {
+        // A slice of the pools per task, yielding in between
+        (void)repeat([] {
+            return stop_iteration(memory::compact_small_pools([] { return need_preempt(); }));
+        });
+    });
+    small_pool_compaction_timer.arm_periodic(1s);
+
     itimerspec its = seastar::posix::to_relative_itimerspec(_task_quota, _task_quota);
     _task_quota_timer.timerfd_settime(0, its);
     auto& task_quote_itimerspec = its;
@@ -3124,6 +3651,8 @@ int reactor::do_run() {
     assert(r == 0);
 
     bool idle = false;
+    // Unlike idle_start, not moved forward by the load timer
+    auto idle_since = idle_start;
 
     std::function<bool()> check_for_work = [this] () {
         return poll_once() || have_more_tasks();
@@ -3135,6 +3664,7 @@ int reactor::do_run() {
         run_some_tasks();
         if (_stopped) {
             load_timer.cancel();
+            small_pool_compaction_timer.cancel();
             // Final tasks may include sending the last response to cpu 0, so run them
             while (have_more_tasks()) {
                 run_some_tasks();
@@ -3159,11 +3689,16 @@ int reactor::do_run() {
                 account_idle(idle_end - idle_start);
                 idle_start = idle_end;
                 idle = false;
+                if (_idle_governor) {
+                    _idle_governor->on_idle_end(idle_end - idle_since);
+                    _max_poll_time = _idle_governor->poll_time();
+                }
             }
         } else {
             idle_end = now();
             if (!idle) {
                 idle_start = idle_end;
+                idle_since = idle_end;
                 idle = true;
             }
             bool go_to_sleep = true;
@@ -3183,11 +3718,15 @@ int reactor::do_run() {
                     struct itimerspec zero_itimerspec = {};
                     _task_quota_timer.timerfd_settime(0, zero_itimerspec);
                     auto start_sleep = now();
+                    auto next_timer = _timers.empty() ? steady_clock_type::time_point::max() : _timers.get_next_timeout();
                     _cpu_stall_detector->start_sleep();
                     sleep();
                     _cpu_stall_detector->end_sleep();
                     // We may have slept for a while, so freshen idle_end
                     idle_end = now();
+                    if (_idle_governor && idle_end >= next_timer) {
+                        _idle_governor->on_wakeup(idle_end - next_timer);
+                    }
                     _total_sleep += idle_end - start_sleep;
                     _task_quota_timer.timerfd_settime(0, task_quote_itimerspec);
                 }
@@ -3666,10 +4205,25 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , poll_mode(*this, "poll-mode", "poll continuously (100% cpu use)")
     , idle_poll_time_us(*this, "idle-poll-time-us", reactor::calculate_poll_time() / 1us,
                 "idle polling time in microseconds (reduce for overprovisioned environments or laptops)")
+    , idle_poll_governor(*this, "idle-poll-governor", false,
+                "adapt the idle polling time, up to idle-poll-time-us, to how long the shard stays idle between requests")
     , poll_aio(*this, "poll-aio", true,
                 "busy-poll for disk I/O (reduces latency and increases throughput)")
     , task_quota_ms(*this, "task-quota-ms", 0.5, "Max time (ms) between polls")
     , io_latency_goal_ms(*this, "io-latency-goal-ms", {}, "Max time (ms) io operations must take (1.5 * task-quota-ms if not set)")
+    , io_latency_target_ms(*this, "io-latency-target-ms", {},
+                "Scale the disk dispatch rate to keep the mean time (ms) requests spend in the disk around this value"
+                " (fixed rates from the I/O properties if not set)")
+    , io_rate_min_ratio(*this, "io-rate-min-ratio", 0.1,
+                "Lowest fraction of the configured disk rates to dispatch at (see --io-latency-target-ms)")
+    , io_rate_max_ratio(*this, "io-rate-max-ratio", 1.0,
+                "Highest fraction of the configured disk rates to dispatch at (see --io-latency-target-ms)")
+    , io_capacity_borrowing(*this, "io-capacity-borrowing", false,
+                "let shards with queued I/O use the dispatch capacity idle shards of the same I/O group leave unused")
+    , io_merge_reads(*this, "io-merge-reads", false,
+                "merge queued adjacent reads of the same file and class into one disk request")
+    , io_merge_max_gap(*this, "io-merge-max-gap", 0,
+                "largest hole (bytes) between reads merged by --io-merge-reads; the hole is read and dropped")
     , max_task_backlog(*this, "max-task-backlog", 1000, "Maximum number of task backlog to allow; above this we ignore I/O")
     , blocked_reactor_notify_ms(*this, "blocked-reactor-notify-ms", 25, "threshold in miliseconds over which the reactor is considered blocked if no progress is made")
     , blocked_reactor_reports_per_minute(*this, "blocked-reactor-reports-per-minute", 5, "Maximum number of backtraces reported by stall detector per minute")
@@ -3698,11 +4252,38 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , max_networking_io_control_blocks(*this, "max-networking-io-control-blocks", 10000,
                 "Maximum number of I/O control blocks (IOCBs) to allocate per shard. This translates to the number of sockets supported per shard."
                 " Requires tuning /proc/sys/fs/aio-max-nr. Only valid for the linux-aio reactor backend (see --reactor-backend).")
+    , io_uring_register_buffers(*this, "io-uring-register-buffers", false,
+                "Register the shard memory with io_uring and use fixed-buffer operations for disk I/O."
+                " Locks all of the shard memory up front. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_register_files(*this, "io-uring-register-files", false,
+                "Register open disk files with io_uring and use the fixed file table for disk I/O."
+                " Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_sqpoll(*this, "io-uring-sqpoll", false,
+                "Let a kernel thread poll the io_uring submission queue, saving the submission system calls."
+                " Requires Linux 5.11 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_sqpoll_pin_to_sibling(*this, "io-uring-sqpoll-pin-to-sibling", false,
+                "Pin the io_uring submission queue polling thread to a hyperthread sibling of the shard's CPU (see --io-uring-sqpoll)")
+    , io_uring_sqpoll_idle_ms(*this, "io-uring-sqpoll-idle-ms", 0,
+                "Time (ms) the io_uring submission queue polling thread spins without submissions before it sleeps"
+                " (0 for the kernel default, see --io-uring-sqpoll)")
+    , io_uring_queue_len(*this, "io-uring-queue-len", 0,
+                "Number of io_uring submission queue entries per shard (0 to derive it from the disk request rate and the I/O latency goal)."
+                " Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_multishot(*this, "io-uring-multishot", false,
+                "Use multishot accept and multishot receive (with kernel-provided buffers) for sockets."
+                " Requires Linux 6.0 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_iopoll(*this, "io-uring-iopoll", false,
+                "Complete reads and writes of block devices that support polling (e.g. NVMe with poll queues) by polling instead of interrupts."
+                " Requires Linux 5.10 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , zerocopy_send_threshold(*this, "zerocopy-send-threshold", 0,
+                "Send TCP payloads of at least this many bytes without copying them into the kernel (0 to always copy)")
 #ifdef SEASTAR_HEAPPROF
     , heapprof(*this, "heapprof", "enable seastar heap profiling")
 #else
     , heapprof(*this, "heapprof", program_options::unused{})
 #endif
+    , heap_sampling_rate(*this, "heap-sampling-rate", 0,
+                "Sample one allocation per this many allocated bytes on average for the sampling heap profiler (0 to disable)")
     , no_handle_interrupt(*this, "no-handle-interrupt", "ignore SIGINT (for gdb)")
 {
 }
@@ -3898,6 +4479,12 @@ class disk_config_params {
     unsigned _num_io_groups = 0;
     std::unordered_map<dev_t, mountpoint_params> _mountpoints;
     std::chrono::duration<double> _latency_goal;
+    std::chrono::duration<double> _latency_target{0};
+    double _rate_min_ratio = 0.1;
+    double _rate_max_ratio = 1.0;
+    bool _capacity_borrowing = false;
+    bool _merge_reads = false;
+    size_t _read_merge_gap = 0;
 
 public:
     uint64_t per_io_group(uint64_t qty, unsigned nr_groups) const noexcept {
@@ -3921,6 +4508,19 @@ class disk_config_params {
         _latency_goal = std::chrono::duration_cast<std::chrono::duration<double>>(latency_goal_opt(reactor_opts) * 1ms);
         seastar_logger.debug("latency_goal: {}", latency_goal().count());
 
+        if (reactor_opts.io_latency_target_ms) {
+            _latency_target = std::chrono::duration_cast<std::chrono::duration<double>>(reactor_opts.io_latency_target_ms.get_value() * 1ms);
+            _rate_min_ratio = reactor_opts.io_rate_min_ratio.get_value();
+            _rate_max_ratio = reactor_opts.io_rate_max_ratio.get_value();
+            if (_latency_target.count() <= 0 || _rate_min_ratio <= 0 || _rate_min_ratio > _rate_max_ratio) {
+                throw std::runtime_error("io-latency-target-ms must be positive and io-rate-min-ratio must be positive and not above io-rate-max-ratio");
+            }
+        }
+
+        _capacity_borrowing = reactor_opts.io_capacity_borrowing.get_value();
+        _merge_reads = reactor_opts.io_merge_reads.get_value();
+        _read_merge_gap = reactor_opts.io_merge_max_gap.get_value();
+
         if (smp_opts.num_io_groups) {
             _num_io_groups = smp_opts.num_io_groups.get_value();
             if (!_num_io_groups) {
@@ -3979,6 +4579,38 @@ class disk_config_params {
         _mountpoints.emplace(0, d);
     }
 
+    // The scheduler assumes the disk can sustain one unit of capacity per
+    // second, where a request costs 1/iops + size/bandwidth of its direction.
+    // Under mixed load the disk may deliver less than that with the latency
+    // within the goal. For every measured mix take the best throughput that
+    // met the goal (or the lowest latency one if none did) and see how much
+    // capacity it is worth. The least of those is what the disk can do.
+    float mixed_workload_factor(const mountpoint_params& p) const {
+        std::map<float, const mixed_workload_params*> best;
+        auto cost = [&p] (const mixed_workload_params& w) {
+            return double(w.read_iops) / p.read_req_rate + double(w.read_bandwidth) / p.read_bytes_rate +
+                    double(w.write_iops) / p.write_req_rate + double(w.write_bandwidth) / p.write_bytes_rate;
+        };
+        for (auto& w : p.mixed_workloads) {
+            auto& b = best[w.read_ratio];
+            bool meets_goal = w.p99_latency <= latency_goal();
+            if (!b) {
+                b = &w;
+            } else if (b->p99_latency <= latency_goal()) {
+                if (meets_goal && cost(w) > cost(*b)) {
+                    b = &w;
+                }
+            } else if (meets_goal || w.p99_latency < b->p99_latency) {
+                b = &w;
+            }
+        }
+        double factor = 1.0;
+        for (auto& b : best) {
+            factor = std::min(factor, cost(*b.second));
+        }
+        return factor > 0 ? factor : 1.0;
+    }
+
     struct io_queue::config generate_config(dev_t devid, unsigned nr_groups) const {
         seastar_logger.debug("generate_config dev_id: {}", devid);
         const mountpoint_params& p = _mountpoints.at(devid);
@@ -3993,6 +4625,10 @@ class disk_config_params {
         if (p.read_req_rate != std::numeric_limits<uint64_t>::max()) {
             cfg.req_count_rate = io_queue::read_request_base_count * (unsigned long)per_io_group(p.read_req_rate, nr_groups);
             cfg.disk_req_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_req_rate) / p.write_req_rate;
+            // Unconfigured disks are not throttled at all, so there is nothing to scale
+            cfg.latency_target = _latency_target;
+            cfg.min_rate_scale = _rate_min_ratio;
+            cfg.max_rate_scale = _rate_max_ratio;
         }
         if (p.read_saturation_length != std::numeric_limits<uint64_t>::max()) {
             cfg.disk_read_saturation_length = p.read_saturation_length;
@@ -4003,7 +4639,16 @@ class disk_config_params {
         cfg.mountpoint = p.mountpoint;
         cfg.duplex = p.duplex;
         cfg.rate_factor = p.rate_factor;
+        if (!p.mixed_workloads.empty() && p.read_req_rate != std::numeric_limits<uint64_t>::max()) {
+            auto factor = mixed_workload_factor(p);
+            seastar_logger.info("Mixed workloads on {} fit the {:.2f}ms latency goal at {:.2f} of the configured capacity",
+                    p.mountpoint, latency_goal().count() * 1000, factor);
+            cfg.rate_factor *= factor;
+        }
         cfg.rate_limit_duration = latency_goal();
+        cfg.capacity_borrowing = _capacity_borrowing;
+        cfg.merge_reads = _merge_reads;
+        cfg.read_merge_gap = _read_merge_gap;
         // Block count limit should not be less than the minimal IO size on the device
         // On the other hand, even this is not good enough -- in the worst case the
         // scheduler will self-tune to allow for the single 64k request, while it would
@@ -4016,8 +4661,33 @@ class disk_config_params {
     auto device_ids() {
         return boost::adaptors::keys(_mountpoints);
     }
+
+    // How many requests a single shard may have in flight to the device.
+    // The I/O scheduler lets the whole group's request rate through during
+    // one latency goal period, and a shard can be the only one dispatching.
+    uint64_t max_in_flight(dev_t devid, unsigned nr_groups) const {
+        const mountpoint_params& p = _mountpoints.at(devid);
+        if (p.read_req_rate == std::numeric_limits<uint64_t>::max()) {
+            return 0;
+        }
+        return per_io_group(p.read_req_rate, nr_groups) * latency_goal().count();
+    }
 };
 
+// Picks the io_uring ring size for --io-uring-queue-len=0. Disks without
+// io-properties have no known request rate and get the default size.
+static unsigned io_uring_auto_queue_len(const disk_config_params& disk_config, const resource::resources& resources) {
+    constexpr unsigned min_len = 256;
+    constexpr unsigned max_len = 4096;
+    // Sockets, timers and fsync()s share the ring with disk I/O
+    constexpr unsigned other_requests = 64;
+    uint64_t in_flight = other_requests;
+    for (auto&& [devid, io_info] : resources.ioq_topology) {
+        in_flight += disk_config.max_in_flight(devid, io_info.groups.size());
+    }
+    return std::clamp<uint64_t>(uint64_t(1) << log2ceil(in_flight), min_len, max_len);
+}
+
 unsigned smp::adjust_max_networking_aio_io_control_blocks(unsigned network_iocbs)
 {
     static unsigned constexpr storage_iocbs = reactor::max_aio;
@@ -4215,6 +4885,18 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     reactor_config reactor_cfg;
     reactor_cfg.auto_handle_sigint_sigterm = reactor_opts._auto_handle_sigint_sigterm;
     reactor_cfg.max_networking_aio_io_control_blocks = adjust_max_networking_aio_io_control_blocks(reactor_opts.max_networking_io_control_blocks.get_value());
+    reactor_cfg.io_uring_register_buffers = reactor_opts.io_uring_register_buffers.get_value();
+    reactor_cfg.io_uring_register_files = reactor_opts.io_uring_register_files.get_value();
+    reactor_cfg.io_uring_sqpoll = reactor_opts.io_uring_sqpoll.get_value();
+    reactor_cfg.io_uring_sqpoll_pin_to_sibling = reactor_opts.io_uring_sqpoll_pin_to_sibling.get_value();
+    reactor_cfg.io_uring_sqpoll_idle_ms = reactor_opts.io_uring_sqpoll_idle_ms.get_value();
+    reactor_cfg.io_uring_queue_len = reactor_opts.io_uring_queue_len.get_value();
+    if (!reactor_cfg.io_uring_queue_len) {
+        reactor_cfg.io_uring_queue_len = io_uring_auto_queue_len(disk_config, resources);
+    }
+    reactor_cfg.io_uring_multishot = reactor_opts.io_uring_multishot.get_value();
+    reactor_cfg.io_uring_iopoll = reactor_opts.io_uring_iopoll.get_value();
+    reactor_cfg.zerocopy_send_threshold = reactor_opts.zerocopy_send_threshold.get_value();
 
 #ifdef SEASTAR_HEAPPROF
     bool heapprof_enabled = reactor_opts.heapprof;
@@ -4224,6 +4906,10 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 #else
     bool heapprof_enabled = false;
 #endif
+    size_t heap_sampling_rate = reactor_opts.heap_sampling_rate.get_value();
+    if (heap_sampling_rate) {
+        memory::set_heap_sampling_rate(heap_sampling_rate);
+    }
 
 #ifdef SEASTAR_HAVE_DPDK
     if (_using_dpdk) {
@@ -4301,7 +4987,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     auto smp_tmain = smp::_tmain;
     for (i = 1; i < smp::count; i++) {
         auto allocation = allocations[i];
-        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_enabled, mbind, backend_selector, reactor_cfg] {
+        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_enabled, heap_sampling_rate, mbind, backend_selector, reactor_cfg] {
           try {
             // initialize thread_locals that are equal across all reacto threads of this smp instance
             smp::_tmain = smp_tmain;
@@ -4316,6 +5002,9 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
             if (heapprof_enabled) {
                 memory::set_heap_profiling_enabled(heapprof_enabled);
             }
+            if (heap_sampling_rate) {
+                memory::set_heap_sampling_rate(heap_sampling_rate);
+            }
             sigset_t mask;
             sigfillset(&mask);
             for (auto sig : { SIGSEGV }) {
@@ -21,19 +21,23 @@
 #include "core/reactor_backend.hh"
 #include "core/thread_pool.hh"
 #include "core/syscall_result.hh"
+#include <seastar/core/bitops.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 #include <seastar/core/internal/uname.hh>
+#include <seastar/core/metrics.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/read_first_line.hh>
+#include <boost/intrusive/list.hpp>
 
 #include <chrono>
 #include <filesystem>
 #include <sys/poll.h>
 #include <sys/syscall.h>
 #include <sys/resource.h>
+#include <sys/sysmacros.h>
 
 #ifdef SEASTAR_HAVE_URING
 #include <liburing.h>
@@ -51,9 +55,16 @@ using namespace internal::linux_abi;
 namespace fs = std::filesystem;
 
 class pollable_fd_state_completion : public kernel_completion {
+    pollable_fd_state* _fd = nullptr;
     promise<> _pr;
 public:
+    pollable_fd_state_completion() = default;
+    // Completes the polls of the kernel with the ready events
+    explicit pollable_fd_state_completion(pollable_fd_state& fd) noexcept : _fd(&fd) {}
     virtual void complete_with(ssize_t res) override {
+        if (_fd && res > 0 && (res & POLLERR)) {
+            _fd->reap_zerocopy();
+        }
         _pr.set_value();
     }
     future<> get_future() {
@@ -572,6 +583,9 @@ class aio_pollable_fd_state : public pollable_fd_state {
     }
     explicit aio_pollable_fd_state(file_desc fd, speculation speculate)
         : pollable_fd_state(std::move(fd), std::move(speculate))
+        , _completion_pollin(*this)
+        , _completion_pollout(*this)
+        , _completion_pollrdhup(*this)
     {}
     future<> get_completion_future(int events) {
         return get_desc(events)->get_future();
@@ -591,7 +605,7 @@ future<> reactor_backend_aio::poll(pollable_fd_state& fd, int events) {
         auto* iocb = pfd->get_iocb(events);
         auto* desc = pfd->get_desc(events);
         *iocb = make_poll_iocb(fd.fd.get(), events);
-        *desc = pollable_fd_state_completion{};
+        *desc = pollable_fd_state_completion(fd);
         set_user_data(*iocb, desc);
         _polling_io.queue(iocb);
         return pfd->get_completion_future(events);
@@ -660,6 +674,21 @@ reactor_backend_aio::sendmsg(pollable_fd_state& fd, net::packet& p) {
     return _r.do_sendmsg(fd, p);
 }
 
+future<size_t>
+reactor_backend_aio::sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) {
+    return _r.do_sendmsg_zerocopy(fd, p);
+}
+
+future<size_t>
+reactor_backend_aio::recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return _r.do_recvmmsg(fd, msgs, n);
+}
+
+future<size_t>
+reactor_backend_aio::sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return _r.do_sendmmsg(fd, msgs, n);
+}
+
 future<temporary_buffer<char>>
 reactor_backend_aio::recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) {
     return _r.do_recv_some(fd, ba);
@@ -840,6 +869,9 @@ reactor_backend_epoll::wait_and_process(int timeout, const sigset_t* active_sigm
             _steady_clock_timer_deadline = {};
             continue;
         }
+        if (evt.events & EPOLLERR) {
+            pfd->reap_zerocopy();
+        }
         if (evt.events & (EPOLLHUP | EPOLLERR)) {
             // treat the events as required events when error occurs, let
             // send/recv/accept/connect handle the specific error.
@@ -1045,6 +1077,21 @@ reactor_backend_epoll::sendmsg(pollable_fd_state& fd, net::packet& p) {
     return _r.do_sendmsg(fd, p);
 }
 
+future<size_t>
+reactor_backend_epoll::sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) {
+    return _r.do_sendmsg_zerocopy(fd, p);
+}
+
+future<size_t>
+reactor_backend_epoll::recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return _r.do_recvmmsg(fd, msgs, n);
+}
+
+future<size_t>
+reactor_backend_epoll::sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return _r.do_sendmmsg(fd, msgs, n);
+}
+
 future<temporary_buffer<char>>
 reactor_backend_epoll::recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) {
     return _r.do_recv_some(fd, ba);
@@ -1156,6 +1203,21 @@ reactor_backend_osv::sendmsg(pollable_fd_state& fd, net::packet& p) {
     return engine().do_sendmsg(fd, p);
 }
 
+future<size_t>
+reactor_backend_osv::sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) {
+    return sendmsg(fd, p);
+}
+
+future<size_t>
+reactor_backend_osv::recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return engine().do_recvmmsg(fd, msgs, n);
+}
+
+future<size_t>
+reactor_backend_osv::sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) {
+    return engine().do_sendmmsg(fd, msgs, n);
+}
+
 future<temporary_buffer<char>>
 reactor_backend_osv::recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) {
     return engine().do_recv_some(fd, p);
@@ -1175,12 +1237,24 @@ reactor_backend_osv::make_pollable_fd_state(file_desc fd, pollable_fd::speculati
 
 #ifdef SEASTAR_HAVE_URING
 
+// Provided buffer rings and the multishot helpers appeared in liburing 2.4,
+// the first release to also define its version. Zero-copy sends are a bit
+// older (2.3), but can't be told apart by the version.
+#if defined(IO_URING_VERSION_MAJOR) && (IO_URING_VERSION_MAJOR > 2 || IO_URING_VERSION_MINOR >= 4)
+#define SEASTAR_HAVE_URING_MULTISHOT
+#define SEASTAR_HAVE_URING_SEND_ZC
+#endif
+
 static
 std::optional<::io_uring>
-try_create_uring(unsigned queue_len, bool throw_on_error) {
+try_create_uring(unsigned queue_len, bool throw_on_error, ::io_uring_params params = {}) {
     auto required_features =
             IORING_FEAT_SUBMIT_STABLE
             | IORING_FEAT_NODROP;
+    if (params.flags & IORING_SETUP_SQPOLL) {
+        // Older kernels can only poll for requests on fixed files
+        required_features |= IORING_FEAT_SQPOLL_NONFIXED;
+    }
     auto required_ops = {
             IORING_OP_POLL_ADD, // linux 5.1
             IORING_OP_READV,
@@ -1201,9 +1275,6 @@ try_create_uring(unsigned queue_len, bool throw_on_error) {
         }
     };
 
-    auto params = ::io_uring_params{
-        .flags = 0,
-    };
     ::io_uring ring;
     auto err = ::io_uring_queue_init_params(queue_len, &ring, &params);
     if (err != 0) {
@@ -1235,6 +1306,24 @@ try_create_uring(unsigned queue_len, bool throw_on_error) {
     return ring;
 }
 
+static
+std::optional<unsigned>
+hyperthread_sibling(unsigned cpu) {
+    try {
+        auto siblings = resource::parse_cpuset(read_first_line(fmt::format("/sys/devices/system/cpu/cpu{}/topology/thread_siblings_list", cpu)));
+        if (siblings) {
+            for (auto sibling : *siblings) {
+                if (sibling != cpu) {
+                    return sibling;
+                }
+            }
+        }
+    } catch (...) {
+        seastar_logger.debug("Cannot read hyperthread siblings of cpu {}: {}", cpu, std::current_exception());
+    }
+    return std::nullopt;
+}
+
 static
 bool
 have_md_devices() {
@@ -1276,24 +1365,182 @@ detect_io_uring() {
 }
 
 class reactor_backend_uring final : public reactor_backend {
-    // s_queue_len is more or less arbitrary. Too low and we'll be
-    // issuing too small batches, too high and we require too much locked
-    // memory, but otherwise it doesn't matter.
-    static constexpr unsigned s_queue_len = 200;  
+    // The ring length comes from reactor_config::io_uring_queue_len. Too low
+    // and we'll be issuing too small batches and stalling on a full
+    // submission queue, too high and we require too much locked memory.
+    // It cannot go below s_min_queue_len, since linked chains of up to
+    // s_max_sendmsg_chain entries must fit in the submission queue whole.
+    static constexpr unsigned s_min_queue_len = 64;
+    // Completions reaped from the ring in one go
+    static constexpr unsigned s_completion_batch = 256;
+    // The kernel refuses to register a single buffer larger than 1GB, so the
+    // shard memory is registered as a series of buffers of that size.
+    static constexpr size_t s_registered_buffer_size = size_t(1) << 30;
+    // Size of the fixed file table, files opened beyond that are accessed
+    // by their regular descriptors.
+    static constexpr unsigned s_fixed_files = 4096;
     reactor& _r;
     ::io_uring _uring;
+    uint64_t _sqpoll_wakeups = 0;
+    // Times a submission had to wait for the submission queue to drain
+    uint64_t _sqe_starvations = 0;
+    // Submitted requests whose final completion was not reaped yet
+    uint64_t _in_flight = 0;
+    uint64_t _peak_in_flight = 0;
+    bool _reported_short_ring = false;
+    bool _have_send_zc = false;
+    metrics::metric_groups _metrics;
     bool _did_work_while_getting_sqe = false;
     bool _has_pending_submissions = false;
+    uintptr_t _registered_memory_start = 0;
+    uintptr_t _registered_memory_end = 0;
+    struct fixed_file {
+        int slot = -1;
+        unsigned refs = 0;
+    };
+    // Indexed by file descriptor
+    std::vector<fixed_file> _fixed_files;
+    std::vector<int> _free_fixed_file_slots;
+    bool _have_fixed_file_table = false;
+    // Block device reads and writes completed by polling rather than by
+    // interrupts go to this ring (see reactor_options::io_uring_iopoll).
+    // It only accepts O_DIRECT I/O, so everything else stays on _uring.
+    std::optional<::io_uring> _iopoll_ring;
+    // Indexed by file descriptor
+    std::vector<bool> _polled_files;
+    std::unordered_map<dev_t, bool> _device_polls;
+    unsigned _polled_in_flight = 0;
+    uint64_t _polled_requests = 0;
+    bool _has_pending_polled_submissions = false;
     file_desc _hrtimer_timerfd;
     preempt_io_context _preempt_io_context;
 
+    // Multishot requests post many completions for a single submission, and
+    // need to see the completion flags. They are told apart from the regular
+    // kernel_completion-s by the lowest bit of the user data.
+    class multishot_completion {
+    protected:
+        ~multishot_completion() = default;
+    public:
+        virtual void complete_with(int res, unsigned flags) = 0;
+    };
+    static constexpr uintptr_t s_multishot_tag = 1;
+
+    // A write linked (IOSQE_IO_LINK) with the fdatasync that follows it. The
+    // kernel posts a completion for each of the two, the request completes
+    // when both are in. A short or failed write breaks the link and the sync
+    // is cancelled, in which case the write result is reported and it's up to
+    // the caller to sync what was written.
+    class linked_write_fdatasync_completion {
+        struct link final : public kernel_completion {
+            linked_write_fdatasync_completion& _owner;
+            ssize_t _res = 0;
+            explicit link(linked_write_fdatasync_completion& owner) noexcept : _owner(owner) {}
+            virtual void complete_with(ssize_t res) override {
+                _res = res;
+                _owner.link_completed();
+            }
+        };
+        io_completion* _completion;
+        size_t _size;
+        unsigned _pending = 2;
+        link _write{*this};
+        link _sync{*this};
+
+        void link_completed() noexcept {
+            if (--_pending) {
+                return;
+            }
+            auto res = _write._res;
+            if (res >= 0 && _sync._res < 0 && !(_sync._res == -ECANCELED && size_t(res) < _size)) {
+                res = _sync._res;
+            }
+            _completion->complete_with(res);
+            delete this;
+        }
+    public:
+        linked_write_fdatasync_completion(io_completion* completion, size_t size) noexcept
+            : _completion(completion), _size(size) {}
+        kernel_completion* write_link() noexcept { return &_write; }
+        kernel_completion* sync_link() noexcept { return &_sync; }
+    };
+    // Completes a batch of sendmsg requests submitted as one linked chain,
+    // once all of their CQEs have arrived. A failed link cancels the rest
+    // of the chain, so the messages sent are always a prefix of the batch.
+    class linked_sendmsg_completion {
+        struct link final : public kernel_completion {
+            linked_sendmsg_completion* _owner = nullptr;
+            ssize_t _res = 0;
+            virtual void complete_with(ssize_t res) override {
+                _res = res;
+                _owner->link_completed();
+            }
+        };
+        pollable_fd_state& _fd;
+        ::mmsghdr* _msgs;
+        size_t _nr;
+        size_t _pending;
+        std::unique_ptr<link[]> _links;
+        promise<size_t> _result;
+
+        void link_completed() noexcept {
+            if (--_pending) {
+                return;
+            }
+            size_t sent = 0;
+            while (sent < _nr && _links[sent]._res >= 0) {
+                _msgs[sent].msg_len = _links[sent]._res;
+                ++sent;
+            }
+            if (sent == _nr) {
+                _fd.speculate_epoll(EPOLLOUT);
+            }
+            if (sent || _links[0]._res == -EAGAIN) {
+                // Zero tells the caller to wait for the socket to drain
+                _result.set_value(sent);
+            } else {
+                _result.set_exception(std::system_error(-_links[0]._res, std::system_category(), "sendmmsg"));
+            }
+            delete this;
+        }
+    public:
+        linked_sendmsg_completion(pollable_fd_state& fd, ::mmsghdr* msgs, size_t nr)
+                : _fd(fd), _msgs(msgs), _nr(nr), _pending(nr), _links(new link[nr]) {
+            for (size_t i = 0; i < nr; i++) {
+                _links[i]._owner = this;
+            }
+        }
+        kernel_completion* link_at(size_t i) noexcept { return &_links[i]; }
+        future<size_t> get_future() { return _result.get_future(); }
+    };
+    // Longest chain of sendmsg requests a batched send is split into
+    static constexpr size_t s_max_sendmsg_chain = 32;
+    // How many accepted connections or received buffers may pile up on a
+    // socket nobody reads from, before its multishot request is cancelled
+    static constexpr size_t s_max_multishot_backlog = 64;
+    // Buffers provided to the kernel for multishot receive. The ring size
+    // must be a power of two.
+    static constexpr unsigned s_recv_buffer_ring_entries = 512;
+    static constexpr size_t s_recv_buffer_size = 8192;
+    static constexpr int s_recv_buffer_group = 0;
+
+    class multishot_accept;
+    class multishot_recv;
+
     class uring_pollable_fd_state : public pollable_fd_state {
         pollable_fd_state_completion _completion_pollin;
         pollable_fd_state_completion _completion_pollout;
         pollable_fd_state_completion _completion_pollrdhup;
+    public:
+        multishot_accept* _multishot_accept = nullptr;
+        multishot_recv* _multishot_recv = nullptr;
+        std::optional<bool> _send_zc_capable;
     public:
         explicit uring_pollable_fd_state(file_desc desc, speculation speculate)
-                : pollable_fd_state(std::move(desc), std::move(speculate)) {
+                : pollable_fd_state(std::move(desc), std::move(speculate))
+                , _completion_pollin(*this)
+                , _completion_pollout(*this)
+                , _completion_pollrdhup(*this) {
         }
         pollable_fd_state_completion* get_desc(int events) {
             if (events & POLLIN) {
@@ -1351,6 +1598,419 @@ class reactor_backend_uring final : public reactor_backend {
 
     using smp_wakeup_completion = recurring_eventfd_or_timerfd_completion;
 
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    // Buffers the kernel picks from for multishot receive. A buffer handed
+    // over to the application is immediately replaced by a fresh one.
+    class provided_buffer_ring {
+        ::io_uring& _uring;
+        ::io_uring_buf_ring* _ring;
+        std::vector<temporary_buffer<char>> _buffers;
+        std::vector<unsigned> _missing;
+    private:
+        explicit provided_buffer_ring(::io_uring& uring, ::io_uring_buf_ring* ring)
+                : _uring(uring), _ring(ring), _buffers(s_recv_buffer_ring_entries) {
+            _missing.reserve(s_recv_buffer_ring_entries);
+            for (unsigned bid = 0; bid < s_recv_buffer_ring_entries; bid++) {
+                provide(bid);
+            }
+        }
+        void provide(unsigned bid) noexcept {
+            try {
+                _buffers[bid] = temporary_buffer<char>(s_recv_buffer_size);
+            } catch (...) {
+                // Retried when the next buffer is taken
+                _missing.push_back(bid);
+                return;
+            }
+            ::io_uring_buf_ring_add(_ring, _buffers[bid].get_write(), s_recv_buffer_size, bid,
+                    ::io_uring_buf_ring_mask(s_recv_buffer_ring_entries), 0);
+            ::io_uring_buf_ring_advance(_ring, 1);
+        }
+    public:
+        static std::unique_ptr<provided_buffer_ring> create(::io_uring& uring) {
+            int err = 0;
+            auto ring = ::io_uring_setup_buf_ring(&uring, s_recv_buffer_ring_entries, s_recv_buffer_group, 0, &err);
+            if (!ring) {
+                seastar_logger.warn("Cannot register provided buffers with io_uring: {}", std::system_category().message(-err));
+                return nullptr;
+            }
+            return std::unique_ptr<provided_buffer_ring>(new provided_buffer_ring(uring, ring));
+        }
+        ~provided_buffer_ring() {
+            ::io_uring_free_buf_ring(&_uring, _ring, s_recv_buffer_ring_entries, s_recv_buffer_group);
+        }
+        temporary_buffer<char> take(unsigned bid, size_t len) noexcept {
+            auto buf = std::move(_buffers[bid]);
+            buf.trim(len);
+            provide(bid);
+            refill();
+            return buf;
+        }
+        // Retries providing the buffers that could not be allocated before.
+        // Returns whether the kernel has any buffer to pick.
+        bool refill() noexcept {
+            while (!_missing.empty()) {
+                auto missing = _missing.back();
+                _missing.pop_back();
+                auto still_missing = _missing.size();
+                provide(missing);
+                if (_missing.size() > still_missing) {
+                    break;
+                }
+            }
+            return _missing.size() < s_recv_buffer_ring_entries;
+        }
+    };
+    std::unique_ptr<provided_buffer_ring> _recv_buffer_ring;
+
+    // Multishot requests on a socket. The backend keeps track of all of
+    // them, so that the ones left over at teardown can be cancelled and
+    // freed; an object leaves the list when it is deleted.
+    class socket_multishot : public multishot_completion {
+    public:
+        boost::intrusive::list_member_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>> _link;
+        // Detaches the request from its socket; see multishot_accept::orphan()
+        virtual void orphan() noexcept = 0;
+        virtual bool orphaned() const noexcept = 0;
+    protected:
+        explicit socket_multishot(reactor_backend_uring& be) noexcept {
+            be._socket_multishots.push_back(*this);
+        }
+        ~socket_multishot() = default;
+    };
+    using socket_multishot_list = boost::intrusive::list<socket_multishot,
+            boost::intrusive::member_hook<socket_multishot, decltype(socket_multishot::_link), &socket_multishot::_link>,
+            boost::intrusive::constant_time_size<false>>;
+    socket_multishot_list _socket_multishots;
+
+    // Keeps accepting connections on a listening socket, queueing them until
+    // accept() is called.
+    class multishot_accept final : public socket_multishot {
+        reactor_backend_uring& _be;
+        pollable_fd_state* _listenfd; // null after the socket is forgotten
+        bool _armed = false;
+        circular_buffer<int> _accepted;
+        std::exception_ptr _error;
+        std::optional<promise<std::tuple<pollable_fd, socket_address>>> _waiter;
+    private:
+        static std::tuple<pollable_fd, socket_address> make_result(int fd) {
+            auto fdesc = file_desc::from_fd(fd);
+            socket_address sa;
+            ::getpeername(fd, &sa.as_posix_sockaddr(), &sa.addr_length);
+            return {pollable_fd(std::move(fdesc), pollable_fd::speculation(EPOLLOUT)), std::move(sa)};
+        }
+        void maybe_arm() {
+            if (!_armed) {
+                auto sqe = _be.get_sqe();
+                ::io_uring_prep_multishot_accept(sqe, _listenfd->fd.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                _be.set_multishot_data(sqe, this);
+                _armed = true;
+            }
+        }
+        void set_error(std::exception_ptr eptr) noexcept {
+            if (_waiter) {
+                _waiter->set_exception(std::move(eptr));
+                _waiter.reset();
+            } else {
+                _error = std::move(eptr);
+            }
+        }
+    public:
+        multishot_accept(reactor_backend_uring& be, pollable_fd_state& listenfd) noexcept
+                : socket_multishot(be), _be(be), _listenfd(&listenfd) {}
+        future<std::tuple<pollable_fd, socket_address>> get() {
+            if (!_accepted.empty()) {
+                auto fd = _accepted.front();
+                _accepted.pop_front();
+                return futurize_invoke(make_result, fd);
+            }
+            if (_error) {
+                return make_exception_future<std::tuple<pollable_fd, socket_address>>(std::exchange(_error, nullptr));
+            }
+            maybe_arm();
+            _waiter.emplace();
+            return _waiter->get_future();
+        }
+        virtual void complete_with(int res, unsigned flags) override {
+            if (!(flags & IORING_CQE_F_MORE)) {
+                _armed = false;
+            }
+            if (!_listenfd) {
+                if (res >= 0) {
+                    ::close(res);
+                }
+                if (!_armed) {
+                    delete this;
+                }
+                return;
+            }
+            if (res >= 0) {
+                if (_waiter) {
+                    try {
+                        _waiter->set_value(make_result(res));
+                    } catch (...) {
+                        _waiter->set_exception(std::current_exception());
+                    }
+                    _waiter.reset();
+                } else {
+                    try {
+                        _accepted.push_back(res);
+                    } catch (...) {
+                        ::close(res);
+                    }
+                    if (_armed && _accepted.size() >= s_max_multishot_backlog) {
+                        _be.cancel_multishot(this);
+                    }
+                }
+            } else if (res != -ECANCELED) {
+                auto eptr = std::make_exception_ptr(std::system_error(-res, std::system_category()));
+                if (res == -EINVAL) {
+                    try {
+                        // The chances are that we shutting down the connection.
+                        _listenfd->maybe_no_more_recv();
+                    } catch (...) {
+                        eptr = std::current_exception();
+                    }
+                }
+                set_error(std::move(eptr));
+            }
+            if (_waiter) {
+                maybe_arm();
+            }
+        }
+        // Called when the socket is forgotten; the object frees itself once
+        // the kernel is done with it
+        virtual void orphan() noexcept override {
+            _listenfd = nullptr;
+            _waiter.reset();
+            for (auto fd : _accepted) {
+                ::close(fd);
+            }
+            _accepted.clear();
+            if (_armed) {
+                _be.cancel_multishot(this);
+            } else {
+                delete this;
+            }
+        }
+        virtual bool orphaned() const noexcept override {
+            return !_listenfd;
+        }
+    };
+
+    // Keeps receiving into provided buffers, queueing them until
+    // recv_some() is called.
+    class multishot_recv final : public socket_multishot {
+        reactor_backend_uring& _be;
+        pollable_fd_state* _fd; // null after the socket is forgotten
+        bool _armed = false;
+        circular_buffer<temporary_buffer<char>> _received;
+        std::exception_ptr _error;
+        std::optional<promise<temporary_buffer<char>>> _waiter;
+    private:
+        void maybe_arm() {
+            if (!_armed) {
+                auto sqe = _be.get_sqe();
+                ::io_uring_prep_recv_multishot(sqe, _fd->fd.get(), nullptr, 0, 0);
+                sqe->flags |= IOSQE_BUFFER_SELECT;
+                sqe->buf_group = s_recv_buffer_group;
+                _be.set_multishot_data(sqe, this);
+                _armed = true;
+            }
+        }
+        void deliver(temporary_buffer<char> buf) noexcept {
+            if (_waiter) {
+                _waiter->set_value(std::move(buf));
+                _waiter.reset();
+                return;
+            }
+            try {
+                _received.push_back(std::move(buf));
+            } catch (...) {
+                _error = std::current_exception();
+            }
+            if (_armed && _received.size() >= s_max_multishot_backlog) {
+                _be.cancel_multishot(this);
+            }
+        }
+        void set_error(std::exception_ptr eptr) noexcept {
+            if (_waiter) {
+                _waiter->set_exception(std::move(eptr));
+                _waiter.reset();
+            } else {
+                _error = std::move(eptr);
+            }
+        }
+    public:
+        multishot_recv(reactor_backend_uring& be, pollable_fd_state& fd) noexcept
+                : socket_multishot(be), _be(be), _fd(&fd) {}
+        future<temporary_buffer<char>> get() {
+            if (!_received.empty()) {
+                auto buf = std::move(_received.front());
+                _received.pop_front();
+                return make_ready_future<temporary_buffer<char>>(std::move(buf));
+            }
+            if (_error) {
+                return make_exception_future<temporary_buffer<char>>(std::exchange(_error, nullptr));
+            }
+            maybe_arm();
+            _waiter.emplace();
+            return _waiter->get_future();
+        }
+        virtual void complete_with(int res, unsigned flags) override {
+            if (!(flags & IORING_CQE_F_MORE)) {
+                _armed = false;
+            }
+            temporary_buffer<char> buf;
+            if (flags & IORING_CQE_F_BUFFER) {
+                buf = _be._recv_buffer_ring->take(flags >> IORING_CQE_BUFFER_SHIFT, std::max(res, 0));
+            }
+            if (!_fd) {
+                if (!_armed) {
+                    delete this;
+                }
+                return;
+            }
+            if (res >= 0) {
+                // Zero-sized buffer (EOF) also terminates the request
+                deliver(std::move(buf));
+            } else if (res == -ENOBUFS) {
+                // The buffers taken before are replaced by now, unless none
+                // could be allocated. Then re-arming would fail the same way.
+                if (!_be._recv_buffer_ring->refill()) {
+                    set_error(std::make_exception_ptr(std::bad_alloc()));
+                }
+            } else if (res != -ECANCELED) {
+                set_error(std::make_exception_ptr(std::system_error(-res, std::system_category())));
+            }
+            if (_waiter) {
+                maybe_arm();
+            }
+        }
+        virtual void orphan() noexcept override {
+            _fd = nullptr;
+            _waiter.reset();
+            _received.clear();
+            if (_armed) {
+                _be.cancel_multishot(this);
+            } else {
+                delete this;
+            }
+        }
+        virtual bool orphaned() const noexcept override {
+            return !_fd;
+        }
+    };
+
+    void cancel_multishot(multishot_completion* completion) noexcept {
+        auto sqe = get_sqe();
+        ::io_uring_prep_cancel64(sqe, reinterpret_cast<uintptr_t>(completion) | s_multishot_tag, 0);
+        // The cancellation's own completion is ignored
+        ::io_uring_sqe_set_data(sqe, nullptr);
+        _has_pending_submissions = true;
+    }
+
+    // Cancels the socket multishot requests still armed and waits for the
+    // kernel to let go of them, freeing them and the buffers they picked.
+    // Other completions are of no interest anymore and are dropped.
+    void retire_socket_multishots() noexcept {
+        for (auto it = _socket_multishots.begin(); it != _socket_multishots.end();) {
+            // Orphaning an unarmed request deletes it
+            auto& ms = *it++;
+            if (!ms.orphaned()) {
+                ms.orphan();
+            }
+        }
+        ::io_uring_submit(&_uring);
+        while (!_socket_multishots.empty()) {
+            ::io_uring_cqe* cqe;
+            ::__kernel_timespec timeout = { .tv_sec = 1, .tv_nsec = 0 };
+            if (::io_uring_wait_cqe_timeout(&_uring, &cqe, &timeout) < 0) {
+                seastar_logger.warn("io_uring multishot requests not cancelled in time, leaking them");
+                return;
+            }
+            auto user_data = cqe->user_data;
+            auto res = cqe->res;
+            auto flags = cqe->flags;
+            ::io_uring_cqe_seen(&_uring, cqe);
+            if (user_data & s_multishot_tag) {
+                auto completion = reinterpret_cast<multishot_completion*>(user_data & ~s_multishot_tag);
+                for (auto& ms : _socket_multishots) {
+                    if (&ms == completion) {
+                        ms.complete_with(res, flags);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+#endif
+
+    void set_multishot_data(::io_uring_sqe* sqe, multishot_completion* completion) noexcept {
+        ::io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(completion) | s_multishot_tag));
+        _has_pending_submissions = true;
+    }
+
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+    // The kernel posts the result of a zero-copy send first and then, unless
+    // the send failed, a notification once it no longer references the
+    // data. The packet is kept alive until that.
+    class zerocopy_send_completion final : public multishot_completion {
+        pollable_fd_state& _fd;
+        net::packet _p;
+        ::msghdr _mh = {};
+        promise<size_t> _result;
+    public:
+        zerocopy_send_completion(pollable_fd_state& fd, net::packet& p)
+                : _fd(fd), _p(p.share()) {
+            _mh.msg_iov = reinterpret_cast<iovec*>(_p.fragment_array());
+            _mh.msg_iovlen = std::min<size_t>(_p.nr_frags(), IOV_MAX);
+        }
+        virtual void complete_with(int res, unsigned flags) override {
+            if (flags & IORING_CQE_F_NOTIF) {
+                delete this;
+                return;
+            }
+            if (res >= 0) {
+                if (size_t(res) == _p.len()) {
+                    _fd.speculate_epoll(EPOLLOUT);
+                }
+                _result.set_value(res);
+            } else {
+                _result.set_exception(std::make_exception_ptr(std::system_error(-res, std::system_category())));
+            }
+            if (!(flags & IORING_CQE_F_MORE)) {
+                delete this;
+            }
+        }
+        ::msghdr* msghdr() noexcept {
+            return &_mh;
+        }
+        future<size_t> get_future() noexcept {
+            return _result.get_future();
+        }
+    };
+
+    // IORING_OP_SENDMSG_ZC is only supported by TCP and UDP sockets
+    static bool send_zc_capable(uring_pollable_fd_state& fd) noexcept {
+        if (!fd._send_zc_capable) {
+            int domain = AF_UNSPEC;
+            socklen_t len = sizeof(domain);
+            ::getsockopt(fd.fd.get(), SOL_SOCKET, SO_DOMAIN, &domain, &len);
+            fd._send_zc_capable = domain == AF_INET || domain == AF_INET6;
+        }
+        return *fd._send_zc_capable;
+    }
+#endif
+
+    bool multishot() const noexcept {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        return bool(_recv_buffer_ring);
+#else
+        return false;
+#endif
+    }
+
     hrtimer_completion _hrtimer_completion;
     smp_wakeup_completion _smp_wakeup_completion;
 private:
@@ -1358,6 +2018,52 @@ class reactor_backend_uring final : public reactor_backend {
         return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
     }
 
+    static unsigned queue_len(const reactor_config& cfg) {
+        if (cfg.io_uring_queue_len < s_min_queue_len) {
+            seastar_logger.warn("io_uring queue length {} is too short, using {}", cfg.io_uring_queue_len, s_min_queue_len);
+            return s_min_queue_len;
+        }
+        return cfg.io_uring_queue_len;
+    }
+
+    static ::io_uring create_uring(const reactor_config& cfg) {
+        if (cfg.io_uring_sqpoll) {
+            auto params = ::io_uring_params{
+                .flags = IORING_SETUP_SQPOLL,
+                .sq_thread_idle = cfg.io_uring_sqpoll_idle_ms,
+            };
+            if (cfg.io_uring_sqpoll_pin_to_sibling) {
+                auto sibling = hyperthread_sibling(::sched_getcpu());
+                if (sibling) {
+                    params.flags |= IORING_SETUP_SQ_AFF;
+                    params.sq_thread_cpu = *sibling;
+                } else {
+                    seastar_logger.warn("No hyperthread sibling found, io_uring submission queue polling thread is not pinned");
+                }
+            }
+            try {
+                return try_create_uring(queue_len(cfg), true, params).value();
+            } catch (...) {
+                seastar_logger.warn("Cannot create io_uring with submission queue polling, continuing without it: {}", std::current_exception());
+            }
+        }
+        return try_create_uring(queue_len(cfg), true).value();
+    }
+
+    bool sqpoll() const noexcept {
+        return _uring.flags & IORING_SETUP_SQPOLL;
+    }
+
+    // With submission queue polling, io_uring_submit() only enters the
+    // kernel if the polling thread went to sleep and needs a wakeup
+    int submit() {
+        if (sqpoll() && ::io_uring_sq_ready(&_uring)
+                && (__atomic_load_n(_uring.sq.kflags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP)) {
+            _sqpoll_wakeups++;
+        }
+        return ::io_uring_submit(&_uring);
+    }
+
     // Can fail if the completion queue is full
     ::io_uring_sqe* try_get_sqe() {
         return ::io_uring_get_sqe(&_uring);
@@ -1367,7 +2073,7 @@ class reactor_backend_uring final : public reactor_backend {
         if (_has_pending_submissions) {
             _has_pending_submissions = false;
             _did_work_while_getting_sqe = false;
-            io_uring_submit(&_uring);
+            submit();
             return true;
         } else {
             return std::exchange(_did_work_while_getting_sqe, false);
@@ -1377,13 +2083,90 @@ class reactor_backend_uring final : public reactor_backend {
     ::io_uring_sqe* get_sqe() {
         ::io_uring_sqe* sqe;
         while (__builtin_expect((sqe = try_get_sqe()) == nullptr, false)) {
-            do_flush_submission_ring();
-            do_process_kernel_completions_step();
-            _did_work_while_getting_sqe = true;
+            wait_for_sqes();
+        }
+        if (++_in_flight > _peak_in_flight) {
+            note_peak_in_flight();
         }
         return sqe;
     }
 
+    // The ring cannot be resized, so just suggest a better length for the
+    // next run once the completions may outgrow the completion queue
+    void note_peak_in_flight() {
+        _peak_in_flight = _in_flight;
+        if (__builtin_expect(_peak_in_flight > _uring.cq.ring_entries && !_reported_short_ring, false)) {
+            _reported_short_ring = true;
+            seastar_logger.info("{} requests in flight exceed the io_uring completion queue of {} entries, consider --io-uring-queue-len={}",
+                    _peak_in_flight, _uring.cq.ring_entries, size_t(1) << log2ceil(_peak_in_flight));
+        }
+    }
+
+    // Makes room in a full submission queue
+    void wait_for_sqes() {
+        do_flush_submission_ring();
+        do_process_kernel_completions_step();
+        _did_work_while_getting_sqe = true;
+        _sqe_starvations++;
+    }
+
+    void register_buffers() {
+        memory::memory_layout layout;
+        try {
+            layout = memory::get_memory_layout();
+        } catch (...) {
+            seastar_logger.warn("Cannot register buffers with io_uring: {}", std::current_exception());
+            return;
+        }
+        std::vector<::iovec> iovecs;
+        for (auto p = layout.start; p < layout.end; p += s_registered_buffer_size) {
+            iovecs.push_back(::iovec{reinterpret_cast<void*>(p), std::min<size_t>(s_registered_buffer_size, layout.end - p)});
+        }
+        auto r = ::io_uring_register_buffers(&_uring, iovecs.data(), iovecs.size());
+        if (r < 0) {
+            seastar_logger.warn("Cannot register buffers with io_uring (check RLIMIT_MEMLOCK): {}", std::system_category().message(-r));
+            return;
+        }
+        _registered_memory_start = layout.start;
+        _registered_memory_end = layout.end;
+    }
+
+    void register_fixed_file_table() {
+        std::vector<int> fds(s_fixed_files, -1);
+        auto r = ::io_uring_register_files(&_uring, fds.data(), fds.size());
+        if (r < 0) {
+            seastar_logger.warn("Cannot register fixed file table with io_uring: {}", std::system_category().message(-r));
+            return;
+        }
+        _free_fixed_file_slots.reserve(s_fixed_files);
+        for (int slot = s_fixed_files - 1; slot >= 0; slot--) {
+            _free_fixed_file_slots.push_back(slot);
+        }
+        _have_fixed_file_table = true;
+    }
+
+    // Returns the index of the registered buffer that fully contains
+    // the given range, or -1 if there's no such
+    int registered_buffer_index(const void* addr, size_t size) const noexcept {
+        auto start = reinterpret_cast<uintptr_t>(addr);
+        if (start < _registered_memory_start || start + size > _registered_memory_end || size == 0) {
+            return -1;
+        }
+        auto idx = (start - _registered_memory_start) / s_registered_buffer_size;
+        if ((start + size - 1 - _registered_memory_start) / s_registered_buffer_size != idx) {
+            return -1;
+        }
+        return idx;
+    }
+
+    void maybe_use_fixed_file(::io_uring_sqe* sqe) noexcept {
+        auto fd = sqe->fd;
+        if (fd >= 0 && size_t(fd) < _fixed_files.size() && _fixed_files[fd].refs) {
+            sqe->fd = _fixed_files[fd].slot;
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
     future<> poll(pollable_fd_state& fd, int events) {
         auto sqe = get_sqe();
         ::io_uring_prep_poll_add(sqe, fd.fd.get(), events);
@@ -1393,18 +2176,176 @@ class reactor_backend_uring final : public reactor_backend {
         return ufd->get_completion_future(events);
     }
 
-    void submit_io_request(const internal::io_request& req, io_completion* completion) {
+    template <typename WriteOp>
+    void prep_write(::io_uring_sqe* sqe, const WriteOp& op) noexcept {
+        auto buf_idx = op.pos != uint64_t(-1) ? registered_buffer_index(op.addr, op.size) : -1;
+        if (buf_idx >= 0) {
+            ::io_uring_prep_write_fixed(sqe, op.fd, op.addr, op.size, op.pos, buf_idx);
+        } else {
+            ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+        }
+    }
+
+    template <typename WriteOp>
+    void submit_write_fdatasync(const WriteOp& op, io_completion* completion) {
+        linked_write_fdatasync_completion* linked;
+        try {
+            linked = new linked_write_fdatasync_completion(completion, op.size);
+        } catch (...) {
+            completion->set_exception(std::current_exception());
+            return;
+        }
+        // Both links must make it into the same submission, otherwise
+        // the kernel would see a chain cut in the middle
+        while (__builtin_expect(::io_uring_sq_space_left(&_uring) < 2, false)) {
+            wait_for_sqes();
+        }
         auto sqe = get_sqe();
+        prep_write(sqe, op);
+        maybe_use_fixed_file(sqe);
+        sqe->flags |= IOSQE_IO_LINK;
+        ::io_uring_sqe_set_data(sqe, linked->write_link());
+
+        sqe = get_sqe();
+        ::io_uring_prep_fsync(sqe, op.fd, IORING_FSYNC_DATASYNC);
+        maybe_use_fixed_file(sqe);
+        ::io_uring_sqe_set_data(sqe, linked->sync_link());
+
+        _has_pending_submissions = true;
+    }
+
+    void create_iopoll_ring() {
+        if (kernel_uname().whitelisted({"5.10"})) {
+            auto params = ::io_uring_params{
+                .flags = IORING_SETUP_IOPOLL,
+            };
+            _iopoll_ring = try_create_uring(queue_len(_r._cfg), false, params);
+        }
+        if (!_iopoll_ring) {
+            seastar_logger.warn("Cannot create polled io_uring (requires Linux 5.10), continuing without it");
+        }
+    }
+
+    // Polling only works for devices set up with polling queues; for others
+    // the kernel would fail the requests
+    bool device_polls(dev_t device_id) {
+        auto i = _device_polls.find(device_id);
+        if (i != _device_polls.end()) {
+            return i->second;
+        }
+        auto dev = fmt::format("/sys/dev/block/{}:{}", major(device_id), minor(device_id));
+        bool polls = false;
+        // Partitions share the queue of their whole disk
+        for (auto queue : {dev + "/queue/io_poll", dev + "/../queue/io_poll"}) {
+            try {
+                polls = read_first_line_as<int>(queue) != 0;
+                break;
+            } catch (...) {
+            }
+        }
+        seastar_logger.debug("Block device {}:{} {} polled I/O", major(device_id), minor(device_id), polls ? "supports" : "does not support");
+        _device_polls.emplace(device_id, polls);
+        return polls;
+    }
+
+    bool is_polled(const internal::io_request& req) const noexcept {
+        using o = internal::io_request::operation;
+        int fd;
+        switch (req.opcode()) {
+        case o::read: fd = req.as<o::read>().fd; break;
+        case o::write: fd = req.as<o::write>().fd; break;
+        case o::readv: fd = req.as<o::readv>().fd; break;
+        case o::writev: fd = req.as<o::writev>().fd; break;
+        default: return false;
+        }
+        return fd >= 0 && size_t(fd) < _polled_files.size() && _polled_files[fd];
+    }
+
+    void submit_polled_io_request(const internal::io_request& req, io_completion* completion) {
+        using o = internal::io_request::operation;
+        ::io_uring_sqe* sqe;
+        while (__builtin_expect((sqe = ::io_uring_get_sqe(&*_iopoll_ring)) == nullptr, false)) {
+            process_polled_completions();
+            _did_work_while_getting_sqe = true;
+            _sqe_starvations++;
+        }
+        switch (req.opcode()) {
+        case o::read: {
+            const auto& op = req.as<o::read>();
+            ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+            break;
+        }
+        case o::write: {
+            const auto& op = req.as<o::write>();
+            ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+            break;
+        }
+        case o::readv: {
+            const auto& op = req.as<o::readv>();
+            ::io_uring_prep_readv(sqe, op.fd, op.iovec, op.iov_len, op.pos);
+            break;
+        }
+        case o::writev: {
+            const auto& op = req.as<o::writev>();
+            ::io_uring_prep_writev(sqe, op.fd, op.iovec, op.iov_len, op.pos);
+            break;
+        }
+        default:
+            // See is_polled()
+            abort();
+        }
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(completion));
+        _polled_in_flight++;
+        _polled_requests++;
+        _has_pending_polled_submissions = true;
+    }
+
+    // On a polled ring, entering the kernel both submits the queued requests
+    // and polls the device for completions, so it is done every time the
+    // reactor polls while there are requests in flight.
+    // Returns true if completions were processed.
+    bool process_polled_completions() {
+        if (!_polled_in_flight) {
+            return false;
+        }
+        _has_pending_polled_submissions = false;
+        ::io_uring_submit(&*_iopoll_ring);
+        struct ::io_uring_cqe* buf[s_completion_batch];
+        auto n = ::io_uring_peek_batch_cqe(&*_iopoll_ring, buf, s_completion_batch);
+        for (unsigned i = 0; i < n; i++) {
+            auto completion = reinterpret_cast<kernel_completion*>(buf[i]->user_data);
+            completion->complete_with(buf[i]->res);
+        }
+        ::io_uring_cq_advance(&*_iopoll_ring, n);
+        _polled_in_flight -= n;
+        return n != 0;
+    }
+
+    void submit_io_request(const internal::io_request& req, io_completion* completion) {
         using o = internal::io_request::operation;
+        if (req.opcode() == o::write_fdatasync) {
+            submit_write_fdatasync(req.as<o::write_fdatasync>(), completion);
+            return;
+        }
+        if (_iopoll_ring && is_polled(req)) {
+            submit_polled_io_request(req, completion);
+            return;
+        }
+        auto sqe = get_sqe();
         switch (req.opcode()) {
             case o::read: {
                 const auto& op = req.as<io_request::operation::read>();
-                ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                // Only positional (i.e. -- disk) reads use registered buffers
+                auto buf_idx = op.pos != uint64_t(-1) ? registered_buffer_index(op.addr, op.size) : -1;
+                if (buf_idx >= 0) {
+                    ::io_uring_prep_read_fixed(sqe, op.fd, op.addr, op.size, op.pos, buf_idx);
+                } else {
+                    ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                }
                 break;
             }
             case o::write: {
-                const auto& op = req.as<io_request::operation::write>();
-                ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+                prep_write(sqe, req.as<io_request::operation::write>());
                 break;
             }
             case o::readv: {
@@ -1452,6 +2393,8 @@ class reactor_backend_uring final : public reactor_backend {
                 ::io_uring_prep_connect(sqe, op.fd, op.sockaddr, op.socklen);
                 break;
             }
+            case o::write_fdatasync:
+                // Takes two SQEs, see submit_write_fdatasync() above
             case o::poll_add:
             case o::poll_remove:
             case o::cancel:
@@ -1461,6 +2404,7 @@ class reactor_backend_uring final : public reactor_backend {
                 seastar_logger.error("Invalid operation for iocb: {}", req.opname());
                 abort();
         }
+        maybe_use_fixed_file(sqe);
         ::io_uring_sqe_set_data(sqe, completion);
 
         _has_pending_submissions = true;
@@ -1480,15 +2424,25 @@ class reactor_backend_uring final : public reactor_backend {
     void do_process_ready_kernel_completions(::io_uring_cqe** buf, size_t nr) {
         for (auto p = buf; p != buf + nr; ++p) {
             auto cqe = *p;
+            // Multishot requests and zero-copy sends keep their submission
+            // in flight until a completion without IORING_CQE_F_MORE
+            _in_flight -= !(cqe->flags & IORING_CQE_F_MORE);
+            if (__builtin_expect(cqe->user_data & s_multishot_tag, false)) {
+                auto completion = reinterpret_cast<multishot_completion*>(cqe->user_data & ~s_multishot_tag);
+                completion->complete_with(cqe->res, cqe->flags);
+                continue;
+            }
             auto completion = reinterpret_cast<kernel_completion*>(cqe->user_data);
-            completion->complete_with(cqe->res);
+            if (completion) {
+                completion->complete_with(cqe->res);
+            }
         }
     }
 
     // Returns true if completions were processed
     bool do_process_kernel_completions_step() {
-        struct ::io_uring_cqe* buf[s_queue_len];
-        auto n = ::io_uring_peek_batch_cqe(&_uring, buf, s_queue_len);
+        struct ::io_uring_cqe* buf[s_completion_batch];
+        auto n = ::io_uring_peek_batch_cqe(&_uring, buf, s_completion_batch);
         do_process_ready_kernel_completions(buf, n);
         ::io_uring_cq_advance(&_uring, n);
         return n != 0;
@@ -1512,7 +2466,7 @@ class reactor_backend_uring final : public reactor_backend {
 public:
     explicit reactor_backend_uring(reactor& r)
             : _r(r)
-            , _uring(try_create_uring(s_queue_len, true).value())
+            , _uring(create_uring(r._cfg))
             , _hrtimer_timerfd(make_timerfd())
             , _preempt_io_context(_r, _r._task_quota_timer, _hrtimer_timerfd)
             , _hrtimer_completion(_r, _hrtimer_timerfd)
@@ -1521,28 +2475,95 @@ class reactor_backend_uring final : public reactor_backend {
         // expired when it really hasn't, we don't want to block in read(tfd, ...).
         auto tfd = _r._task_quota_timer.get();
         ::fcntl(tfd, F_SETFL, ::fcntl(tfd, F_GETFL) | O_NONBLOCK);
+        if (_r._cfg.io_uring_register_buffers) {
+            register_buffers();
+        }
+        if (_r._cfg.io_uring_register_files) {
+            register_fixed_file_table();
+        }
+        if (_r._cfg.io_uring_iopoll) {
+            create_iopoll_ring();
+        }
+        if (_r._cfg.io_uring_multishot) {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+            if (kernel_uname().whitelisted({"6.0"})) {
+                _recv_buffer_ring = provided_buffer_ring::create(_uring);
+            } else {
+                seastar_logger.warn("io_uring multishot receive requires Linux 6.0, continuing without it");
+            }
+#else
+            seastar_logger.warn("io_uring multishot operations not compiled in, continuing without them");
+#endif
+        }
+        if (_r._cfg.zerocopy_send_threshold) {
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+            _have_send_zc = kernel_uname().whitelisted({"6.1"});
+#endif
+            if (!_have_send_zc) {
+                seastar_logger.info("io_uring zero-copy send not available, using MSG_ZEROCOPY instead");
+            }
+        }
+        namespace sm = seastar::metrics;
+        _metrics.add_group("reactor", {
+            sm::make_gauge("io_uring_queue_len", [this] { return _uring.sq.ring_entries; },
+                    sm::description("Number of io_uring submission queue entries")),
+            sm::make_counter("io_uring_sqe_starvations", _sqe_starvations,
+                    sm::description("Number of times a submission had to wait for the io_uring submission queue to drain")),
+            sm::make_gauge("io_uring_in_flight", _in_flight,
+                    sm::description("Number of requests in flight in io_uring")),
+            sm::make_gauge("io_uring_peak_in_flight", _peak_in_flight,
+                    sm::description("Highest number of requests in flight in io_uring")),
+        });
+        if (sqpoll()) {
+            _metrics.add_group("reactor", {
+                sm::make_counter("io_uring_sqpoll_wakeups", _sqpoll_wakeups,
+                        sm::description("Number of times the io_uring submission queue polling thread had to be woken up by a system call")),
+            });
+        }
+        if (_iopoll_ring) {
+            _metrics.add_group("reactor", {
+                sm::make_counter("io_uring_polled_requests", _polled_requests,
+                        sm::description("Number of block device requests submitted to the polled io_uring")),
+            });
+        }
     }
     ~reactor_backend_uring() {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        retire_socket_multishots();
+        _recv_buffer_ring.reset();
+#endif
+        if (_iopoll_ring) {
+            ::io_uring_queue_exit(&*_iopoll_ring);
+        }
         ::io_uring_queue_exit(&_uring);
     }
     virtual bool reap_kernel_completions() override {
-        return do_process_kernel_completions();
+        bool did_work = false;
+        did_work |= do_process_kernel_completions();
+        did_work |= process_polled_completions();
+        return did_work;
     }
     virtual bool kernel_submit_work() override {
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= queue_pending_file_io();
-        did_work |= ::io_uring_submit(&_uring);
+        did_work |= submit();
+        if (_has_pending_polled_submissions) {
+            _has_pending_polled_submissions = false;
+            ::io_uring_submit(&*_iopoll_ring);
+            did_work = true;
+        }
         return did_work;
     }
     virtual bool kernel_events_can_sleep() const override {
-        // We never need to spin while I/O is in flight.
-        return true;
+        // We never need to spin while interrupt-driven I/O is in flight,
+        // but nothing wakes us up for polled I/O.
+        return !_polled_in_flight;
     }
     virtual void wait_and_process_events(const sigset_t* active_sigmask) override {
         _smp_wakeup_completion.maybe_rearm(*this);
         _hrtimer_completion.maybe_rearm(*this);
-        ::io_uring_submit(&_uring);
+        submit();
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= std::exchange(_did_work_while_getting_sqe, false);
@@ -1577,9 +2598,26 @@ class reactor_backend_uring final : public reactor_backend {
     }
     virtual void forget(pollable_fd_state& fd) noexcept override {
         auto* pfd = static_cast<uring_pollable_fd_state*>(&fd);
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (pfd->_multishot_accept) {
+            pfd->_multishot_accept->orphan();
+        }
+        if (pfd->_multishot_recv) {
+            pfd->_multishot_recv->orphan();
+        }
+#endif
         delete pfd;
     }
     virtual future<std::tuple<pollable_fd, socket_address>> accept(pollable_fd_state& listenfd) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (multishot()) {
+            auto& ufd = static_cast<uring_pollable_fd_state&>(listenfd);
+            if (!ufd._multishot_accept) {
+                ufd._multishot_accept = new multishot_accept(*this, listenfd);
+            }
+            return ufd._multishot_accept->get();
+        }
+#endif
         if (listenfd.take_speculation(POLLIN)) {
             try {
                 listenfd.maybe_no_more_recv();
@@ -1835,6 +2873,74 @@ class reactor_backend_uring final : public reactor_backend {
         auto req = internal::io_request::make_sendmsg(fd.fd.get(), desc->msghdr(), MSG_NOSIGNAL);
         return submit_request(std::move(desc), std::move(req));
     }
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) override {
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+        if (_have_send_zc && send_zc_capable(static_cast<uring_pollable_fd_state&>(fd))) {
+            zerocopy_send_completion* desc;
+            try {
+                desc = new zerocopy_send_completion(fd, p);
+            } catch (...) {
+                return current_exception_as_future<size_t>();
+            }
+            auto fut = desc->get_future();
+            auto sqe = get_sqe();
+            ::io_uring_prep_sendmsg_zc(sqe, fd.fd.get(), desc->msghdr(), MSG_NOSIGNAL);
+            set_multishot_data(sqe, desc);
+            return fut;
+        }
+#endif
+        return _r.do_sendmsg_zerocopy(fd, p);
+    }
+    virtual future<size_t> recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override {
+        // There is no batched receive opcode; wait for readability on the
+        // ring and drain the socket with a single recvmmsg()
+        return _r.do_recvmmsg(fd, msgs, n);
+    }
+    virtual future<size_t> sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override {
+        if (fd.take_speculation(EPOLLOUT)) {
+            auto r = ::sendmmsg(fd.fd.get(), msgs, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (r > 0) {
+                if (size_t(r) == n) {
+                    fd.speculate_epoll(EPOLLOUT);
+                }
+                return make_ready_future<size_t>(r);
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return make_exception_future<size_t>(std::system_error(errno, std::system_category(), "sendmmsg"));
+            }
+        }
+        // Queue the batch as a chain of sendmsg requests; they reach the
+        // kernel together with the rest of this poll cycle's submissions
+        n = std::min(n, s_max_sendmsg_chain);
+        linked_sendmsg_completion* desc;
+        try {
+            desc = new linked_sendmsg_completion(fd, msgs, n);
+        } catch (...) {
+            return current_exception_as_future<size_t>();
+        }
+        auto fut = desc->get_future();
+        // The whole chain must make it into the same submission
+        while (__builtin_expect(::io_uring_sq_space_left(&_uring) < n, false)) {
+            wait_for_sqes();
+        }
+        for (size_t i = 0; i < n; i++) {
+            auto sqe = get_sqe();
+            ::io_uring_prep_sendmsg(sqe, fd.fd.get(), &msgs[i].msg_hdr, MSG_NOSIGNAL);
+            if (i + 1 < n) {
+                sqe->flags |= IOSQE_IO_LINK;
+            }
+            ::io_uring_sqe_set_data(sqe, desc->link_at(i));
+        }
+        _has_pending_submissions = true;
+        return fut.then([this, &fd, msgs, n] (size_t sent) {
+            if (sent) {
+                return make_ready_future<size_t>(sent);
+            }
+            return writeable(fd).then([this, &fd, msgs, n] {
+                return sendmmsg(fd, msgs, n);
+            });
+        });
+    }
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) override {
         if (fd.take_speculation(EPOLLOUT)) {
             try {
@@ -1877,6 +2983,15 @@ class reactor_backend_uring final : public reactor_backend {
     }
 
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (multishot()) {
+            auto& ufd = static_cast<uring_pollable_fd_state&>(fd);
+            if (!ufd._multishot_recv) {
+                ufd._multishot_recv = new multishot_recv(*this, fd);
+            }
+            return ufd._multishot_recv->get();
+        }
+#endif
         if (fd.take_speculation(POLLIN)) {
             auto buffer = ba->allocate_buffer();
             try {
@@ -1930,6 +3045,81 @@ class reactor_backend_uring final : public reactor_backend {
         return true;
     }
 
+    virtual bool have_linked_fdatasync() const noexcept override {
+        return true;
+    }
+
+    virtual bool registers_files() const noexcept override {
+        return _have_fixed_file_table || _iopoll_ring;
+    }
+    virtual void register_file(int fd) noexcept override {
+        if (fd < 0) {
+            return;
+        }
+        try {
+            if (size_t(fd) >= _fixed_files.size()) {
+                if (_free_fixed_file_slots.empty()) {
+                    return;
+                }
+                _fixed_files.resize(fd + 1);
+            }
+        } catch (...) {
+            return; // just go without the fixed file
+        }
+        auto& ff = _fixed_files[fd];
+        if (ff.refs) {
+            ff.refs++;
+            return;
+        }
+        if (_free_fixed_file_slots.empty()) {
+            return;
+        }
+        auto slot = _free_fixed_file_slots.back();
+        auto r = ::io_uring_register_files_update(&_uring, slot, &fd, 1);
+        if (r < 0) {
+            seastar_logger.debug("Cannot register fd {} with io_uring: {}", fd, std::system_category().message(-r));
+            return;
+        }
+        _free_fixed_file_slots.pop_back();
+        ff.slot = slot;
+        ff.refs = 1;
+    }
+    virtual void register_polled_file(int fd, dev_t device_id) noexcept override {
+        if (!_iopoll_ring || fd < 0) {
+            return;
+        }
+        try {
+            if (!device_polls(device_id)) {
+                return;
+            }
+            if (size_t(fd) >= _polled_files.size()) {
+                _polled_files.resize(fd + 1);
+            }
+            _polled_files[fd] = true;
+        } catch (...) {
+            // Just a hint, the file keeps using interrupts
+            seastar_logger.debug("Cannot use polled I/O for fd {}: {}", fd, std::current_exception());
+        }
+    }
+    virtual void unregister_file(int fd) noexcept override {
+        if (fd >= 0 && size_t(fd) < _polled_files.size()) {
+            _polled_files[fd] = false;
+        }
+        if (fd < 0 || size_t(fd) >= _fixed_files.size() || !_fixed_files[fd].refs) {
+            return;
+        }
+        auto& ff = _fixed_files[fd];
+        if (--ff.refs) {
+            return;
+        }
+        // Don't let prepared, but not yet submitted requests see the empty slot
+        do_flush_submission_ring();
+        int none = -1;
+        ::io_uring_register_files_update(&_uring, ff.slot, &none, 1);
+        _free_fixed_file_slots.push_back(ff.slot); // capacity is reserved
+        ff.slot = -1;
+    }
+
     virtual void signal_received(int signo, siginfo_t* siginfo, void* ignore) override {
         _r._signals.action(signo, siginfo, ignore);
     }
@@ -203,12 +203,38 @@ class reactor_backend {
     virtual future<size_t> recvmsg(pollable_fd_state& fd, const std::vector<iovec>& iov) = 0;
     virtual future<temporary_buffer<char>> read_some(pollable_fd_state& fd, internal::buffer_allocator* ba) = 0;
     virtual future<size_t> sendmsg(pollable_fd_state& fd, net::packet& p) = 0;
+    // Like sendmsg(), but the kernel references the packet data instead of
+    // copying it. The data is kept alive past the returned future, until the
+    // kernel releases it.
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) = 0;
+    // Receive or send up to n datagrams in one go. Return how many of the
+    // messages were transferred; msg_len of each of them is updated.
+    virtual future<size_t> recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) = 0;
+    virtual future<size_t> sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) = 0;
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) = 0;
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) = 0;
 
     virtual bool do_blocking_io() const {
         return false;
     }
+    // Hints that a disk file descriptor is about to be used for I/O, so the
+    // backend may pre-register it with the kernel. Every register_file()
+    // is paired with an unregister_file() before the descriptor is closed.
+    virtual void register_file(int fd) noexcept {}
+    virtual void unregister_file(int fd) noexcept {}
+    // Whether register_file() and register_polled_file() may do anything
+    virtual bool registers_files() const noexcept {
+        return false;
+    }
+    // Additionally hints that fd is a block device opened with O_DIRECT,
+    // so its reads and writes may be completed by polling the device.
+    // Dropped by unregister_file().
+    virtual void register_polled_file(int fd, dev_t device_id) noexcept {}
+    // Whether io_request::operation::write_fdatasync can be submitted, i.e.
+    // the backend can order the sync after the write in the kernel.
+    virtual bool have_linked_fdatasync() const noexcept {
+        return false;
+    }
     virtual void signal_received(int signo, siginfo_t* siginfo, void* ignore) = 0;
     virtual void start_tick() = 0;
     virtual void stop_tick() = 0;
@@ -270,6 +296,9 @@ class reactor_backend_epoll : public reactor_backend {
     virtual future<size_t> recvmsg(pollable_fd_state& fd, const std::vector<iovec>& iov) override;
     virtual future<temporary_buffer<char>> read_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
     virtual future<size_t> sendmsg(pollable_fd_state& fd, net::packet& p) override;
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) override;
+    virtual future<size_t> recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override;
+    virtual future<size_t> sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override;
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) override;
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
 
@@ -320,6 +349,9 @@ class reactor_backend_aio : public reactor_backend {
     virtual future<size_t> recvmsg(pollable_fd_state& fd, const std::vector<iovec>& iov) override;
     virtual future<temporary_buffer<char>> read_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
     virtual future<size_t> sendmsg(pollable_fd_state& fd, net::packet& p) override;
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) override;
+    virtual future<size_t> recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override;
+    virtual future<size_t> sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override;
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) override;
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
 
@@ -365,6 +397,9 @@ class reactor_backend_osv : public reactor_backend {
     virtual future<size_t> recvmsg(pollable_fd_state& fd, const std::vector<iovec>& iov) override;
     virtual future<temporary_buffer<char>> read_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
     virtual future<size_t> sendmsg(pollable_fd_state& fd, net::packet& p) override;
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) override;
+    virtual future<size_t> recvmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override;
+    virtual future<size_t> sendmmsg(pollable_fd_state& fd, ::mmsghdr* msgs, size_t n) override;
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) override;
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
 
@@ -0,0 +1,213 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <seastar/core/segment_file_pool.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/util/log.hh>
+#include <charconv>
+#include <system_error>
+
+namespace seastar {
+
+segment_file_pool::segment_file_pool(config cfg)
+        : _config(std::move(cfg))
+{
+    _config.segment_size = align_up<uint64_t>(std::max<uint64_t>(_config.segment_size, 1), 4096);
+    _config.max_free = std::max(_config.max_free, _config.reserve);
+}
+
+sstring segment_file_pool::path_of(std::string_view name) const {
+    return _config.directory + "/" + sstring(name);
+}
+
+sstring segment_file_pool::next_free_path() {
+    return path_of(_config.prefix + to_sstring(_next_id++));
+}
+
+future<> segment_file_pool::start() {
+    return open_directory(_config.directory).then([this] (file dir) {
+        return do_with(std::move(dir), std::vector<sstring>(), [this] (file& dir, std::vector<sstring>& names) {
+            return dir.list_directory([this, &names] (directory_entry de) {
+                std::string_view name = de.name;
+                if (name.substr(0, _config.prefix.size()) == std::string_view(_config.prefix)) {
+                    auto id = name.substr(_config.prefix.size());
+                    uint64_t n;
+                    auto [end, ec] = std::from_chars(id.data(), id.data() + id.size(), n);
+                    if (ec == std::errc() && end == id.data() + id.size()) {
+                        _next_id = std::max(_next_id, n + 1);
+                        names.push_back(std::move(de.name));
+                    }
+                }
+                return make_ready_future<>();
+            }).done().finally([&dir] {
+                return dir.close();
+            }).then([this, &names] {
+                return do_for_each(names, [this] (const sstring& name) {
+                    auto path = path_of(name);
+                    return file_size(path).then([this, path] (uint64_t size) {
+                        // Cut short by a crash while being created
+                        if (size != _config.segment_size) {
+                            _stats.removed++;
+                            return remove_file(path);
+                        }
+                        return open_file_dma(path, open_flags::rw, _config.open_options).then([this, path] (file f) {
+                            _free.push_back(free_segment{path, std::move(f)});
+                        });
+                    });
+                });
+            });
+        });
+    }).then([this] {
+        _filler = fill_loop();
+    });
+}
+
+future<> segment_file_pool::stop() {
+    _stopping = true;
+    _refill.broken();
+    return std::exchange(_filler, make_ready_future<>()).then([this] {
+        return do_with(std::exchange(_free, {}), [] (std::deque<free_segment>& free) {
+            return parallel_for_each(free, [] (free_segment& s) {
+                return s.f.close();
+            });
+        });
+    });
+}
+
+future<> segment_file_pool::fill_loop() {
+    return do_until([this] { return _stopping; }, [this] {
+        if (_free.size() >= _config.reserve) {
+            return _refill.wait().handle_exception_type([] (const broken_condition_variable&) {});
+        }
+        return create(true).then([this] (free_segment s) {
+            _free.push_back(std::move(s));
+        }).handle_exception([this] (std::exception_ptr ex) {
+            seastar_logger.warn("Failed to create a segment in {}: {}", _config.directory, ex);
+            // Don't spin on a full or broken disk
+            return sleep(std::chrono::seconds(1));
+        });
+    });
+}
+
+future<segment_file_pool::free_segment> segment_file_pool::create(bool zero) {
+    auto path = next_free_path();
+    return open_file_dma(path, open_flags::rw | open_flags::create | open_flags::exclusive, _config.open_options).then(
+            [this, path, zero] (file f) {
+        return f.allocate(0, _config.segment_size).then([this, f, zero] () mutable {
+            // Writing the zeros turns the allocated extents into written
+            // ones, so that the first write into them updates no metadata
+            return zero ? zero_fill(f) : f.truncate(_config.segment_size);
+        }).then([f] () mutable {
+            return f.flush();
+        }).then_wrapped([this, path, f] (future<> fut) mutable {
+            if (fut.failed()) {
+                auto ex = fut.get_exception();
+                return f.close().then([path] {
+                    return remove_file(path);
+                }).then_wrapped([ex = std::move(ex)] (future<> cleanup) {
+                    cleanup.ignore_ready_future();
+                    return make_exception_future<free_segment>(ex);
+                });
+            }
+            _stats.created++;
+            return make_ready_future<free_segment>(free_segment{path, std::move(f)});
+        });
+    });
+}
+
+future<> segment_file_pool::zero_fill(file f) {
+    auto chunk = std::min<uint64_t>(_config.segment_size, 128 << 10);
+    auto zeros = temporary_buffer<char>::aligned(f.memory_dma_alignment(), chunk);
+    std::fill_n(zeros.get_write(), zeros.size(), 0);
+    return do_with(std::move(f), std::move(zeros), uint64_t(0), [this] (file& f, temporary_buffer<char>& zeros, uint64_t& pos) {
+        return do_until([this, &pos] { return pos >= _config.segment_size; }, [this, &f, &zeros, &pos] {
+            auto len = std::min<uint64_t>(zeros.size(), _config.segment_size - pos);
+            return f.dma_write(pos, zeros.get(), len, _config.io_priority_class).then([&pos] (size_t written) {
+                if (written == 0) {
+                    // Nothing was written, and retrying would get nowhere
+                    return make_exception_future<>(std::system_error(EIO, std::system_category(), "segment_file_pool: short write"));
+                }
+                pos += written;
+                return make_ready_future<>();
+            });
+        });
+    });
+}
+
+future<file> segment_file_pool::acquire(sstring name) {
+    auto seg = [this] {
+        if (_free.empty()) {
+            _stats.misses++;
+            return create(false);
+        }
+        auto s = std::move(_free.front());
+        _free.pop_front();
+        return make_ready_future<free_segment>(std::move(s));
+    }();
+    _refill.signal();
+    return seg.then([this, name = std::move(name)] (free_segment s) {
+        return rename_file(s.path, path_of(name)).then([this] {
+            return sync_directory(_config.directory);
+        }).then_wrapped([this, f = std::move(s.f)] (future<> fut) mutable {
+            if (fut.failed()) {
+                auto ex = fut.get_exception();
+                return f.close().then_wrapped([ex = std::move(ex)] (future<> close) {
+                    close.ignore_ready_future();
+                    return make_exception_future<file>(ex);
+                });
+            }
+            _stats.acquired++;
+            return make_ready_future<file>(std::move(f));
+        });
+    });
+}
+
+future<> segment_file_pool::recycle(sstring name) {
+    auto path = path_of(name);
+    if (_stopping || _free.size() >= _config.max_free) {
+        _stats.removed++;
+        return remove_file(path);
+    }
+    return file_size(path).then([this, path] (uint64_t size) {
+        // Reusing a segment of another size would change metadata again
+        if (size != _config.segment_size) {
+            _stats.removed++;
+            return remove_file(path);
+        }
+        auto free_path = next_free_path();
+        return rename_file(path, free_path).then([this] {
+            return sync_directory(_config.directory);
+        }).then([this, free_path] {
+            return open_file_dma(free_path, open_flags::rw, _config.open_options);
+        }).then([this, free_path] (file f) {
+            _stats.recycled++;
+            if (_stopping) {
+                return f.close();
+            }
+            _free.push_back(free_segment{free_path, std::move(f)});
+            return make_ready_future<>();
+        });
+    });
+}
+
+}
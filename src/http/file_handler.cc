@@ -87,6 +87,21 @@ future<std::unique_ptr<http::reply>> file_interaction_handler::read(
         sstring file_name, std::unique_ptr<http::request> req,
         std::unique_ptr<http::reply> rep) {
     sstring extension = get_extension(file_name);
+    if (!transformer) {
+        // Nothing to apply to the content, let the network stack send it
+        // straight from the file
+        return open_file_dma(file_name, open_flags::ro).then([rep = std::move(rep), extension] (file f) mutable {
+            return f.size().then_wrapped([f, rep = std::move(rep), extension] (future<uint64_t> size) mutable {
+                if (size.failed()) {
+                    return f.close().then([size = std::move(size)] () mutable {
+                        return make_exception_future<std::unique_ptr<http::reply>>(size.get_exception());
+                    });
+                }
+                rep->write_body(extension, std::move(f), size.get0());
+                return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+            });
+        });
+    }
     rep->write_body(extension, [req = std::move(req), extension, file_name, this] (output_stream<char>&& s) mutable {
         return do_with(output_stream<char>(get_stream(std::move(req), extension, std::move(s))),
                 [file_name] (output_stream<char>& os) {
@@ -122,16 +122,18 @@ future<> connection::start_response() {
     }
     set_headers(*_resp);
     _resp->_headers["Content-Length"] = to_sstring(
-            _resp->_content.size());
+            _resp->_body_file ? _resp->_body_file_size : _resp->_content.size());
     return _write_buf.write(_resp->_response_line.data(),
             _resp->_response_line.size()).then([this] {
         return _resp->write_reply_headers(*this);
     }).then([this] {
         return _write_buf.write("\r\n", 2);
     }).then([this] {
-        return write_body();
+        return _resp->_body_file ? write_file_body() : write_body();
     }).then([this] {
         return _write_buf.flush();
+    }).finally([this] {
+        return _resp->_body_file ? _resp->_body_file.close() : make_ready_future<>();
     }).then([this] {
         _resp.reset();
     });
@@ -325,6 +327,13 @@ future<> connection::write_body() {
             _resp->_content.size());
 }
 
+future<> connection::write_file_body() {
+    // The headers must reach the socket ahead of the file contents
+    return _write_buf.flush_and_wait().then([this] {
+        return _fd.send_file(_resp->_body_file, 0, _resp->_body_file_size);
+    });
+}
+
 void connection::set_headers(http::reply& resp) {
     resp._headers["Server"] = "Seastar httpd";
     resp._headers["Date"] = _server._date;
@@ -200,6 +200,12 @@ void reply::write_body(const sstring& content_type, sstring content) {
     done(content_type);
 }
 
+void reply::write_body(const sstring& content_type, file f, uint64_t size) {
+    _body_file = std::move(f);
+    _body_file_size = size;
+    done(content_type);
+}
+
 future<> reply::write_reply_to_connection(httpd::connection& con) {
     add_header("Transfer-Encoding", "chunked");
     return con.out().write(response_line()).then([this, &con] () mutable {
@@ -20,6 +20,7 @@
  */
 
 #include <random>
+#include <deque>
 
 #include <sys/socket.h>
 #include <linux/if.h>
@@ -36,6 +37,7 @@
 #include <seastar/net/inet_address.hh>
 #include <seastar/util/std-compat.hh>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netinet/sctp.h>
 
 namespace std {
@@ -269,6 +271,14 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     future<> wait_input_shutdown() override {
         return _fd.poll_rdhup();
     }
+    future<> send_file(file f, uint64_t pos, uint64_t len) override {
+        if (!pollable_fd::can_send_file(f)) {
+            return connected_socket_impl::send_file(std::move(f), pos, len);
+        }
+        return do_with(std::move(f), [this, pos, len] (file& f) {
+            return _fd.send_file(f, pos, len);
+        });
+    }
 
     friend class posix_server_socket_impl;
     friend class posix_ap_server_socket_impl;
@@ -636,6 +646,10 @@ std::vector<iovec> to_iovec(std::vector<temporary_buffer<char>>& buf_vec) {
 
 future<>
 posix_data_sink_impl::put(temporary_buffer<char> buf) {
+    if (_fd.zerocopy_eligible(buf.size())) {
+        // Only a packet carries the deleter that keeps the data alive
+        return put(packet(std::move(buf)));
+    }
     return _fd.write_all(buf.get(), buf.size()).then([d = buf.release()] {});
 }
 
@@ -697,39 +711,67 @@ posix_ap_network_stack::listen(socket_address sa, listen_options opt) {
         server_socket(std::make_unique<posix_ap_server_socket_impl>(protocol, sa, _allocator));
 }
 
-struct cmsg_with_pktinfo {
-    struct cmsghdrcmh;
-    union {
-        struct in_pktinfo pktinfo;
-        struct in6_pktinfo pkt6info;
-    };
-};
-
 class posix_udp_channel : public udp_channel_impl {
 private:
     static constexpr int MAX_DATAGRAM_SIZE = 65507;
+    // Most datagrams a single receive_batch() or sendmmsg() call handles
+    static constexpr size_t MAX_BATCH = 32;
+    // Most datagrams the kernel accepts in one UDP_SEGMENT message
+    static constexpr size_t MAX_GSO_SEGMENTS = 64;
+    // Room for the destination address (IP_PKTINFO) and the GRO segment size
+    static constexpr size_t RECV_CMSG_SPACE = CMSG_SPACE(sizeof(in6_pktinfo)) + CMSG_SPACE(sizeof(int));
     struct recv_ctx {
         struct msghdr _hdr;
         struct iovec _iov;
         socket_address _src_addr;
         char* _buffer;
-        cmsg_with_pktinfo _cmsg;
+        alignas(cmsghdr) char _cmsg[RECV_CMSG_SPACE];
 
         recv_ctx() {
             memset(&_hdr, 0, sizeof(_hdr));
             _hdr.msg_iov = &_iov;
             _hdr.msg_iovlen = 1;
             _hdr.msg_name = &_src_addr.u.sa;
-            _hdr.msg_namelen = sizeof(_src_addr.u.sas);
-            memset(&_cmsg, 0, sizeof(_cmsg));
-            _hdr.msg_control = &_cmsg;
-            _hdr.msg_controllen = sizeof(_cmsg);
+            _hdr.msg_control = _cmsg;
         }
 
         void prepare() {
             _buffer = new char[MAX_DATAGRAM_SIZE];
             _iov.iov_base = _buffer;
             _iov.iov_len = MAX_DATAGRAM_SIZE;
+            // recvmsg() overwrites these with the lengths actually used
+            _hdr.msg_namelen = sizeof(_src_addr.u.sas);
+            _hdr.msg_controllen = sizeof(_cmsg);
+        }
+    };
+    struct recv_batch_ctx {
+        struct slot {
+            socket_address _src_addr;
+            struct iovec _iov;
+            std::unique_ptr<char[]> _buffer;
+            alignas(cmsghdr) char _cmsg[RECV_CMSG_SPACE];
+        };
+        // Buffers of slots left empty by a batch are kept for the next one
+        std::array<slot, MAX_BATCH> _slots;
+        std::array<struct mmsghdr, MAX_BATCH> _hdrs;
+
+        void prepare(size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                auto& s = _slots[i];
+                if (!s._buffer) {
+                    s._buffer.reset(new char[MAX_DATAGRAM_SIZE]);
+                }
+                s._iov.iov_base = s._buffer.get();
+                s._iov.iov_len = MAX_DATAGRAM_SIZE;
+                auto& h = _hdrs[i];
+                memset(&h, 0, sizeof(h));
+                h.msg_hdr.msg_name = &s._src_addr.u.sa;
+                h.msg_hdr.msg_namelen = sizeof(s._src_addr.u.sas);
+                h.msg_hdr.msg_iov = &s._iov;
+                h.msg_hdr.msg_iovlen = 1;
+                h.msg_hdr.msg_control = s._cmsg;
+                h.msg_hdr.msg_controllen = sizeof(s._cmsg);
+            }
         }
     };
     struct send_ctx {
@@ -754,11 +796,44 @@ class posix_udp_channel : public udp_channel_impl {
             resolve_outgoing_address(_dst);
         }
     };
+    struct send_batch_ctx {
+        struct message {
+            socket_address _dst;
+            std::vector<struct iovec> _iovecs;
+            // Index of the first datagram carried by this message
+            size_t _first;
+            alignas(cmsghdr) char _cmsg[CMSG_SPACE(sizeof(uint16_t))];
+        };
+        std::vector<udp_outgoing_datagram> _datagrams;
+        std::vector<message> _messages;
+        std::vector<struct mmsghdr> _hdrs;
+        size_t _sent = 0;
+        bool _gso = false;
+
+        send_batch_ctx(std::vector<udp_outgoing_datagram> datagrams, bool gso)
+                : _datagrams(std::move(datagrams)) {
+            build(0, gso);
+        }
+        void build(size_t first, bool gso);
+    };
     pollable_fd _fd;
     socket_address _address;
     recv_ctx _recv;
     send_ctx _send;
+    std::unique_ptr<recv_batch_ctx> _recv_batch;
+    // Datagrams received, but not handed out yet: the rest of a batch, or
+    // of a message coalesced by GRO
+    std::deque<udp_datagram> _pending;
+    bool _gso = false;
     bool _closed;
+
+    void deliver(const msghdr& hdr, const socket_address& src, std::unique_ptr<char[]> buffer, size_t size);
+    udp_datagram pop_pending() noexcept {
+        auto dgram = std::move(_pending.front());
+        _pending.pop_front();
+        return dgram;
+    }
+    std::vector<udp_datagram> take_pending(size_t max_datagrams);
 public:
     posix_udp_channel(const socket_address& bind_address)
             : _closed(false) {
@@ -768,6 +843,13 @@ class posix_udp_channel : public udp_channel_impl {
         if (engine().posix_reuseport_available()) {
             fd.setsockopt(SOL_SOCKET, SO_REUSEPORT, 1);
         }
+        // Segmentation and receive offloads are used where the kernel
+        // supports them (Linux 4.18 and 5.0); failures here are not errors
+        int gro = 1;
+        ::setsockopt(fd.get(), SOL_UDP, UDP_GRO, &gro, sizeof(gro));
+        int gso_size;
+        socklen_t gso_size_len = sizeof(gso_size);
+        _gso = ::getsockopt(fd.get(), SOL_UDP, UDP_SEGMENT, &gso_size, &gso_size_len) == 0;
         fd.bind(sa.u.sa, sizeof(sa.u.sas));
         _address = fd.get_address();
         _fd = std::move(fd);
@@ -776,6 +858,8 @@ class posix_udp_channel : public udp_channel_impl {
     virtual future<udp_datagram> receive() override;
     virtual future<> send(const socket_address& dst, const char *msg) override;
     virtual future<> send(const socket_address& dst, packet p) override;
+    virtual future<std::vector<udp_datagram>> receive_batch(size_t max_datagrams) override;
+    virtual future<> send_batch(std::vector<udp_outgoing_datagram> datagrams) override;
     virtual void shutdown_input() override {
         _fd.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
     }
@@ -808,6 +892,92 @@ future<> posix_udp_channel::send(const socket_address& dst, packet p) {
             .then([len] (size_t size) { assert(size == len); });
 }
 
+void posix_udp_channel::send_batch_ctx::build(size_t first, bool gso) {
+    _gso = false;
+    _sent = 0;
+    _messages.clear();
+    _hdrs.clear();
+    for (size_t i = first; i < _datagrams.size();) {
+        auto& m = _messages.emplace_back();
+        m._dst = _datagrams[i].dst;
+        m._first = i;
+        const size_t segment = _datagrams[i].data.len();
+        size_t total = 0;
+        // With GSO, a run of datagrams to one destination goes out as a single
+        // message, cut by the kernel into segment-sized datagrams. Only the
+        // last one may be shorter.
+        do {
+            auto& p = _datagrams[i].data;
+            for (auto&& f : p.fragments()) {
+                m._iovecs.push_back({.iov_base = f.base, .iov_len = f.size});
+            }
+            total += p.len();
+            ++i;
+        } while (gso && segment > 0 && i < _datagrams.size()
+                && i - m._first < MAX_GSO_SEGMENTS
+                && _datagrams[i - 1].data.len() == segment
+                && _datagrams[i].data.len() <= segment
+                && _datagrams[i].dst == m._dst
+                && total + _datagrams[i].data.len() <= MAX_DATAGRAM_SIZE
+                && m._iovecs.size() + _datagrams[i].data.nr_frags() <= IOV_MAX);
+        resolve_outgoing_address(m._dst);
+        auto& h = _hdrs.emplace_back();
+        memset(&h, 0, sizeof(h));
+        if (i - m._first > 1) {
+            h.msg_hdr.msg_control = m._cmsg;
+            h.msg_hdr.msg_controllen = sizeof(m._cmsg);
+            auto* cmsg = CMSG_FIRSTHDR(&h.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = segment;
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            _gso = true;
+        }
+    }
+    // Pointers into _messages are only stable once it's complete
+    for (size_t n = 0; n < _messages.size(); n++) {
+        auto& m = _messages[n];
+        auto& h = _hdrs[n].msg_hdr;
+        h.msg_name = &m._dst.u.sa;
+        h.msg_namelen = m._dst.addr_length;
+        h.msg_iov = m._iovecs.data();
+        h.msg_iovlen = m._iovecs.size();
+    }
+}
+
+future<> posix_udp_channel::send_batch(std::vector<udp_outgoing_datagram> datagrams) {
+    if (datagrams.empty()) {
+        return make_ready_future<>();
+    }
+    std::unique_ptr<send_batch_ctx> ctx;
+    try {
+        ctx = std::make_unique<send_batch_ctx>(std::move(datagrams), _gso);
+    } catch (...) {
+        return current_exception_as_future();
+    }
+    return do_with(std::move(ctx), [this] (std::unique_ptr<send_batch_ctx>& ctx) {
+        return do_until([&ctx] { return ctx->_sent == ctx->_hdrs.size(); }, [this, &ctx] {
+            auto n = std::min(ctx->_hdrs.size() - ctx->_sent, MAX_BATCH);
+            return _fd.sendmmsg(ctx->_hdrs.data() + ctx->_sent, n).then_wrapped([this, &ctx] (future<size_t> f) {
+                if (!f.failed()) {
+                    ctx->_sent += f.get0();
+                    return;
+                }
+                auto ex = f.get_exception();
+                if (!ctx->_gso) {
+                    std::rethrow_exception(std::move(ex));
+                }
+                // The route may not support segmentation offload (EIO), or
+                // the kernel may reject the segment count or size (EINVAL);
+                // resend the rest as plain datagrams from now on.
+                _gso = false;
+                ctx->build(ctx->_messages[ctx->_sent]._first, false);
+            });
+        });
+    });
+}
+
 udp_channel
 posix_network_stack::make_udp_channel(const socket_address& addr) {
     return udp_channel(std::make_unique<posix_udp_channel>(addr));
@@ -840,25 +1010,94 @@ class posix_datagram : public udp_datagram_impl {
     virtual packet& get_data() override { return _p; }
 };
 
+void posix_udp_channel::deliver(const msghdr& hdr, const socket_address& src, std::unique_ptr<char[]> buffer, size_t size) {
+    socket_address dst;
+    size_t segment = 0;
+    for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+            dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
+        } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+            dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
+        } else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            // Several datagrams of one flow coalesced by the kernel, all
+            // but the last one of this size
+            segment = copy_reinterpret_cast<int>(CMSG_DATA(cmsg));
+        }
+    }
+    if (hdr.msg_flags & MSG_TRUNC) {
+        // The last datagram didn't fit into the buffer and is dropped. The
+        // ones GRO coalesced with it before are whole, as only the last
+        // segment may be shorter than the others.
+        size = segment ? size - size % segment : 0;
+        if (size == 0) {
+            return;
+        }
+    }
+    if (segment == 0) {
+        segment = size;
+    }
+    auto* data = buffer.get();
+    auto del = make_deleter([buffer = std::move(buffer)] {});
+    size_t off = 0;
+    do {
+        auto len = std::min(segment, size - off);
+        _pending.emplace_back(std::make_unique<posix_datagram>(src, dst, packet(fragment{data + off, len}, del.share())));
+        off += len;
+    } while (off < size);
+}
+
+std::vector<udp_datagram> posix_udp_channel::take_pending(size_t max_datagrams) {
+    std::vector<udp_datagram> ret;
+    auto n = std::min(std::max<size_t>(max_datagrams, 1), _pending.size());
+    ret.reserve(n);
+    while (n--) {
+        ret.push_back(pop_pending());
+    }
+    return ret;
+}
+
 future<udp_datagram>
 posix_udp_channel::receive() {
+    if (!_pending.empty()) {
+        return make_ready_future<udp_datagram>(pop_pending());
+    }
     _recv.prepare();
-    return _fd.recvmsg(&_recv._hdr).then([this] (size_t size) {
-        socket_address dst;
-        for (auto* cmsg = CMSG_FIRSTHDR(&_recv._hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&_recv._hdr, cmsg)) {
-            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
-                dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
-                break;
-            } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-                dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
-                break;
-            }
+    return _fd.recvmsg(&_recv._hdr).then_wrapped([this] (future<size_t> f) {
+        std::unique_ptr<char[]> buffer(_recv._buffer);
+        deliver(_recv._hdr, _recv._src_addr, std::move(buffer), f.get0());
+        if (_pending.empty()) {
+            // Dropped as truncated
+            return receive();
+        }
+        return make_ready_future<udp_datagram>(pop_pending());
+    });
+}
+
+future<std::vector<udp_datagram>>
+posix_udp_channel::receive_batch(size_t max_datagrams) {
+    if (!_pending.empty()) {
+        return make_ready_future<std::vector<udp_datagram>>(take_pending(max_datagrams));
+    }
+    auto n = std::clamp<size_t>(max_datagrams, 1, MAX_BATCH);
+    try {
+        if (!_recv_batch) {
+            _recv_batch = std::make_unique<recv_batch_ctx>();
+        }
+        _recv_batch->prepare(n);
+    } catch (...) {
+        return current_exception_as_future<std::vector<udp_datagram>>();
+    }
+    return _fd.recvmmsg(_recv_batch->_hdrs.data(), n).then([this, max_datagrams] (size_t received) {
+        for (size_t i = 0; i < received; i++) {
+            auto& s = _recv_batch->_slots[i];
+            auto& h = _recv_batch->_hdrs[i];
+            deliver(h.msg_hdr, s._src_addr, std::move(s._buffer), h.msg_len);
+        }
+        if (_pending.empty()) {
+            // All of them dropped as truncated
+            return receive_batch(max_datagrams);
         }
-        return make_ready_future<udp_datagram>(udp_datagram(std::make_unique<posix_datagram>(
-            _recv._src_addr, dst, packet(fragment{_recv._buffer, size}, make_deleter([buf = _recv._buffer] { delete[] buf; })))));
-    }).handle_exception([p = _recv._buffer](auto ep) {
-        delete[] p;
-        return make_exception_future<udp_datagram>(std::move(ep));
+        return make_ready_future<std::vector<udp_datagram>>(take_pending(max_datagrams));
     });
 }
 
@@ -21,6 +21,8 @@
 
 #include <seastar/net/stack.hh>
 #include <seastar/net/inet_address.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/loop.hh>
 
 namespace seastar {
 
@@ -65,6 +67,32 @@ future<> net::udp_channel::send(const socket_address& dst, packet p) {
     return _impl->send(dst, std::move(p));
 }
 
+future<std::vector<net::udp_datagram>> net::udp_channel::receive_batch(size_t max_datagrams) {
+    return _impl->receive_batch(max_datagrams);
+}
+
+future<> net::udp_channel::send_batch(std::vector<udp_outgoing_datagram> datagrams) {
+    return _impl->send_batch(std::move(datagrams));
+}
+
+future<std::vector<net::udp_datagram>> net::udp_channel_impl::receive_batch(size_t max_datagrams) {
+    // Default implementation receives one datagram at a time
+    return receive().then([] (udp_datagram dgram) {
+        std::vector<udp_datagram> ret;
+        ret.push_back(std::move(dgram));
+        return ret;
+    });
+}
+
+future<> net::udp_channel_impl::send_batch(std::vector<udp_outgoing_datagram> datagrams) {
+    // Default implementation sends one datagram at a time
+    return do_with(std::move(datagrams), [this] (std::vector<udp_outgoing_datagram>& datagrams) {
+        return do_for_each(datagrams, [this] (udp_outgoing_datagram& dgram) {
+            return send(dgram.dst, std::move(dgram.data));
+        });
+    });
+}
+
 bool net::udp_channel::is_closed() const {
     return _impl->is_closed();
 }
@@ -149,12 +177,46 @@ future<> connected_socket::wait_input_shutdown() {
     return _csi->wait_input_shutdown();
 }
 
+future<> connected_socket::send_file(file f, uint64_t pos, uint64_t len) {
+    return _csi->send_file(std::move(f), pos, len);
+}
+
 data_source
 net::connected_socket_impl::source(connected_socket_input_stream_config csisc) {
     // Default implementation falls back to non-parameterized data_source
     return source();
 }
 
+future<>
+net::connected_socket_impl::send_file(file f, uint64_t pos, uint64_t len) {
+    // Default implementation copies the file through userspace
+    file_input_stream_options opts;
+    opts.buffer_size = 128 * 1024;
+    opts.read_ahead = 1;
+    return do_with(make_file_input_stream(std::move(f), pos, len, std::move(opts)), sink(), len,
+            [] (input_stream<char>& in, data_sink& out, uint64_t& left) {
+        return repeat([&in, &out, &left] {
+            return in.read().then([&out, &left] (temporary_buffer<char> buf) {
+                if (buf.empty()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                left -= buf.size();
+                return out.put(std::move(buf)).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        }).then([&out] {
+            return out.flush();
+        }).finally([&in] {
+            return in.close();
+        }).then([&left] {
+            if (left) {
+                throw std::system_error(ENODATA, std::system_category(), "send_file: file ended before the requested range");
+            }
+        });
+    });
+}
+
 socket::~socket()
 {}
 
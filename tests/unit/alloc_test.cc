@@ -21,6 +21,7 @@
 
 #include <seastar/testing/test_case.hh>
 #include <seastar/core/memory.hh>
+#include <seastar/core/heap_profiler.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/util/memory_diagnostics.hh>
@@ -31,6 +32,7 @@
 #include <vector>
 #include <future>
 #include <iostream>
+#include <sstream>
 
 #include <malloc.h>
 
@@ -78,6 +80,30 @@ SEASTAR_TEST_CASE(test_live_objects_counter_with_cross_cpu_free) {
     });
 }
 
+SEASTAR_TEST_CASE(test_cross_cpu_free_batches) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    return smp::submit_to(1, [] {
+        auto ret = std::vector<std::unique_ptr<int>>(10000);
+        for (auto& o : ret) {
+            o = std::make_unique<int>(0);
+        }
+        return ret;
+    }).then([] (auto&& vec) {
+        auto before = memory::stats();
+        vec.clear();
+        memory::drain_cross_cpu_freelist();
+        auto after = memory::stats();
+        auto frees = after.cross_cpu_frees() - before.cross_cpu_frees();
+        auto batches = after.cross_cpu_free_batches() - before.cross_cpu_free_batches();
+        BOOST_REQUIRE_GE(frees, 10000);
+        BOOST_REQUIRE_GE(batches, 10000 / 64);
+        BOOST_REQUIRE_LE(batches * 16, frees);
+    });
+#else
+    return make_ready_future<>();
+#endif
+}
+
 SEASTAR_TEST_CASE(test_aligned_alloc) {
     for (size_t align = sizeof(void*); align <= 65536; align <<= 1) {
         for (size_t size = align; size <= align * 2; size <<= 1) {
@@ -312,6 +338,140 @@ SEASTAR_TEST_CASE(test_diagnostics_allocation) {
 }
 
 
+SEASTAR_TEST_CASE(test_size_class_stats) {
+    auto find_pool = [] (const memory::size_class_statistics& stats, size_t size) {
+        auto it = std::find_if(stats.small_pools.begin(), stats.small_pools.end(), [size] (auto& p) {
+            return p.object_size >= size;
+        });
+        BOOST_REQUIRE(it != stats.small_pools.end());
+        return *it;
+    };
+    auto before = find_pool(memory::size_class_stats(), 1000);
+
+    std::vector<std::unique_ptr<char[]>> objects;
+    objects.reserve(1000);
+    for (int i = 0; i < 1000; i++) {
+        objects.emplace_back(new char[before.object_size]);
+    }
+    auto stats = memory::size_class_stats();
+    auto after = find_pool(stats, 1000);
+    BOOST_REQUIRE_EQUAL(after.object_size, before.object_size);
+    BOOST_REQUIRE_GE(after.live_objects, before.live_objects + 1000);
+    BOOST_REQUIRE_GE(after.pages * memory::page_size, after.live_objects * after.object_size);
+    BOOST_REQUIRE_GE(after.fragmentation(), 0);
+    BOOST_REQUIRE_LT(after.fragmentation(), 1);
+
+    BOOST_REQUIRE(!stats.spans.empty());
+    size_t free_pages = 0;
+    for (auto& s : stats.spans) {
+        BOOST_REQUIRE_LE(s.free_pages, s.free_spans << s.order);
+        free_pages += s.free_pages;
+    }
+    BOOST_REQUIRE_LE(free_pages * memory::page_size, memory::stats().free_memory());
+    BOOST_REQUIRE_GE(stats.free_memory_fragmentation(), 0);
+    BOOST_REQUIRE_LE(stats.free_memory_fragmentation(), 1);
+
+    return make_ready_future<>();
+}
+
+
+SEASTAR_TEST_CASE(test_small_pool_compaction) {
+    auto pool_stats = [] {
+        auto stats = memory::size_class_stats();
+        return *std::find_if(stats.small_pools.begin(), stats.small_pools.end(), [] (auto& p) {
+            return p.object_size >= 3000;
+        });
+    };
+    auto before = pool_stats();
+
+    std::vector<std::unique_ptr<char[]>> objects;
+    for (int i = 0; i < 2000; i++) {
+        objects.emplace_back(new char[before.object_size]);
+    }
+    // Free every other object first, so the free objects are spread over
+    // all the spans of the burst
+    for (size_t i = 0; i < objects.size(); i += 2) {
+        objects[i].reset();
+    }
+    objects.clear();
+    auto burst = pool_stats();
+
+    // The first compaction sees the refills of the burst and keeps the
+    // free objects, the second finds the pool idle
+    memory::compact_small_pools();
+    memory::compact_small_pools();
+    auto after = pool_stats();
+    BOOST_REQUIRE_EQUAL(after.live_objects, before.live_objects);
+    BOOST_REQUIRE_LT(after.pages, burst.pages);
+    BOOST_REQUIRE_LE(after.pages, before.pages);
+
+    return make_ready_future<>();
+}
+
+
+SEASTAR_TEST_CASE(test_huge_page_placement) {
+    auto before = memory::huge_page_stats(true);
+    BOOST_REQUIRE_EQUAL(before.regions * memory::huge_page_size, memory::stats().total_memory());
+    BOOST_REQUIRE_LE(before.free_regions + before.mixed_regions, before.regions);
+    BOOST_REQUIRE_GE(before.huge_page_backed_fraction(), 0);
+    BOOST_REQUIRE_LE(before.huge_page_backed_fraction(), 1);
+
+    // Large allocations and small pool spans made in turns still end up
+    // in separate regions
+    std::vector<std::unique_ptr<char[]>> large, small;
+    large.reserve(64);
+    small.reserve(64 * 64);
+    for (int i = 0; i < 64; i++) {
+        large.emplace_back(new char[64 << 10]);
+        for (int j = 0; j < 64; j++) {
+            small.emplace_back(new char[1000]);
+        }
+    }
+    auto after = memory::huge_page_stats();
+    BOOST_REQUIRE_LE(after.mixed_regions, before.mixed_regions + 2);
+
+    return make_ready_future<>();
+}
+
+
+SEASTAR_TEST_CASE(test_sampling_heap_profiler) {
+    auto live_bytes = [] {
+        double ret = 0;
+        for (auto& site : memory::sampled_heap_profile()) {
+            ret += site.live_bytes;
+        }
+        return ret;
+    };
+    auto before = live_bytes();
+
+    memory::set_heap_sampling_rate(4096);
+    std::vector<std::unique_ptr<char[]>> objects;
+    objects.reserve(1000);
+    for (int i = 0; i < 1000; i++) {
+        objects.emplace_back(new char[1024]);
+    }
+    memory::set_heap_sampling_rate(0);
+    BOOST_REQUIRE_EQUAL(memory::get_heap_sampling_rate(), 0);
+
+    // About 250 samples, the estimate is well within a factor of 2
+    auto sampled = live_bytes() - before;
+    BOOST_REQUIRE_GT(sampled, 1000 * 1024 / 2);
+    BOOST_REQUIRE_LT(sampled, 1000 * 1024 * 2);
+
+    std::ostringstream os;
+    heap_profiler::write_pprof(os, memory::sampled_heap_profile());
+    BOOST_REQUIRE(os.str().starts_with("heap profile: "));
+    BOOST_REQUIRE_NE(os.str().find("MAPPED_LIBRARIES:"), std::string::npos);
+
+    // Freed samples are no longer live, even with sampling disabled
+    objects.clear();
+    objects.shrink_to_fit();
+    BOOST_REQUIRE_LT(live_bytes() - before, 1000 * 1024 / 4);
+
+    return make_ready_future<>();
+}
+
+
 #endif // #ifndef SEASTAR_DEFAULT_ALLOCATOR
 
 SEASTAR_TEST_CASE(test_large_allocation_warning_off_by_one) {
@@ -0,0 +1,247 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/when_all.hh>
+
+using namespace seastar;
+
+namespace {
+
+// A file kept in memory, counting the reads reaching it
+class memory_file final : public file_impl {
+    std::vector<char> _data;
+public:
+    unsigned reads = 0;
+    // Reads wait for this, when set
+    std::optional<shared_promise<>> hold;
+
+    explicit memory_file(size_t size) : _data(size) {
+        for (size_t i = 0; i < size; i++) {
+            _data[i] = char(i * 7 + i / 4096);
+        }
+    }
+    const std::vector<char>& data() const noexcept { return _data; }
+
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class&) override {
+        if (pos + len > _data.size()) {
+            _data.resize(pos + len);
+        }
+        std::copy_n(static_cast<const char*>(buffer), len, _data.data() + pos);
+        return make_ready_future<size_t>(len);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        size_t done = 0;
+        for (auto& v : iov) {
+            write_dma(pos + done, v.iov_base, v.iov_len, pc).get();
+            done += v.iov_len;
+        }
+        return make_ready_future<size_t>(done);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class&) override {
+        return make_exception_future<size_t>(std::bad_function_call());
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class&) override {
+        return make_exception_future<size_t>(std::bad_function_call());
+    }
+    virtual future<> flush() override {
+        return make_ready_future<>();
+    }
+    virtual future<struct stat> stat() override {
+        return make_exception_future<struct stat>(std::bad_function_call());
+    }
+    virtual future<> truncate(uint64_t length) override {
+        _data.resize(length);
+        return make_ready_future<>();
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return make_ready_future<>();
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return make_ready_future<>();
+    }
+    virtual future<uint64_t> size() override {
+        return make_ready_future<uint64_t>(_data.size());
+    }
+    virtual future<> close() override {
+        return make_ready_future<>();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)>) override {
+        throw std::bad_function_call();
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class&) override {
+        reads++;
+        auto wait = hold ? hold->get_shared_future() : make_ready_future<>();
+        return wait.then([this, offset, range_size] {
+            auto start = std::min<uint64_t>(offset, _data.size());
+            auto len = std::min<uint64_t>(range_size, _data.size() - start);
+            return temporary_buffer<uint8_t>(reinterpret_cast<const uint8_t*>(_data.data() + start), len);
+        });
+    }
+};
+
+struct cached {
+    shared_ptr<memory_file> mem;
+    file f;
+
+    cached(size_t size, block_cache& cache)
+        : mem(make_shared<memory_file>(size))
+        , f(make_cached_file(file(mem), cache))
+    { }
+    ~cached() {
+        f.close().get();
+    }
+
+    sstring read(uint64_t pos, size_t len) {
+        auto buf = f.dma_read_bulk<char>(pos, len).get0();
+        return sstring(buf.get(), buf.size());
+    }
+    sstring expected(uint64_t pos, size_t len) const {
+        auto& d = mem->data();
+        pos = std::min<uint64_t>(pos, d.size());
+        return sstring(d.data() + pos, std::min<uint64_t>(len, d.size() - pos));
+    }
+};
+
+block_cache::config cache_config(size_t capacity) {
+    block_cache::config cfg;
+    cfg.capacity = capacity;
+    cfg.block_size = 4096;
+    cfg.name = "test";
+    return cfg;
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cached_file_reads) {
+    block_cache cache(cache_config(1 << 20));
+    cached c(5 * 4096 + 100, cache);
+
+    BOOST_REQUIRE_EQUAL(c.read(100, 200), c.expected(100, 200));
+    BOOST_REQUIRE_EQUAL(c.mem->reads, 1);
+    BOOST_REQUIRE_EQUAL(c.read(300, 1000), c.expected(300, 1000));
+    BOOST_REQUIRE_EQUAL(c.mem->reads, 1);
+
+    // Across blocks and up to the end of the file
+    BOOST_REQUIRE_EQUAL(c.read(4000, 3 * 4096), c.expected(4000, 3 * 4096));
+    BOOST_REQUIRE_EQUAL(c.read(4 * 4096, 8192), c.expected(4 * 4096, 8192));
+    BOOST_REQUIRE_EQUAL(c.read(6 * 4096, 100), "");
+    BOOST_REQUIRE_EQUAL(c.mem->reads, 7);
+
+    std::vector<char> buf(8192);
+    auto n = c.f.dma_read(4096 - 10, buf.data(), buf.size()).get0();
+    BOOST_REQUIRE_EQUAL(n, buf.size());
+    BOOST_REQUIRE_EQUAL(sstring(buf.data(), n), c.expected(4096 - 10, buf.size()));
+    BOOST_REQUIRE_EQUAL(c.mem->reads, 7);
+
+    BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 7);
+    BOOST_REQUIRE_GE(cache.get_stats().hits, 4);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().bytes, 5 * 4096 + 100);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cached_file_input_stream) {
+    block_cache cache(cache_config(1 << 20));
+    cached c(100000, cache);
+
+    auto read_all = [&] {
+        file_input_stream_options opts;
+        opts.buffer_size = 8192;
+        auto in = make_file_input_stream(c.f, opts);
+        sstring ret;
+        while (auto buf = in.read().get0()) {
+            ret += sstring(buf.get(), buf.size());
+        }
+        in.close().get();
+        return ret;
+    };
+    BOOST_REQUIRE_EQUAL(read_all(), c.expected(0, 100000));
+    auto reads = c.mem->reads;
+    BOOST_REQUIRE_EQUAL(read_all(), c.expected(0, 100000));
+    BOOST_REQUIRE_EQUAL(c.mem->reads, reads);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cached_file_coalescing) {
+    block_cache cache(cache_config(1 << 20));
+    cached c(4 * 4096, cache);
+
+    c.mem->hold.emplace();
+    auto f1 = c.f.dma_read_bulk<char>(0, 100);
+    auto f2 = c.f.dma_read_bulk<char>(1000, 100);
+    auto f3 = c.f.dma_read_bulk<char>(4000, 200);
+    c.mem->hold->set_value();
+    c.mem->hold.reset();
+    auto [b1, b2, b3] = when_all_succeed(std::move(f1), std::move(f2), std::move(f3)).get();
+    BOOST_REQUIRE_EQUAL(sstring(b1.get(), b1.size()), c.expected(0, 100));
+    BOOST_REQUIRE_EQUAL(sstring(b2.get(), b2.size()), c.expected(1000, 100));
+    BOOST_REQUIRE_EQUAL(sstring(b3.get(), b3.size()), c.expected(4000, 200));
+    BOOST_REQUIRE_EQUAL(c.mem->reads, 2);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().coalesced, 2);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cached_file_invalidation) {
+    block_cache cache(cache_config(1 << 20));
+    cached c(4 * 4096, cache);
+
+    c.read(0, 4 * 4096);
+    auto data = sstring(4096, 'x');
+    c.f.dma_write(4096, data.data(), data.size()).get();
+    BOOST_REQUIRE_EQUAL(c.read(4000, 200), c.expected(4000, 200));
+    BOOST_REQUIRE_EQUAL(cache.get_stats().invalidations, 1);
+
+    // A read in flight during a write doesn't cache stale data
+    c.f.dma_write(4096, data.data(), data.size()).get();
+    c.mem->hold.emplace();
+    auto f = c.f.dma_read_bulk<char>(4096, 100);
+    c.f.dma_write(4096, data.data(), data.size()).get();
+    c.mem->hold->set_value();
+    c.mem->hold.reset();
+    f.get();
+    auto reads = c.mem->reads;
+    BOOST_REQUIRE_EQUAL(c.read(4096, 100), c.expected(4096, 100));
+    BOOST_REQUIRE_EQUAL(c.mem->reads, reads + 1);
+
+    c.f.truncate(4096 + 10).get();
+    BOOST_REQUIRE_EQUAL(c.read(0, 4 * 4096), c.expected(0, 4 * 4096));
+    BOOST_REQUIRE_EQUAL(cache.get_stats().bytes, 4096 + 10);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cached_file_eviction) {
+    block_cache cache(cache_config(4 * 4096));
+    cached c(16 * 4096, cache);
+
+    // Blocks 0 and 1 are used twice and get protected
+    c.read(0, 2 * 4096);
+    c.read(0, 2 * 4096);
+    auto reads = c.mem->reads;
+
+    // A scan doesn't push them out
+    c.read(2 * 4096, 14 * 4096);
+    BOOST_REQUIRE_LE(cache.get_stats().bytes, cache.capacity());
+    BOOST_REQUIRE_GE(cache.get_stats().evictions, 12);
+    c.read(0, 2 * 4096);
+    BOOST_REQUIRE_EQUAL(c.mem->reads, reads + 14);
+
+    BOOST_REQUIRE_EQUAL(cache.evict(1), 4096);
+    cache.set_capacity(0);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().bytes, 0);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().blocks, 0);
+}
@@ -26,6 +26,7 @@
 #include <seastar/testing/test_runner.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/fair_queue.hh>
+#include <seastar/core/smp.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/util/later.hh>
 #include <seastar/core/sleep.hh>
@@ -447,3 +448,245 @@ SEASTAR_THREAD_TEST_CASE(test_fair_queue_random_run) {
     auto expected_error = std::max(1, int(round(reqs * 0.05)));
     env.verify(format("random_run ({:d} requests)", reqs), {1, 1}, expected_error);
 }
+
+// Requests due soon overtake the others of their class, overdue ones are not dispatched
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_deadlines) {
+    fair_group::config gcfg;
+    gcfg.weight_rate = 1'000'000;
+    gcfg.size_rate = std::numeric_limits<int>::max();
+    gcfg.rate_limit_duration = 1ms;
+    fair_group fg(gcfg);
+
+    fair_queue::config qcfg;
+    qcfg.deadline_horizon = 5ms;
+    fair_queue fq(fg, qcfg);
+    fq.register_priority_class(0, 100);
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<fair_queue_entry>> ents;
+    auto queue = [&] (std::optional<std::chrono::steady_clock::time_point> deadline) {
+        ents.push_back(std::make_unique<fair_queue_entry>(fair_queue_ticket(1, 0)));
+        if (deadline) {
+            ents.back()->set_deadline(*deadline);
+        }
+        fq.queue(0, *ents.back());
+    };
+    queue(std::nullopt);
+    queue(now + 1h);
+    queue(now + 1ms);
+    queue(now - 1ms);
+
+    auto index_of = [&] (fair_queue_entry& ent) {
+        return std::find_if(ents.begin(), ents.end(), [&] (auto& e) { return e.get() == &ent; }) - ents.begin();
+    };
+    std::vector<long> dispatched, expired;
+    fq.dispatch_requests([&] (fair_queue_entry& ent) {
+        dispatched.push_back(index_of(ent));
+    }, [&] (fair_queue_entry& ent) {
+        expired.push_back(index_of(ent));
+    });
+
+    BOOST_REQUIRE_EQUAL(expired, std::vector<long>({3}));
+    BOOST_REQUIRE_EQUAL(dispatched, std::vector<long>({2, 0, 1}));
+    for (auto i : dispatched) {
+        fq.notify_request_finished(ents[i]->ticket());
+    }
+    fq.unregister_priority_class(0);
+}
+
+// Requests with a deadline that is not close keep their place in the queue
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_deadline_keeps_fifo_order) {
+    fair_group::config gcfg;
+    gcfg.weight_rate = 1'000'000;
+    gcfg.size_rate = std::numeric_limits<int>::max();
+    gcfg.rate_limit_duration = 1ms;
+    fair_group fg(gcfg);
+
+    fair_queue::config qcfg;
+    qcfg.deadline_horizon = 5ms;
+    fair_queue fq(fg, qcfg);
+    fq.register_priority_class(0, 100);
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<fair_queue_entry>> ents;
+    auto queue = [&] (std::optional<std::chrono::steady_clock::time_point> deadline) {
+        ents.push_back(std::make_unique<fair_queue_entry>(fair_queue_ticket(1, 0)));
+        if (deadline) {
+            ents.back()->set_deadline(*deadline);
+        }
+        fq.queue(0, *ents.back());
+    };
+    queue(now + 1h);
+    queue(std::nullopt);
+    queue(now + 2h);
+    queue(std::nullopt);
+
+    auto index_of = [&] (fair_queue_entry& ent) {
+        return std::find_if(ents.begin(), ents.end(), [&] (auto& e) { return e.get() == &ent; }) - ents.begin();
+    };
+    std::vector<long> dispatched;
+    fq.dispatch_requests([&] (fair_queue_entry& ent) {
+        dispatched.push_back(index_of(ent));
+    }, [&] (fair_queue_entry& ent) {
+        BOOST_FAIL("unexpected expiry");
+    });
+
+    BOOST_REQUIRE_EQUAL(dispatched, std::vector<long>({0, 1, 2, 3}));
+    for (auto i : dispatched) {
+        fq.notify_request_finished(ents[i]->ticket());
+    }
+    fq.unregister_priority_class(0);
+}
+
+// An entry that grows while capacity is pending for it is still dispatched
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_pending_entry_grows) {
+    fair_group::config gcfg;
+    gcfg.weight_rate = 1'000'000;
+    gcfg.size_rate = std::numeric_limits<int>::max();
+    gcfg.rate_limit_duration = 1ms;
+    fair_group fg(gcfg);
+
+    fair_queue fq(fg, fair_queue::config());
+    fq.register_priority_class(0, 100);
+
+    // The group capacity covers a thousand such requests
+    std::vector<fair_queue_entry> ents;
+    ents.reserve(2000);
+    for (unsigned i = 0; i < 2000; i++) {
+        ents.emplace_back(fair_queue_ticket(1, 0));
+        fq.queue(0, ents.back());
+    }
+    std::vector<fair_queue_entry*> dispatched;
+    auto nr = dispatched.size();
+    do {
+        nr = dispatched.size();
+        fq.dispatch_requests([&] (fair_queue_entry& ent) { dispatched.push_back(&ent); });
+    } while (dispatched.size() != nr);
+    BOOST_REQUIRE_LT(nr, ents.size());
+
+    // The head waits for capacity, as if a read was merged into it
+    auto& head = ents[nr];
+    fq.update_request_ticket(head, fair_queue_ticket(2, 0));
+    for (auto ent : dispatched) {
+        fq.notify_request_finished(ent->ticket());
+    }
+    dispatched.clear();
+
+    for (unsigned i = 0; i < 100 && dispatched.empty(); i++) {
+        sleep(1ms).get();
+        fq.dispatch_requests([&] (fair_queue_entry& ent) { dispatched.push_back(&ent); });
+    }
+    BOOST_REQUIRE(!dispatched.empty());
+    BOOST_REQUIRE_EQUAL(dispatched.front(), &head);
+
+    for (auto ent : dispatched) {
+        fq.notify_request_finished(ent->ticket());
+    }
+    while (dispatched.size() < ents.size() - nr) {
+        fq.dispatch_requests([&] (fair_queue_entry& ent) {
+            dispatched.push_back(&ent);
+            fq.notify_request_finished(ent.ticket());
+        });
+    }
+    fq.unregister_priority_class(0);
+}
+
+// A bigger request due soon overtakes the one capacity is pending for
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_deadline_overtakes_pending) {
+    fair_group::config gcfg;
+    gcfg.weight_rate = 1'000'000;
+    gcfg.size_rate = std::numeric_limits<int>::max();
+    gcfg.rate_limit_duration = 1ms;
+    fair_group fg(gcfg);
+
+    fair_queue::config qcfg;
+    qcfg.deadline_horizon = 1h;
+    fair_queue fq(fg, qcfg);
+    fq.register_priority_class(0, 100);
+
+    std::vector<fair_queue_entry> ents;
+    ents.reserve(2001);
+    for (unsigned i = 0; i < 2000; i++) {
+        ents.emplace_back(fair_queue_ticket(1, 0));
+        fq.queue(0, ents.back());
+    }
+    std::vector<fair_queue_entry*> dispatched;
+    auto nr = dispatched.size();
+    do {
+        nr = dispatched.size();
+        fq.dispatch_requests([&] (fair_queue_entry& ent) { dispatched.push_back(&ent); });
+    } while (dispatched.size() != nr);
+    BOOST_REQUIRE_LT(nr, ents.size());
+
+    auto& urgent = ents.emplace_back(fair_queue_ticket(5, 0));
+    urgent.set_deadline(std::chrono::steady_clock::now() + 1h);
+    fq.queue(0, urgent);
+    for (auto ent : dispatched) {
+        fq.notify_request_finished(ent->ticket());
+    }
+    dispatched.clear();
+
+    for (unsigned i = 0; i < 100 && dispatched.empty(); i++) {
+        sleep(1ms).get();
+        fq.dispatch_requests([&] (fair_queue_entry& ent) { dispatched.push_back(&ent); });
+    }
+    BOOST_REQUIRE(!dispatched.empty());
+    BOOST_REQUIRE_EQUAL(dispatched.front(), &urgent);
+
+    for (auto ent : dispatched) {
+        fq.notify_request_finished(ent->ticket());
+    }
+    while (dispatched.size() < ents.size() - nr) {
+        fq.dispatch_requests([&] (fair_queue_entry& ent) {
+            dispatched.push_back(&ent);
+            fq.notify_request_finished(ent.ticket());
+        });
+    }
+    fq.unregister_priority_class(0);
+}
+
+// A shard with queued requests may dispatch the capacity idle siblings don't use
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_capacity_borrowing) {
+    auto dispatch_all = [] (bool borrowing) {
+        fair_group::config gcfg;
+        gcfg.weight_rate = 1'000'000;
+        gcfg.size_rate = std::numeric_limits<int>::max();
+        gcfg.rate_limit_duration = 1ms;
+        gcfg.capacity_borrowing = borrowing;
+        fair_group fg(gcfg);
+
+        fair_queue hot(fg, fair_queue::config());
+        fair_queue idle(fg, fair_queue::config());
+        hot.register_priority_class(0, 100);
+        idle.register_priority_class(0, 100);
+
+        std::vector<fair_queue_entry> ents;
+        ents.reserve(2000);
+        for (unsigned i = 0; i < 2000; i++) {
+            ents.emplace_back(fair_queue_ticket(1, 0));
+            hot.queue(0, ents.back());
+        }
+        std::vector<fair_queue_entry*> dispatched;
+        hot.dispatch_requests([&] (fair_queue_entry& ent) { dispatched.push_back(&ent); });
+        idle.dispatch_requests([] (fair_queue_entry&) { BOOST_FAIL("nothing to dispatch"); });
+
+        auto nr = dispatched.size();
+        auto done = nr;
+        for (auto ent : dispatched) {
+            hot.notify_request_finished(ent->ticket());
+        }
+        while (done < ents.size()) {
+            hot.dispatch_requests([&] (fair_queue_entry& ent) {
+                hot.notify_request_finished(ent.ticket());
+                done++;
+            });
+        }
+        hot.unregister_priority_class(0);
+        idle.unregister_priority_class(0);
+        return nr;
+    };
+
+    // The group capacity covers a thousand such requests
+    BOOST_REQUIRE_LE(dispatch_all(false), 1000 / smp::count + 1);
+    BOOST_REQUIRE_GE(dispatch_all(true), 1000);
+}
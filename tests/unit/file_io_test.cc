@@ -888,6 +888,25 @@ SEASTAR_TEST_CASE(test_intent) {
     });
 }
 
+SEASTAR_TEST_CASE(test_dma_write_and_sync) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get0();
+        auto buf = allocate_aligned_buffer<unsigned char>(4096, 4096);
+        for (unsigned i = 0; i < 4; i++) {
+            std::fill(buf.get(), buf.get() + 4096, 'a' + i);
+            auto count = f.dma_write_and_sync(i * 4096, buf.get(), 4096).get0();
+            BOOST_REQUIRE_EQUAL(count, 4096);
+        }
+        auto rbuf = allocate_aligned_buffer<unsigned char>(4096, 4096);
+        for (unsigned i = 0; i < 4; i++) {
+            f.dma_read(i * 4096, rbuf.get(), 4096).get();
+            BOOST_REQUIRE(std::all_of(rbuf.get(), rbuf.get() + 4096, [i] (unsigned char c) { return c == 'a' + i; }));
+        }
+        f.close().get();
+    });
+}
+
 SEASTAR_TEST_CASE(parallel_overwrite) {
     // Avoid /tmp for tmp_dir, since it can be tmpfs
     return tmp_dir::do_with("XXXXXXXX.tmp", [] (tmp_dir& t) {
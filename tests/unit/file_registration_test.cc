@@ -0,0 +1,87 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Runs both with and without --io-uring-register-files, see CMakeLists.txt
+
+#include <seastar/core/file.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/util/tmp_file.hh>
+
+using namespace seastar;
+
+static void write_pattern(file& f, char c) {
+    auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 4096);
+    std::fill_n(buf.get_write(), buf.size(), c);
+    BOOST_REQUIRE_EQUAL(f.dma_write(0, buf.get(), buf.size()).get0(), buf.size());
+    f.flush().get();
+}
+
+static char read_pattern(file& f) {
+    auto buf = f.dma_read_exactly<char>(0, 4096).get0();
+    BOOST_REQUIRE_EQUAL(buf.size(), 4096);
+    BOOST_REQUIRE(std::all_of(buf.begin(), buf.end(), [&buf] (char c) { return c == buf[0]; }));
+    return buf[0];
+}
+
+// Closed descriptors are reused by the next files opened, which must not
+// do their I/O to the registration of the closed ones
+SEASTAR_TEST_CASE(file_registration_reuse_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto name = [&t] (unsigned i) {
+            return (t.get_path() / fmt::format("file-{}", i)).native();
+        };
+        constexpr unsigned nr = 16;
+        for (unsigned i = 0; i < nr; i++) {
+            auto f = open_file_dma(name(i), open_flags::rw | open_flags::create).get0();
+            write_pattern(f, 'a' + i);
+            if (i % 2) {
+                f.close().get();
+            }
+            // The others are closed by the destructor
+        }
+        for (unsigned i = 0; i < nr; i++) {
+            auto f = open_file_dma(name(i), open_flags::ro).get0();
+            BOOST_REQUIRE_EQUAL(read_pattern(f), char('a' + i));
+            f.close().get();
+        }
+    });
+}
+
+// Each shard registers the files it opens with its own reactor
+SEASTAR_TEST_CASE(file_registration_dup_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto name = (t.get_path() / "file").native();
+        auto f = open_file_dma(name, open_flags::rw | open_flags::create).get0();
+        write_pattern(f, 'x');
+        auto h = f.dup();
+        smp::submit_to((this_shard_id() + 1) % smp::count, [h = std::move(h)] () mutable {
+            return seastar::async([h = std::move(h)] {
+                auto f = std::move(h).to_file();
+                BOOST_REQUIRE_EQUAL(read_pattern(f), 'x');
+                write_pattern(f, 'y');
+                f.close().get();
+            });
+        }).get();
+        BOOST_REQUIRE_EQUAL(read_pattern(f), 'y');
+        f.close().get();
+    });
+}
@@ -539,6 +539,42 @@ SEASTAR_TEST_CASE(test_fstream_slow_start) {
     });
 }
 
+SEASTAR_TEST_CASE(test_read_ahead_engine) {
+    using engine_t = internal::read_ahead_engine;
+    using pattern = engine_t::access_pattern;
+
+    auto streams = [] (std::vector<std::pair<uint64_t, uint64_t>> ranges) {
+        engine_t e;
+        for (auto [start, end] : ranges) {
+            e.on_stream_start(start);
+            e.on_stream_end(end);
+        }
+        return e.pattern();
+    };
+    BOOST_REQUIRE(streams({{0, 100}}) == pattern::unknown);
+    BOOST_REQUIRE(streams({{0, 100}, {100, 250}, {250, 300}}) == pattern::sequential);
+    BOOST_REQUIRE(streams({{0, 100}, {1000, 1100}, {2000, 2100}, {3000, 3100}}) == pattern::strided);
+    BOOST_REQUIRE(streams({{3000, 3100}, {2000, 2100}, {1000, 1100}, {0, 100}}) == pattern::reverse);
+    BOOST_REQUIRE(streams({{0, 100}, {7000, 7100}, {300, 400}, {5000, 5100}}) == pattern::random);
+
+    engine_t e;
+    BOOST_REQUIRE_EQUAL(e.wanted_read_ahead(128 << 10), 0);
+    // A buffer consumed every millisecond, reads take 4.5ms
+    for (int i = 0; i < 10; i++) {
+        e.on_consumed(128 << 10, std::chrono::milliseconds(1));
+        e.on_read(std::chrono::microseconds(4500));
+    }
+    BOOST_REQUIRE_EQUAL(e.wanted_read_ahead(128 << 10), 6);
+    BOOST_REQUIRE(!e.backlogged());
+
+    // Reads waiting in the queue behind others
+    for (int i = 0; i < 5; i++) {
+        e.on_read(std::chrono::milliseconds(500));
+    }
+    BOOST_REQUIRE(e.backlogged());
+    return make_ready_future<>();
+}
+
 #ifdef SEASTAR_ENABLE_ALLOC_FAILURE_INJECTION
 
 SEASTAR_TEST_CASE(test_close_error) {
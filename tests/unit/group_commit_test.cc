@@ -0,0 +1,153 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <seastar/testing/test_case.hh>
+
+#include <seastar/core/group_commit.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/util/tmp_file.hh>
+#include <boost/range/irange.hpp>
+
+using namespace seastar;
+
+static sstring record(unsigned i) {
+    return sstring(1 + (i * 997) % 3000, char('a' + i % 26));
+}
+
+static sstring read_file(sstring name) {
+    auto f = open_file_dma(name, open_flags::ro).get0();
+    auto size = f.size().get0();
+    auto in = make_file_input_stream(f);
+    auto buf = in.read_exactly(size).get0();
+    in.close().get();
+    return sstring(buf.get(), buf.size());
+}
+
+SEASTAR_TEST_CASE(test_group_commit_appends) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto name = (t.get_path() / "log").native();
+        auto f = open_file_dma(name, open_flags::rw | open_flags::create).get0();
+        group_commit_writer w(f);
+
+        constexpr unsigned nr = 200;
+        std::vector<uint64_t> positions(nr);
+        parallel_for_each(boost::irange(0u, nr), [&] (unsigned i) {
+            return w.append(record(i)).then([&positions, i] (uint64_t pos) {
+                positions[i] = pos;
+            });
+        }).get();
+        BOOST_REQUIRE_LT(w.get_stats().batches, nr / 2);
+        BOOST_REQUIRE_EQUAL(w.get_stats().appends, nr);
+
+        auto pos = w.append("tail").get0();
+        BOOST_REQUIRE_EQUAL(pos + 4, w.position());
+        w.close().get();
+
+        auto data = read_file(name);
+        BOOST_REQUIRE_EQUAL(data.size(), w.position());
+        for (unsigned i = 0; i < nr; i++) {
+            auto r = record(i);
+            BOOST_REQUIRE_EQUAL(data.substr(positions[i], r.size()), r);
+        }
+        BOOST_REQUIRE_EQUAL(data.substr(pos, 4), "tail");
+    });
+}
+
+SEASTAR_TEST_CASE(test_group_commit_large_appends) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto name = (t.get_path() / "log").native();
+        auto f = open_file_dma(name, open_flags::rw | open_flags::create).get0();
+        group_commit_options opts;
+        opts.max_batch_size = 4096;
+        opts.max_delay = std::chrono::microseconds(0);
+        group_commit_writer w(f, opts);
+
+        auto small = sstring(100, 'x');
+        auto large = sstring(3 * 4096 + 7, 'y');
+        auto f1 = w.append(small);
+        auto f2 = w.append(large);
+        auto f3 = w.append(small);
+        BOOST_REQUIRE_EQUAL(f1.get0(), 0);
+        BOOST_REQUIRE_EQUAL(f2.get0(), 100);
+        BOOST_REQUIRE_EQUAL(f3.get0(), 100 + large.size());
+        w.flush().get();
+        w.close().get();
+
+        BOOST_REQUIRE_EQUAL(read_file(name), small + large + small);
+    });
+}
+
+// Accepts no data at all, as a full device might
+class zero_write_file : public layered_file_impl {
+public:
+    explicit zero_write_file(file f) : layered_file_impl(std::move(f)) {}
+    virtual future<size_t> write_dma(uint64_t, const void*, size_t, const io_priority_class&) override {
+        return make_ready_future<size_t>(0);
+    }
+    virtual future<size_t> write_dma(uint64_t, std::vector<iovec>, const io_priority_class&) override {
+        return make_ready_future<size_t>(0);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return _underlying_file.dma_read(pos, reinterpret_cast<char*>(buffer), len, pc);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return _underlying_file.dma_read(pos, std::move(iov), pc);
+    }
+    virtual future<> flush() override {
+        return _underlying_file.flush();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat();
+    }
+    virtual future<> truncate(uint64_t length) override {
+        return _underlying_file.truncate(length);
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return _underlying_file.discard(offset, length);
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return _underlying_file.allocate(position, length);
+    }
+    virtual future<uint64_t> size() override {
+        return _underlying_file.size();
+    }
+    virtual future<> close() override {
+        return _underlying_file.close();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return _underlying_file.dma_read_bulk<uint8_t>(offset, range_size, pc);
+    }
+};
+
+SEASTAR_TEST_CASE(test_group_commit_zero_write) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto name = (t.get_path() / "log").native();
+        auto f = open_file_dma(name, open_flags::rw | open_flags::create).get0();
+        group_commit_writer w(file(make_shared<zero_write_file>(std::move(f))));
+
+        BOOST_REQUIRE_THROW(w.append("record").get(), std::system_error);
+        BOOST_REQUIRE_THROW(w.append("record").get(), std::system_error);
+        BOOST_REQUIRE_THROW(w.close().get(), std::system_error);
+    });
+}
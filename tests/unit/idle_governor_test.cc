@@ -0,0 +1,71 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/internal/idle_governor.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+using idle_governor = internal::idle_governor;
+
+static void feed(idle_governor& g, std::chrono::nanoseconds gap, unsigned count) {
+    while (count--) {
+        g.on_idle_end(gap);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_starts_with_max_poll_time) {
+    idle_governor g(200us);
+    BOOST_REQUIRE(g.poll_time() == 200us);
+}
+
+BOOST_AUTO_TEST_CASE(test_short_gaps_poll_then_sleep) {
+    idle_governor g(200us);
+    feed(g, 20us, 1000);
+    BOOST_REQUIRE(g.current_mode() == idle_governor::mode::poll_then_sleep);
+    BOOST_REQUIRE_GE(g.poll_time(), 20us);
+    BOOST_REQUIRE_LT(g.poll_time(), 200us);
+}
+
+BOOST_AUTO_TEST_CASE(test_long_gaps_sleep) {
+    idle_governor g(200us);
+    feed(g, 5ms, 1000);
+    BOOST_REQUIRE(g.current_mode() == idle_governor::mode::sleep);
+    BOOST_REQUIRE(g.poll_time() == 0ns);
+}
+
+BOOST_AUTO_TEST_CASE(test_slow_wakeups_spin) {
+    idle_governor g(200us);
+    for (int i = 0; i < 100; i++) {
+        g.on_wakeup(100us);
+    }
+    BOOST_REQUIRE_GT(g.wakeup_latency(), 50us);
+    feed(g, 20us, 1000);
+    BOOST_REQUIRE(g.current_mode() == idle_governor::mode::spin);
+    BOOST_REQUIRE(g.poll_time() == 200us);
+}
+
+BOOST_AUTO_TEST_CASE(test_follows_load_changes) {
+    idle_governor g(200us);
+    feed(g, 5ms, 1000);
+    BOOST_REQUIRE(g.current_mode() == idle_governor::mode::sleep);
+    feed(g, 20us, 1000);
+    BOOST_REQUIRE(g.current_mode() == idle_governor::mode::poll_then_sleep);
+}
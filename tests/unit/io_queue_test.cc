@@ -31,8 +31,10 @@
 #include <seastar/core/file.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/internal/io_rate_controller.hh>
 #include <seastar/core/internal/io_request.hh>
 #include <seastar/core/internal/io_sink.hh>
+#include <seastar/core/internal/latency_histogram.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 
 using namespace seastar;
@@ -75,8 +77,8 @@ struct io_queue_for_tests {
     io_queue queue;
     timer<> kicker;
 
-    io_queue_for_tests()
-        : group(std::make_shared<io_group>(io_queue::config{0}))
+    explicit io_queue_for_tests(io_queue::config cfg = io_queue::config{0})
+        : group(std::make_shared<io_group>(std::move(cfg)))
         , sink()
         , queue(group, sink)
         , kicker([this] { kick(); })
@@ -176,6 +178,54 @@ SEASTAR_THREAD_TEST_CASE(test_large_request_flow_error) {
     do_test_large_request_flow(part_flaw::error);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_read_merging) {
+    io_queue::config cfg{0};
+    cfg.merge_reads = true;
+    cfg.read_merge_gap = 512;
+    io_queue_for_tests tio(cfg);
+
+    std::vector<char> bufs[4];
+    uint64_t positions[4] = { 0, 512, 1536, 8192 };
+    std::vector<future<size_t>> reads;
+    for (unsigned i = 0; i < 4; i++) {
+        bufs[i].resize(512);
+        reads.push_back(tio.queue.queue_request(default_priority_class(), internal::io_direction_and_length(internal::io_direction_and_length::read_idx, 512),
+                internal::io_request::make_read(0, positions[i], bufs[i].data(), 512, false), nullptr, {}));
+    }
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    unsigned submitted = 0;
+    tio.sink.drain([&submitted] (const internal::io_request& rq, io_completion* desc) -> bool {
+        submitted++;
+        if (rq.opcode() == internal::io_request::operation::readv) {
+            // The first three reads, with the hole between the second and the third
+            const auto& op = rq.as<internal::io_request::operation::readv>();
+            BOOST_REQUIRE_EQUAL(op.pos, 0);
+            BOOST_REQUIRE_EQUAL(op.iov_len, 4);
+            for (unsigned i = 0; i < op.iov_len; i++) {
+                std::fill_n(reinterpret_cast<char*>(op.iovec[i].iov_base), op.iovec[i].iov_len, 'a' + i);
+            }
+            // The disk returns less than asked for
+            desc->complete_with(3 * 512 + 256);
+        } else {
+            const auto& op = rq.as<internal::io_request::operation::read>();
+            BOOST_REQUIRE_EQUAL(op.pos, 8192);
+            std::fill_n(op.addr, op.size, 'z');
+            desc->complete_with(op.size);
+        }
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(submitted, 2);
+
+    size_t expected[4] = { 512, 512, 256, 512 };
+    char filler[4] = { 'a', 'b', 'd', 'z' };
+    for (unsigned i = 0; i < 4; i++) {
+        BOOST_REQUIRE_EQUAL(reads[i].get0(), expected[i]);
+        BOOST_REQUIRE_EQUAL(bufs[i][0], filler[i]);
+    }
+}
+
 SEASTAR_THREAD_TEST_CASE(test_intent_safe_ref) {
     auto get_cancelled = [] (internal::intent_reference& iref) -> bool {
         try {
@@ -501,3 +551,62 @@ SEASTAR_TEST_CASE(test_request_iovec_split) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(test_rate_controller) {
+    using namespace std::chrono_literals;
+    internal::io_rate_controller ctl({ .latency_target = 1ms, .min_scale = 0.1, .max_scale = 1.0 });
+    BOOST_REQUIRE_EQUAL(ctl.scale(), 1.0);
+
+    // Idle periods teach nothing
+    BOOST_REQUIRE_EQUAL(ctl.update(0, 0ms), 1.0);
+    // Healthy disk keeps the configured rate
+    BOOST_REQUIRE_EQUAL(ctl.update(100, 50ms), 1.0);
+
+    // Mild overshoot cuts the rate proportionally, a large one by half at most
+    BOOST_REQUIRE_CLOSE(ctl.update(100, 125ms), 0.8, 0.001);
+    BOOST_REQUIRE_CLOSE(ctl.update(100, 10s), 0.4, 0.001);
+
+    // The rate never goes below the lower bound
+    for (int i = 0; i < 10; i++) {
+        ctl.update(100, 10s);
+    }
+    BOOST_REQUIRE_CLOSE(ctl.scale(), 0.1, 0.001);
+
+    // Recovery is gradual, up to the upper bound
+    BOOST_REQUIRE_CLOSE(ctl.update(100, 50ms), 0.145, 0.001);
+    for (int i = 0; i < 100; i++) {
+        ctl.update(100, 50ms);
+    }
+    BOOST_REQUIRE_EQUAL(ctl.scale(), 1.0);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_latency_histogram) {
+    using namespace std::chrono_literals;
+    using hist = internal::latency_histogram;
+
+    // Buckets are contiguous and at most a quarter of their lower bound wide
+    for (uint64_t usec = 1; usec < (1 << 24); usec += usec / 7 + 1) {
+        auto b = hist::bucket_of(usec);
+        BOOST_REQUIRE_GT(hist::bucket_limit(b), usec);
+        if (b > 0) {
+            BOOST_REQUIRE_LE(hist::bucket_limit(b - 1), usec);
+            BOOST_REQUIRE_LE(hist::bucket_limit(b) - hist::bucket_limit(b - 1), std::max<uint64_t>(hist::bucket_limit(b - 1) / 4, 1));
+        }
+    }
+    BOOST_REQUIRE_EQUAL(hist::bucket_of(1ull << 40), hist::nr_buckets - 1);
+
+    hist h;
+    h.add(3us);
+    h.add(100us);
+    h.add(110us);
+    h.add(1h);
+    auto m = h.to_metrics();
+    BOOST_REQUIRE_EQUAL(m.sample_count, 4);
+    BOOST_REQUIRE_EQUAL(m.buckets.size(), hist::nr_buckets - 1);
+    // Cumulative, the hour only counts towards +Inf
+    BOOST_REQUIRE_EQUAL(m.buckets[hist::bucket_of(3)].count, 1);
+    BOOST_REQUIRE_EQUAL(m.buckets[hist::bucket_of(110)].count, 3);
+    BOOST_REQUIRE_EQUAL(m.buckets.back().count, 3);
+    return make_ready_future<>();
+}
@@ -0,0 +1,194 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Runs with several io_uring backend options, see CMakeLists.txt. Other
+// reactor backends ignore them.
+
+#include <seastar/core/file.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/print.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/net/api.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/util/tmp_file.hh>
+#include <boost/range/irange.hpp>
+#include <filesystem>
+#include <fstream>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Value of the reactor metric \c name on this shard, or std::nullopt if the
+// reactor backend doesn't export it
+static std::optional<double> reactor_metric(sstring name) {
+    auto values = metrics::impl::get_values();
+    const auto& metadata = *values->metadata;
+    for (size_t i = 0; i < metadata.size(); i++) {
+        if (metadata[i].mf.name == "reactor_" + name && !values->values[i].empty()) {
+            return values->values[i][0].d();
+        }
+    }
+    return std::nullopt;
+}
+
+static constexpr size_t block_size = 4096;
+static constexpr unsigned nr_blocks = 64;
+
+// Writes nr_blocks blocks concurrently, each filled with a byte telling
+// its position and the round, and reads them back the same way
+static void write_and_read_blocks(file& f, unsigned round) {
+    auto fill = [round] (unsigned i) { return char('a' + (i + round) % 26); };
+    parallel_for_each(boost::irange(0u, nr_blocks), [&f, fill] (unsigned i) {
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), block_size);
+        std::fill_n(buf.get_write(), buf.size(), fill(i));
+        return f.dma_write(i * block_size, buf.get(), buf.size()).then([buf = std::move(buf)] (size_t size) {
+            BOOST_REQUIRE_EQUAL(size, block_size);
+        });
+    }).get();
+    f.flush().get();
+    parallel_for_each(boost::irange(0u, nr_blocks), [&f, fill] (unsigned i) {
+        return f.dma_read_exactly<char>(i * block_size, block_size).then([c = fill(i)] (temporary_buffer<char> buf) {
+            BOOST_REQUIRE_EQUAL(buf.size(), block_size);
+            BOOST_REQUIRE(std::all_of(buf.begin(), buf.end(), [c] (char x) { return x == c; }));
+        });
+    }).get();
+}
+
+// The pauses between the rounds outlast the submission queue polling
+// thread's idle time when run with --io-uring-sqpoll, so that the reactor
+// also has to wake the thread up to get its requests submitted
+SEASTAR_TEST_CASE(io_uring_file_io_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto f = open_file_dma((t.get_path() / "testfile").native(), open_flags::rw | open_flags::create).get0();
+        for (unsigned round = 0; round < 8; round++) {
+            write_and_read_blocks(f, round);
+            sleep(10ms).get();
+        }
+        f.close().get();
+        if (auto wakeups = reactor_metric("io_uring_sqpoll_wakeups")) {
+            BOOST_TEST_MESSAGE(format("io_uring submission queue polling thread woken up {} times", *wakeups));
+        }
+    });
+}
+
+// Requests count as in flight from their submission until their completion
+// is reaped: reads waiting for data keep the count up until it arrives
+SEASTAR_TEST_CASE(io_uring_in_flight_test) {
+    return seastar::async([] {
+        if (!reactor_metric("io_uring_in_flight")) {
+            BOOST_TEST_MESSAGE("Not running on the io_uring reactor backend, skipping");
+            return;
+        }
+        constexpr unsigned nr_conns = 16;
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12348), lo);
+        std::vector<input_stream<char>> ins;
+        std::vector<output_stream<char>> outs;
+        std::vector<connected_socket> sockets;
+        for (unsigned i = 0; i < nr_conns; i++) {
+            auto acc = ss.accept();
+            sockets.push_back(connect(ipv4_addr("127.0.0.1", 12348)).get0());
+            outs.push_back(sockets.back().output());
+            sockets.push_back(acc.get0().connection);
+            ins.push_back(sockets.back().input());
+        }
+
+        // Other requests of the reactor, like timers, come and go, so
+        // only look for a change most of the reads account for
+        sleep(10ms).get();
+        auto idle = *reactor_metric("io_uring_in_flight");
+        std::vector<future<temporary_buffer<char>>> reads;
+        for (auto& in : ins) {
+            reads.push_back(in.read());
+        }
+        sleep(10ms).get();
+        auto busy = *reactor_metric("io_uring_in_flight");
+        BOOST_TEST_MESSAGE(format("{} requests in flight when idle, {} with {} reads waiting", idle, busy, nr_conns));
+        BOOST_REQUIRE_GE(busy, idle + nr_conns / 2);
+        BOOST_REQUIRE_GE(*reactor_metric("io_uring_peak_in_flight"), busy);
+
+        for (auto& out : outs) {
+            out.write("x").get();
+            out.flush().get();
+        }
+        for (auto& r : reads) {
+            BOOST_REQUIRE_EQUAL(r.get0().size(), 1);
+        }
+        sleep(10ms).get();
+        auto done = *reactor_metric("io_uring_in_flight");
+        BOOST_TEST_MESSAGE(format("{} requests in flight after the reads completed", done));
+        BOOST_REQUIRE_LE(done + nr_conns / 2, busy);
+
+        for (auto& out : outs) {
+            out.close().get();
+        }
+        for (auto& in : ins) {
+            in.close().get();
+        }
+    });
+}
+
+// A block device whose queue is set up for polled I/O, or an empty string
+static sstring find_polling_device() {
+    std::error_code ec;
+    for (auto& dev : std::filesystem::directory_iterator("/sys/block", ec)) {
+        std::ifstream io_poll(dev.path() / "queue" / "io_poll");
+        int polls = 0;
+        if (io_poll >> polls && polls) {
+            return "/dev/" + dev.path().filename().native();
+        }
+    }
+    return "";
+}
+
+// With --io-uring-iopoll, O_DIRECT reads of block devices with polling
+// queues go to the polled ring. The device is only read from, as there is
+// no telling what it holds; writes go through io_uring_file_io_test.
+SEASTAR_TEST_CASE(io_uring_polled_read_test) {
+    return seastar::async([] {
+        auto polled = reactor_metric("io_uring_polled_requests");
+        if (!polled) {
+            BOOST_TEST_MESSAGE("No polled io_uring (not enabled or not supported by the kernel), skipping");
+            return;
+        }
+        auto path = find_polling_device();
+        if (path.empty()) {
+            BOOST_TEST_MESSAGE("No block device with polling queues, skipping");
+            return;
+        }
+        file f;
+        try {
+            f = open_file_dma(path, open_flags::ro).get0();
+        } catch (...) {
+            BOOST_TEST_MESSAGE(format("Cannot open {}: {}, skipping", path, std::current_exception()));
+            return;
+        }
+        parallel_for_each(boost::irange(0u, nr_blocks), [&f] (unsigned i) {
+            return f.dma_read_exactly<char>(i * block_size, block_size).then([] (temporary_buffer<char> buf) {
+                BOOST_REQUIRE_EQUAL(buf.size(), block_size);
+            });
+        }).get();
+        f.close().get();
+        BOOST_REQUIRE_GE(*reactor_metric("io_uring_polled_requests"), *polled + nr_blocks);
+    });
+}
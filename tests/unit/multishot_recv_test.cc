@@ -0,0 +1,96 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Runs with --io-uring-multishot, see CMakeLists.txt. Kernels and backends
+// without multishot receive fall back to plain receives.
+
+#include <seastar/core/loop.hh>
+#include <seastar/core/print.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+#include <seastar/testing/test_case.hh>
+#include <boost/range/irange.hpp>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static constexpr unsigned nr_conns = 4;
+static constexpr size_t size = 8 << 20;
+
+static char pattern(size_t pos, unsigned conn) {
+    return 'a' + (pos / 7 + conn) % 26;
+}
+
+// Receives more than the provided buffer ring holds over several
+// connections at once. Some of the receivers are slow, so that received
+// buffers pile up and the multishot requests get cancelled and re-armed.
+SEASTAR_TEST_CASE(multishot_recv_test) {
+    return seastar::async([] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12347), lo);
+
+        auto server = seastar::async([&] {
+            std::vector<future<>> receivers;
+            for (unsigned i = 0; i < nr_conns; i++) {
+                accept_result acc = ss.accept().get0();
+                receivers.push_back(seastar::async([s = std::move(acc.connection)] () mutable {
+                    auto in = s.input();
+                    auto conn_buf = in.read_exactly(sizeof(unsigned)).get0();
+                    unsigned conn;
+                    std::copy_n(conn_buf.get(), sizeof(conn), reinterpret_cast<char*>(&conn));
+                    size_t pos = 0;
+                    while (auto buf = in.read().get0()) {
+                        for (size_t i = 0; i < buf.size(); i++) {
+                            if (buf[i] != pattern(pos + i, conn)) {
+                                BOOST_FAIL(format("connection {} received wrong data at {}", conn, pos + i));
+                            }
+                        }
+                        pos += buf.size();
+                        if (conn % 2) {
+                            sleep(100us).get();
+                        }
+                    }
+                    BOOST_REQUIRE_EQUAL(pos, size);
+                    in.close().get();
+                }));
+            }
+            when_all_succeed(receivers.begin(), receivers.end()).get();
+        });
+
+        parallel_for_each(boost::irange(0u, nr_conns), [&] (unsigned conn) {
+            return seastar::async([conn] {
+                auto s = connect(ipv4_addr("127.0.0.1", 12347)).get0();
+                auto out = s.output();
+                out.write(reinterpret_cast<const char*>(&conn), sizeof(conn)).get();
+                sstring chunk(uninitialized_string(64 << 10));
+                for (size_t pos = 0; pos < size; pos += chunk.size()) {
+                    for (size_t i = 0; i < chunk.size(); i++) {
+                        chunk[i] = pattern(pos + i, conn);
+                    }
+                    out.write(chunk).get();
+                }
+                out.close().get();
+            });
+        }).get();
+        server.get();
+    });
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <seastar/testing/test_case.hh>
+
+#include <seastar/core/segment_file_pool.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/util/tmp_file.hh>
+
+using namespace seastar;
+
+static segment_file_pool::config pool_config(const tmp_dir& t, unsigned reserve) {
+    segment_file_pool::config cfg;
+    cfg.directory = t.get_path().native();
+    cfg.segment_size = 64 << 10;
+    cfg.reserve = reserve;
+    cfg.max_free = 3;
+    return cfg;
+}
+
+static void wait_for_free_segments(segment_file_pool& pool, size_t nr) {
+    while (pool.free_segments() < nr) {
+        sleep(std::chrono::milliseconds(1)).get();
+    }
+}
+
+SEASTAR_TEST_CASE(test_segment_file_pool) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto dir = t.get_path().native();
+        segment_file_pool pool(pool_config(t, 2));
+        pool.start().get();
+        wait_for_free_segments(pool, 2);
+        BOOST_REQUIRE_EQUAL(pool.get_stats().created, 2);
+
+        auto f = pool.acquire("segment-1").get0();
+        BOOST_REQUIRE_EQUAL(f.size().get0(), 64 << 10);
+        BOOST_REQUIRE(file_exists(dir + "/segment-1").get0());
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 4096);
+        std::fill_n(buf.get_write(), buf.size(), 'x');
+        f.dma_write(0, buf.get(), buf.size()).get();
+        f.close().get();
+
+        // The reserve is refilled, and the segment is kept for reuse
+        wait_for_free_segments(pool, 2);
+        pool.recycle("segment-1").get();
+        BOOST_REQUIRE(!file_exists(dir + "/segment-1").get0());
+        BOOST_REQUIRE_EQUAL(pool.free_segments(), 3);
+        BOOST_REQUIRE_EQUAL(pool.get_stats().recycled, 1);
+
+        // Beyond max_free, segments are removed
+        pool.acquire("segment-2").get0().close().get();
+        wait_for_free_segments(pool, 2);
+        pool.acquire("segment-3").get0().close().get();
+        wait_for_free_segments(pool, 2);
+        pool.recycle("segment-2").get();
+        pool.recycle("segment-3").get();
+        BOOST_REQUIRE_EQUAL(pool.free_segments(), 3);
+        BOOST_REQUIRE_EQUAL(pool.get_stats().removed, 1);
+        pool.stop().get();
+
+        // Free segments survive restarts
+        segment_file_pool restarted(pool_config(t, 2));
+        restarted.start().get();
+        BOOST_REQUIRE_EQUAL(restarted.free_segments(), 3);
+        restarted.acquire("segment-4").get0().close().get();
+        restarted.stop().get();
+        BOOST_REQUIRE_EQUAL(restarted.get_stats().created, 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_segment_file_pool_miss) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        segment_file_pool pool(pool_config(t, 0));
+        pool.start().get();
+        auto f = pool.acquire("segment").get0();
+        BOOST_REQUIRE_EQUAL(f.size().get0(), 64 << 10);
+        f.close().get();
+        BOOST_REQUIRE_EQUAL(pool.get_stats().misses, 1);
+        pool.stop().get();
+    });
+}
@@ -33,6 +33,9 @@
 #include <seastar/core/when_all.hh>
 
 #include <seastar/net/posix-stack.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/file.hh>
+#include <seastar/util/tmp_file.hh>
 
 using namespace seastar;
 
@@ -224,3 +227,140 @@ SEASTAR_TEST_CASE(socket_on_close_local_shutdown_test) {
         when_all(std::move(client), std::move(server)).discard_result().get();
     });
 }
+
+SEASTAR_TEST_CASE(socket_send_file_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring content;
+        for (int i = 0; i < 100000; i++) {
+            content += fmt::format("{} ", i);
+        }
+        auto fname = (t.get_path() / "content").native();
+        auto f = open_file_dma(fname, open_flags::rw | open_flags::create).get0();
+        auto wbuf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), align_up<size_t>(content.size(), f.disk_write_dma_alignment()));
+        std::fill(std::copy(content.begin(), content.end(), wbuf.get_write()), wbuf.get_write() + wbuf.size(), 0);
+        f.dma_write(0, wbuf.get(), wbuf.size()).get();
+        f.truncate(content.size()).get();
+        f.flush().get();
+
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12345), lo);
+
+        const uint64_t pos = 7;
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12345)).get0();
+            auto in = cln.input();
+            sstring received;
+            while (auto buf = in.read().get0()) {
+                received.append(buf.get(), buf.size());
+            }
+            in.close().get();
+            BOOST_REQUIRE_EQUAL(received, "head:" + content.substr(pos) + ":tail");
+        });
+
+        auto server = seastar::async([&] {
+            accept_result acc = ss.accept().get0();
+            auto out = acc.connection.output();
+            out.write("head:").get();
+            out.flush_and_wait().get();
+            acc.connection.send_file(f, pos, content.size() - pos).get();
+            out.write(":tail").get();
+            out.close().get();
+        });
+
+        when_all_succeed(std::move(client), std::move(server)).get();
+        f.close().get();
+    });
+}
+
+// sendfile() from an O_DIRECT descriptor only works for block aligned
+// ranges, so unaligned ones must be sent from a descriptor without it,
+// leaving the file's own descriptor alone
+SEASTAR_TEST_CASE(socket_send_file_unaligned_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring content;
+        for (int i = 0; i < 10000; i++) {
+            content += fmt::format("{} ", i);
+        }
+        auto fname = (t.get_path() / "content").native();
+        auto f = open_file_dma(fname, open_flags::rw | open_flags::create).get0();
+        auto wbuf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), align_up<size_t>(content.size(), f.disk_write_dma_alignment()));
+        std::fill(std::copy(content.begin(), content.end(), wbuf.get_write()), wbuf.get_write() + wbuf.size(), 0);
+        f.dma_write(0, wbuf.get(), wbuf.size()).get();
+        f.flush().get();
+        auto flags = f.fcntl(F_GETFL).get0();
+        if (!(flags & O_DIRECT)) {
+            BOOST_TEST_MESSAGE("File system doesn't support O_DIRECT, only testing the buffered path");
+        }
+
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12349), lo);
+
+        const std::vector<std::pair<uint64_t, uint64_t>> ranges = {{0, 1000}, {7, 3}, {4097, 5000}, {8191, 1}};
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12349)).get0();
+            auto in = cln.input();
+            sstring received;
+            while (auto buf = in.read().get0()) {
+                received.append(buf.get(), buf.size());
+            }
+            in.close().get();
+            sstring expected;
+            for (auto [pos, len] : ranges) {
+                expected += content.substr(pos, len);
+            }
+            BOOST_REQUIRE_EQUAL(received, expected);
+        });
+
+        auto server = seastar::async([&] {
+            accept_result acc = ss.accept().get0();
+            auto out = acc.connection.output();
+            for (auto [pos, len] : ranges) {
+                acc.connection.send_file(f, pos, len).get();
+            }
+            out.close().get();
+        });
+
+        when_all_succeed(std::move(client), std::move(server)).get();
+        BOOST_REQUIRE_EQUAL(f.fcntl(F_GETFL).get0(), flags);
+        f.close().get();
+    });
+}
+
+SEASTAR_TEST_CASE(udp_batch_test) {
+    return seastar::async([] {
+        auto rx = make_udp_channel(ipv4_addr("127.0.0.1", 0));
+        auto tx = make_udp_channel(ipv4_addr("127.0.0.1", 0));
+
+        // Equal sized datagrams followed by a shorter one may be sent, and
+        // received, as a single offloaded message
+        std::vector<sstring> payloads;
+        for (int i = 0; i < 40; i++) {
+            payloads.push_back(sstring(size_t(1000), char('a' + i % 26)));
+        }
+        payloads.push_back("tail");
+        std::vector<net::udp_outgoing_datagram> out;
+        for (auto& p : payloads) {
+            out.push_back({rx.local_address(), net::packet(p.data(), p.size())});
+        }
+        tx.send_batch(std::move(out)).get();
+
+        std::vector<sstring> received;
+        while (received.size() < payloads.size()) {
+            auto batch = rx.receive_batch(16).get0();
+            BOOST_REQUIRE(!batch.empty());
+            BOOST_REQUIRE_LE(batch.size(), 16u);
+            for (auto& dgram : batch) {
+                BOOST_REQUIRE_EQUAL(dgram.get_src(), tx.local_address());
+                auto& p = dgram.get_data();
+                p.linearize();
+                received.emplace_back(p.fragments()[0].base, p.len());
+            }
+        }
+        BOOST_REQUIRE(received == payloads);
+
+        tx.close();
+        rx.close();
+    });
+}
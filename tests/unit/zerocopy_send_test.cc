@@ -0,0 +1,113 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Runs with --zerocopy-send-threshold, see CMakeLists.txt
+
+#include <seastar/core/reactor.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/testing/test_case.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// The completion reports of zero-copy sends make the socket poll as
+// failed until they are read. Waiting to read from the socket must not
+// spin on them.
+SEASTAR_TEST_CASE(zerocopy_send_then_read_test) {
+    return seastar::async([] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12346), lo);
+        auto payload = sstring(64 << 10, 'x');
+
+        auto server = seastar::async([&] {
+            accept_result acc = ss.accept().get0();
+            auto in = acc.connection.input();
+            auto out = acc.connection.output();
+            size_t received = 0;
+            while (received < payload.size()) {
+                auto buf = in.read().get0();
+                BOOST_REQUIRE(buf);
+                received += buf.size();
+            }
+            sleep(100ms).get();
+            out.write("done").get();
+            out.close().get();
+            in.close().get();
+        });
+
+        connected_socket cln = connect(ipv4_addr("127.0.0.1", 12346)).get0();
+        auto in = cln.input();
+        auto out = cln.output();
+        out.write(payload).get();
+        out.flush().get();
+
+        auto tasks = engine().get_sched_stats().tasks_processed;
+        auto reply = in.read().get0();
+        auto waited = engine().get_sched_stats().tasks_processed - tasks;
+        BOOST_REQUIRE_EQUAL(sstring(reply.get(), reply.size()), "done");
+        BOOST_REQUIRE_LT(waited, 1000);
+
+        out.close().get();
+        in.close().get();
+        server.get();
+    });
+}
+
+// The data of a zero-copy send is released once the kernel reports it is
+// done with it, even if nothing else happens on the socket afterwards
+SEASTAR_TEST_CASE(zerocopy_send_releases_data_test) {
+    return seastar::async([] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12350), lo);
+        constexpr size_t size = 64 << 10;
+
+        auto server = seastar::async([&] {
+            accept_result acc = ss.accept().get0();
+            auto in = acc.connection.input();
+            size_t received = 0;
+            while (received < size) {
+                auto buf = in.read().get0();
+                BOOST_REQUIRE(buf);
+                received += buf.size();
+            }
+            in.close().get();
+        });
+
+        connected_socket cln = connect(ipv4_addr("127.0.0.1", 12350)).get0();
+        auto out = cln.output();
+        bool released = false;
+        auto data = new char[size];
+        std::fill_n(data, size, 'x');
+        out.write(temporary_buffer<char>(data, size, make_deleter([data, &released] {
+            delete[] data;
+            released = true;
+        }))).get();
+        out.flush().get();
+        server.get();
+
+        for (int i = 0; i < 1000 && !released; i++) {
+            sleep(1ms).get();
+        }
+        BOOST_REQUIRE(released);
+        out.close().get();
+    });
+}